@@ -0,0 +1,379 @@
+/* This file contains a benchmark suite for the decoding and serial round-trip hot paths
+* Decoding is measured with microbenchmarks, and round-trips are measured end to end
+* against the ELM327 simulator. Results are written as JSON so they can be compared between releases
+* This file contains the main entry point for the benchmarks
+*
+* Author: Josh McIntyre
+*/
+
+#include "bench.h"
+
+// Stop the compiler from optimizing away results that are never used
+template <typename T> static void do_not_optimize(T const &value)
+{
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// This function is the main entry point for the benchmarks
+int main(int argc, char* argv[])
+{
+	std::string sim_path = "bin/elmsim";
+	std::string output_path = "";
+	bool micro_only = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = std::string(argv[i]);
+		if (arg == "--help" || arg == "-h")
+		{
+			show_help();
+			exit(0);
+		}
+		else if (arg == "--sim" && i + 1 < argc)
+		{
+			sim_path = std::string(argv[++i]);
+		}
+		else if (arg == "--output" && i + 1 < argc)
+		{
+			output_path = std::string(argv[++i]);
+		}
+		else if (arg == "--micro")
+		{
+			micro_only = true;
+		}
+		else
+		{
+			std::cout << "Usage obdbench [optional: --sim <elmsim path> --output <json file> --micro]\n";
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	std::vector<BenchResult> results = run_decode_benchmarks();
+
+	if (!micro_only)
+	{
+		pid_t sim_pid = start_simulator(sim_path, SIM_LINK);
+		if (sim_pid < 0)
+		{
+			std::cerr << "Unable to start the simulator at " << sim_path << "\n";
+			exit(EXIT_FAILURE);
+		}
+
+		{
+			ElmDevice elm_device(SIM_LINK);
+
+			std::vector<Command::COMMAND> rpm(1, Command::find_command("rpm"));
+			std::vector<Command::COMMAND> dashboard = {
+				Command::find_command("coo"),
+				Command::find_command("rpm"),
+				Command::find_command("spd"),
+				Command::find_command("thr")
+			};
+
+			results.push_back(run_round_trip("get_data/rpm", elm_device, rpm));
+			results.push_back(run_round_trip("get_data_batch/dashboard", elm_device, dashboard));
+		}
+
+		kill(sim_pid, SIGTERM);
+		waitpid(sim_pid, nullptr, 0);
+	}
+
+	std::string json = to_json(results);
+	if (output_path.empty())
+	{
+		std::cout << json;
+	}
+	else
+	{
+		std::ofstream output(output_path);
+		output << json;
+		std::cerr << "Wrote " << results.size() << " results to " << output_path << "\n";
+	}
+
+	return 0;
+}
+
+/* This function runs a function repeatedly for at least MICRO_DURATION_MS
+* and reports the average time per call
+*/
+template <typename Function> BenchResult run_micro(std::string name, Function function)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point end = start + std::chrono::milliseconds(MICRO_DURATION_MS);
+
+	// Check the clock in batches, so reading it doesn't dominate fast functions
+	long iterations = 0;
+	std::chrono::steady_clock::time_point now;
+	do
+	{
+		for (int i = 0; i < 1000; i++)
+		{
+			function();
+		}
+		iterations += 1000;
+		now = std::chrono::steady_clock::now();
+	} while (now < end);
+
+	BenchResult result = { name, iterations, 0, 0, 0, 0 };
+	result.ns_per_op = std::chrono::duration<double, std::nano>(now - start).count() / iterations;
+
+	return result;
+}
+
+// This function benchmarks response decoding for sample responses of each kind
+std::vector<BenchResult> run_decode_benchmarks()
+{
+	std::vector<BenchResult> results;
+
+	Command::COMMAND rpm = Command::find_command("rpm");
+	Command::COMMAND coolant = Command::find_command("coo");
+	Command::COMMAND dtcs = Command::find_command("dtc");
+
+	results.push_back(run_micro("decode_hex/batch", []()
+	{
+		Command::ResponseBytes response;
+		do_not_optimize(Command::decode_hex(RAW_BATCH, response));
+		do_not_optimize(response);
+	}));
+
+	results.push_back(run_micro("decode/rpm", [rpm]()
+	{
+		do_not_optimize(Command::decode(RAW_RPM, rpm));
+	}));
+
+	results.push_back(run_micro("decode/coolant", [coolant]()
+	{
+		do_not_optimize(Command::decode(RAW_COOLANT, coolant));
+	}));
+
+	results.push_back(run_micro("decode/dtcs", [dtcs]()
+	{
+		do_not_optimize(Command::decode(RAW_DTCS, dtcs));
+	}));
+
+	const Command::COMMAND batch[] = {
+		Command::find_command("coo"),
+		Command::find_command("rpm"),
+		Command::find_command("spd"),
+		Command::find_command("thr")
+	};
+	results.push_back(run_micro("decode_batch/dashboard", [&batch]()
+	{
+		Command::Reading readings[4];
+		Command::decode_batch(RAW_BATCH, batch, 4, readings);
+		do_not_optimize(readings);
+	}));
+
+	// Every Mode 01 formula in the table, decoding the same data bytes
+	const unsigned char data[4] = { 0x1A, 0xF8, 0x40, 0x80 };
+	for (int i = 0; i < PID_TABLE_SIZE; i++)
+	{
+		if (PID_TABLE[i].mode != 0x01)
+		{
+			continue;
+		}
+
+		results.push_back(run_micro(std::string("decode_value/") + PID_TABLE[i].name, [i, &data]()
+		{
+			do_not_optimize(Command::decode_value(data, i));
+		}));
+	}
+
+	results.push_back(run_micro("format_dtc", []()
+	{
+		char dtc[6];
+		Command::format_dtc(0x0133, dtc);
+		do_not_optimize(dtc);
+	}));
+
+	// A generic code near the middle of the table, and a manufacturer specific one that isn't in it
+	volatile unsigned short raw_dtcs[] = { 0x0304, 0x1304 };
+	results.push_back(run_micro("dtc/describe", [&raw_dtcs]()
+	{
+		do_not_optimize(Command::get_dtc_description(raw_dtcs[0]));
+		do_not_optimize(Command::get_dtc_description(raw_dtcs[1]));
+	}));
+
+	// Monitor frames are parsed into the ring and released straight away, so it never fills
+	FrameRing ring(64);
+	FrameParser parser(ring, 3);
+	results.push_back(run_micro("monitor/parse_8_frames", [&ring, &parser]()
+	{
+		parser.feed(RAW_MONITOR, 0);
+		const CanFrame* frames;
+		ring.release(ring.read(frames));
+		do_not_optimize(frames);
+	}));
+
+	CanFrame frame = { 1700000000123456, 0x7E8, 8, { 0x03, 0x41, 0x0C, 0x1A, 0xF8, 0x00, 0x00, 0x00 } };
+	results.push_back(run_micro("monitor/format_frame", [&frame]()
+	{
+		char line[CanMonitor::MAX_LINE_LENGTH];
+		do_not_optimize(CanMonitor::format_frame(frame, 3, line));
+		do_not_optimize(line);
+	}));
+
+	// Shared values are written and read back through a table under a name unique to this run
+	std::string shared_name = "obdbench." + std::to_string(getpid());
+	SharedValuesWriter shared_writer(shared_name);
+	SharedValuesReader shared_reader(shared_name);
+	if (shared_writer.is_open() && shared_reader.is_open())
+	{
+		Command::Reading reading = Command::decode(RAW_RPM, rpm);
+		results.push_back(run_micro("shared_values/publish", [&shared_writer, rpm, &reading]()
+		{
+			shared_writer.publish(1700000000123456, rpm, reading);
+		}));
+
+		results.push_back(run_micro("shared_values/read", [&shared_reader, rpm]()
+		{
+			SharedValue value;
+			do_not_optimize(shared_reader.read(rpm, value));
+			do_not_optimize(value);
+		}));
+	}
+
+	// Every stat over a window holding about 100 samples, plus the fuel channels from MAF
+	MetricsEngine metrics;
+	for (std::string spec : { "rpm:min@1", "rpm:max@1", "rpm:mean@1", "rpm:ewma@1", "fuel_rate", "trip_economy" })
+	{
+		metrics.add_metric(spec);
+	}
+	Command::Reading metric_reading = Command::decode(RAW_RPM, rpm);
+	int64_t metric_timestamp_us = 0;
+	results.push_back(run_micro("metrics/add_sample", [&metrics, rpm, &metric_reading, &metric_timestamp_us]()
+	{
+		metric_timestamp_us += 10000;
+		metric_reading.value = (metric_timestamp_us / 10000) % 7000;
+		metrics.add_sample(metric_timestamp_us, rpm, metric_reading);
+		double value;
+		do_not_optimize(metrics.get_value(0, value));
+		do_not_optimize(value);
+	}));
+
+	// Compressed recording of an rpm sweep every 10 ms, starting a new block as the real recorder does
+	BlockEncoder encoder;
+	int64_t encoder_timestamp_us = 0;
+	results.push_back(run_micro("recorder/encode_sample", [&encoder, &encoder_timestamp_us]()
+	{
+		if (encoder.get_data().size() > 65536)
+		{
+			encoder.reset(encoder_timestamp_us);
+		}
+		encoder_timestamp_us += 10000;
+		encoder.add(encoder_timestamp_us, 0x010C, (encoder_timestamp_us / 10000) % 7000 * 0.25, Command::STATUS_OK, 0);
+	}));
+
+	return results;
+}
+
+/* This function measures full request/response round-trips through ElmDevice
+* It reports samples per second, counting every decoded value, and round-trip percentiles
+*/
+BenchResult run_round_trip(std::string name, ElmDevice &elm_device, std::vector<Command::COMMAND> cmds)
+{
+	std::vector<double> round_trips_us;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point end = start + std::chrono::milliseconds(ROUND_TRIP_DURATION_MS);
+	std::chrono::steady_clock::time_point now = start;
+	while (now < end)
+	{
+		std::chrono::steady_clock::time_point before = now;
+		if (cmds.size() == 1)
+		{
+			do_not_optimize(elm_device.get_data(cmds[0]));
+		}
+		else
+		{
+			do_not_optimize(elm_device.get_data_batch(cmds));
+		}
+
+		now = std::chrono::steady_clock::now();
+		round_trips_us.push_back(std::chrono::duration<double, std::micro>(now - before).count());
+	}
+
+	std::sort(round_trips_us.begin(), round_trips_us.end());
+
+	BenchResult result = { name, (long) round_trips_us.size(), 0, 0, 0, 0 };
+	double elapsed_s = std::chrono::duration<double>(now - start).count();
+	result.ns_per_op = elapsed_s * 1e9 / result.iterations;
+	result.samples_per_sec = result.iterations * cmds.size() / elapsed_s;
+	result.p50_us = round_trips_us[round_trips_us.size() / 2];
+	result.p99_us = round_trips_us[std::min(round_trips_us.size() - 1, round_trips_us.size() * 99 / 100)];
+
+	return result;
+}
+
+/* This function starts the ELM327 simulator in a child process, linked at link_path
+* It waits for the simulator to print its port before returning
+*/
+pid_t start_simulator(std::string sim_path, std::string link_path)
+{
+	int output[2];
+	if (pipe(output) != 0)
+	{
+		return -1;
+	}
+
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		dup2(output[1], STDOUT_FILENO);
+		close(output[0]);
+		execl(sim_path.c_str(), sim_path.c_str(), "--link", link_path.c_str(), "--seed", "1", (char*) nullptr);
+		_exit(EXIT_FAILURE);
+	}
+
+	close(output[1]);
+
+	char buffer[256];
+	ssize_t bytes_read = read(output[0], buffer, sizeof(buffer));
+	close(output[0]);
+
+	if (pid < 0 || bytes_read <= 0)
+	{
+		return -1;
+	}
+
+	return pid;
+}
+
+// This function converts benchmark results to a JSON document
+std::string to_json(std::vector<BenchResult> results)
+{
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(3);
+	ss << "{\n";
+	ss << "  \"timestamp\": " << std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count() << ",\n";
+	ss << "  \"benchmarks\": [\n";
+
+	for (std::vector<BenchResult>::size_type i = 0; i < results.size(); i++)
+	{
+		const BenchResult& result = results[i];
+		ss << "    { \"name\": \"" << result.name << "\", \"iterations\": " << result.iterations
+			<< ", \"ns_per_op\": " << result.ns_per_op;
+
+		if (result.samples_per_sec > 0)
+		{
+			ss << ", \"samples_per_sec\": " << result.samples_per_sec
+				<< ", \"p50_us\": " << result.p50_us
+				<< ", \"p99_us\": " << result.p99_us;
+		}
+
+		ss << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+
+	ss << "  ]\n";
+	ss << "}\n";
+
+	return ss.str();
+}
+
+void show_help()
+{
+	std::cout << "'--sim <path>'\t\tPath to the ELM327 simulator (default bin/elmsim)\n";
+	std::cout << "'--output <file>'\tWrite the JSON results to a file instead of stdout\n";
+	std::cout << "'--micro'\t\tOnly run the decoding microbenchmarks\n";
+}
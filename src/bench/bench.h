@@ -0,0 +1,63 @@
+/* This file contains function declarations and includes for the benchmark suite
+*
+* Author: Josh McIntyre
+*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "elm_device.h"
+#include "monitor.h"
+#include "shared_values.h"
+#include "metrics.h"
+#include "recorder.h"
+
+// This struct holds the result of a single benchmark
+struct BenchResult
+{
+	std::string name;
+	long iterations;
+	double ns_per_op;
+	double samples_per_sec;
+	double p50_us;
+	double p99_us;
+};
+
+template <typename Function> BenchResult run_micro(std::string name, Function function);
+BenchResult run_round_trip(std::string name, ElmDevice &elm_device, std::vector<Command::COMMAND> cmds);
+std::vector<BenchResult> run_decode_benchmarks();
+pid_t start_simulator(std::string sim_path, std::string link_path);
+std::string to_json(std::vector<BenchResult> results);
+void show_help();
+
+// Minimum run time of each benchmark
+const long MICRO_DURATION_MS = 200;
+const long ROUND_TRIP_DURATION_MS = 2000;
+
+// Where the simulated adapter is linked while the round-trip benchmarks run
+const std::string SIM_LINK = "/tmp/obdbench_tty";
+
+// Sample raw responses, as returned by an ELM327 with its default settings
+const std::string RAW_RPM = "41 0C 1A F8 \r\r>";
+const std::string RAW_COOLANT = "41 05 7B \r\r>";
+const std::string RAW_DTCS = "43 01 33 04 20 00 00 \r\r>";
+const std::string RAW_BATCH = "00E \r0: 41 05 7B 0C 1A F8 \r1: 0D 00 11 20 00 00 00 \r\r>";
+
+// A chunk of AT MA monitor output with headers on and spaces off, 8 frames long
+const std::string RAW_MONITOR = "1000C1AF800000000\r10105000000000001\r1027B000000000002\r10311000000000003\r"
+	"7E803410C1AF80000\r7E00201000000000000\r18A00000000000000\r1FF0102030405060708\r";
+
+#endif
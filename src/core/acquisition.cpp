@@ -0,0 +1,154 @@
+/* This file contains code that polls a device in the background and hands the samples
+* to any number of consumers
+*
+* Author: Josh McIntyre
+*/
+
+#include "acquisition.h"
+
+// This constructor allocates a ring, rounding the capacity up to a power of two
+SampleRing::SampleRing(std::size_t capacity)
+{
+	std::size_t size = 1;
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+
+	slots.resize(size);
+	mask = size - 1;
+	head = 0;
+	tail = 0;
+	dropped = 0;
+}
+
+/* This function adds a sample to the ring, from the producer thread
+* It returns false, and counts the sample as dropped, if the ring is full
+*/
+bool SampleRing::push(const Sample& sample)
+{
+	std::size_t position = head.load(std::memory_order_relaxed);
+	if (position - tail.load(std::memory_order_acquire) == slots.size())
+	{
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	slots[position & mask] = sample;
+	head.store(position + 1, std::memory_order_release);
+
+	return true;
+}
+
+// This function takes the oldest sample from the ring, from the consumer thread. It returns false if the ring is empty
+bool SampleRing::pop(Sample& sample)
+{
+	std::size_t position = tail.load(std::memory_order_relaxed);
+	if (position == head.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	sample = slots[position & mask];
+	tail.store(position + 1, std::memory_order_release);
+
+	return true;
+}
+
+// This function returns how many samples were dropped because the consumer fell behind
+unsigned long SampleRing::get_dropped()
+{
+	return dropped.load(std::memory_order_relaxed);
+}
+
+/* This constructor sets up acquisition for a device and its schedule
+* Both are used only by the acquisition thread between start() and stop()
+*/
+Acquisition::Acquisition(ElmDevice& elm_device, PollScheduler& scheduler) : elm_device(elm_device), scheduler(scheduler)
+{
+	shared_values = nullptr;
+	stopped = false;
+}
+
+// This destructor stops the acquisition thread if it's still running
+Acquisition::~Acquisition()
+{
+	stop();
+}
+
+// This function adds a consumer. It must be called before start()
+SampleRing* Acquisition::subscribe(std::size_t capacity)
+{
+	rings.push_back(std::unique_ptr<SampleRing>(new SampleRing(capacity)));
+	return rings.back().get();
+}
+
+// This function publishes the latest value of every item to a shared table as well. It must be called before start()
+void Acquisition::share(SharedValuesWriter* writer)
+{
+	shared_values = writer;
+}
+
+// This function starts polling on the acquisition thread
+void Acquisition::start()
+{
+	stopped = false;
+	thread = std::thread([this]()
+	{
+		run();
+	});
+}
+
+// This function stops polling and waits for the fetch in progress to finish
+void Acquisition::stop()
+{
+	stopped = true;
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+}
+
+/* This function polls the schedule until stopped, publishing every updated item to every ring
+* and the shared table
+* Waits for the next deadline are split into short sleeps, so stopping doesn't have to wait
+* out a slow item's whole period
+*/
+void Acquisition::run()
+{
+	const std::chrono::milliseconds stop_check(50);
+
+	while (!stopped && !scheduler.get_items().empty())
+	{
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		std::chrono::steady_clock::time_point deadline = scheduler.get_next_deadline();
+		if (deadline > now)
+		{
+			std::this_thread::sleep_until(std::min(deadline, now + stop_check));
+			continue;
+		}
+
+		std::vector<int> batch = scheduler.select_batch(now);
+		std::vector<Command::Reading> readings = elm_device.get_data_batch(scheduler.get_commands(batch));
+		scheduler.complete_batch(batch, readings, std::chrono::steady_clock::now());
+
+		Sample sample;
+		sample.timestamp_us = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+		sample.device = 0;
+		for (int index : batch)
+		{
+			sample.index = index;
+			sample.item = scheduler.get_items()[index];
+			for (std::unique_ptr<SampleRing>& ring : rings)
+			{
+				ring -> push(sample);
+			}
+
+			if (shared_values != nullptr)
+			{
+				shared_values -> publish(sample.timestamp_us, sample.item.cmd, sample.item.reading);
+			}
+		}
+	}
+}
@@ -0,0 +1,83 @@
+/* This file contains function declarations and includes for background sample acquisition
+*
+* Author: Josh McIntyre
+*/
+
+#ifndef ACQUISITION_H
+#define ACQUISITION_H
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include "elm_device.h"
+#include "scheduler.h"
+#include "shared_values.h"
+
+/* This struct holds one published sample: a copy of the item's schedule and latest reading
+* as they were right after the fetch, and the index of the item in the schedule
+* The device is the sample's device number in a fleet, and 0 otherwise
+*/
+struct Sample
+{
+	int64_t timestamp_us;
+	int device;
+	int index;
+	ScheduledItem item;
+};
+
+/* This class is a lock-free ring buffer of samples with one producer and one consumer
+* The producer never waits: when the ring is full, the new sample is dropped and counted,
+* so a slow consumer loses samples instead of slowing down the serial link
+*/
+class SampleRing
+{
+	private:
+		std::vector<Sample> slots;
+		std::size_t mask;
+
+		// The producer and consumer positions are kept on separate cache lines
+		alignas(64) std::atomic<std::size_t> head;
+		alignas(64) std::atomic<std::size_t> tail;
+		alignas(64) std::atomic<unsigned long> dropped;
+
+	public:
+		// Enough for several seconds of samples at full speed
+		static const std::size_t DEFAULT_CAPACITY = 4096;
+
+		SampleRing(std::size_t capacity = DEFAULT_CAPACITY);
+		bool push(const Sample& sample);
+		bool pop(Sample& sample);
+		unsigned long get_dropped();
+};
+
+/* This class polls a device on its own thread and publishes every sample
+* Each consumer, such as a display or a recorder, subscribes before start() and gets its
+* own ring, so it can read at its own pace without holding up the others or the device
+* The latest values can also be shared with other processes, straight from this thread
+*/
+class Acquisition
+{
+	private:
+		ElmDevice& elm_device;
+		PollScheduler& scheduler;
+		std::vector<std::unique_ptr<SampleRing> > rings;
+		SharedValuesWriter* shared_values;
+		std::thread thread;
+		std::atomic<bool> stopped;
+
+		void run();
+
+	public:
+		Acquisition(ElmDevice& elm_device, PollScheduler& scheduler);
+		~Acquisition();
+		SampleRing* subscribe(std::size_t capacity = SampleRing::DEFAULT_CAPACITY);
+		void share(SharedValuesWriter* writer);
+		void start();
+		void stop();
+};
+
+#endif
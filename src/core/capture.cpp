@@ -0,0 +1,172 @@
+/* This file contains code that writes and reads raw serial transcript captures
+*
+* Author: Josh McIntyre
+*/
+
+#include "capture.h"
+
+// This function returns the current wall clock time in microseconds since the epoch
+int64_t Capture::now_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// This function escapes raw bytes so they fit in a single capture field
+void Capture::escape(std::string_view raw, std::string& escaped)
+{
+	for (char c : raw)
+	{
+		unsigned char byte = (unsigned char) c;
+		switch (c)
+		{
+			case '\r':
+				escaped += "\\r";
+				break;
+
+			case '\n':
+				escaped += "\\n";
+				break;
+
+			case '\t':
+				escaped += "\\t";
+				break;
+
+			case '\\':
+				escaped += "\\\\";
+				break;
+
+			default:
+				if (byte < 0x20 || byte >= 0x7F)
+				{
+					escaped += "\\x";
+					escaped += Command::format_hex_byte(byte);
+				}
+				else
+				{
+					escaped += c;
+				}
+		}
+	}
+}
+
+/* This function reverses escape()
+* It returns false if a \x escape isn't followed by two hex digits
+*/
+bool Capture::unescape(std::string_view escaped, std::string& raw)
+{
+	for (std::string_view::size_type i = 0; i < escaped.length(); i++)
+	{
+		if (escaped[i] != '\\' || i + 1 == escaped.length())
+		{
+			raw += escaped[i];
+			continue;
+		}
+
+		char c = escaped[++i];
+		if (c == 'r')
+		{
+			raw += '\r';
+		}
+		else if (c == 'n')
+		{
+			raw += '\n';
+		}
+		else if (c == 't')
+		{
+			raw += '\t';
+		}
+		else if (c == 'x')
+		{
+			int high = (i + 2 < escaped.length()) ? Command::hex_value(escaped[i + 1]) : -1;
+			int low = (i + 2 < escaped.length()) ? Command::hex_value(escaped[i + 2]) : -1;
+			if (high < 0 || low < 0)
+			{
+				return false;
+			}
+
+			raw += (char) (high * 16 + low);
+			i += 2;
+		}
+		else
+		{
+			raw += c;
+		}
+	}
+
+	return true;
+}
+
+// This constructor opens a capture file, appending to it if it already exists
+CaptureWriter::CaptureWriter(std::string path)
+{
+	file.open(path, std::ios::binary | std::ios::app);
+}
+
+bool CaptureWriter::is_open()
+{
+	return file.is_open() && file.good();
+}
+
+/* This function appends an exchange to the capture
+* Writes are buffered, so capturing doesn't add a disk write to every serial round-trip
+*/
+void CaptureWriter::write(const CaptureRecord& record)
+{
+	std::string line = std::to_string(record.timestamp_us) + "\t" + std::to_string(record.round_trip_us) + "\t";
+	Capture::escape(record.command, line);
+	line += "\t";
+	Capture::escape(record.response, line);
+	line += "\n";
+
+	file.write(line.c_str(), line.length());
+}
+
+void CaptureWriter::flush()
+{
+	file.flush();
+}
+
+CaptureReader::CaptureReader(std::string path)
+{
+	file.open(path, std::ios::binary);
+}
+
+bool CaptureReader::is_open()
+{
+	return file.is_open();
+}
+
+/* This function reads the next exchange from the capture
+* Malformed lines, such as a partial last line, are skipped
+* It returns false at the end of the file
+*/
+bool CaptureReader::next(CaptureRecord& record)
+{
+	while (std::getline(file, line))
+	{
+		std::string::size_type first = line.find('\t');
+		std::string::size_type second = (first == std::string::npos) ? first : line.find('\t', first + 1);
+		std::string::size_type third = (second == std::string::npos) ? second : line.find('\t', second + 1);
+		if (third == std::string::npos)
+		{
+			continue;
+		}
+
+		record.timestamp_us = std::strtoll(line.c_str(), nullptr, 10);
+		record.round_trip_us = std::strtoll(line.c_str() + first + 1, nullptr, 10);
+		record.command.clear();
+		record.response.clear();
+
+		std::string_view fields(line);
+		if (!Capture::unescape(fields.substr(second + 1, third - second - 1), record.command)
+			|| !Capture::unescape(fields.substr(third + 1), record.response))
+		{
+			continue;
+		}
+
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,68 @@
+/* This file contains function declarations and includes for raw serial transcript captures
+*
+* Author: Josh McIntyre
+*/
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <chrono>
+
+#include "command.h"
+
+/* A capture is a text file with one exchange per line:
+* <timestamp_us>\t<round_trip_us>\t<command>\t<response>
+* The timestamp is microseconds since the epoch when the command was written, and
+* the response is the raw bytes up to and including the > prompt. Control characters,
+* tabs and backslashes are escaped, such as \r, so every exchange stays on one line
+* Failed exchanges, such as timeouts, have an empty response
+*/
+struct CaptureRecord
+{
+	int64_t timestamp_us;
+	int64_t round_trip_us;
+	std::string command;
+	std::string response;
+};
+
+// This class appends command/response exchanges to a capture file
+class CaptureWriter
+{
+	private:
+		std::ofstream file;
+
+	public:
+		CaptureWriter(std::string path);
+		bool is_open();
+		void write(const CaptureRecord& record);
+		void flush();
+};
+
+// This class reads the exchanges in a capture file back in order
+class CaptureReader
+{
+	private:
+		std::ifstream file;
+		std::string line;
+
+	public:
+		CaptureReader(std::string path);
+		bool is_open();
+		bool next(CaptureRecord& record);
+};
+
+// This class holds the escaping helpers shared by the capture writer and reader
+class Capture
+{
+	public:
+		static int64_t now_us();
+		static void escape(std::string_view raw, std::string& escaped);
+		static bool unescape(std::string_view escaped, std::string& raw);
+};
+
+#endif
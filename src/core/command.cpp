@@ -6,301 +6,688 @@
 
 #include "command.h"
 
-// Define constants for the ELM327 command strings
+// Define constants for the ELM327 setting command strings
 const char Command::CMD_ECHO_OFF[] = "AT E0\r";
-
-const char Command::CMD_GET_DTCS[] = "03\r";
-const char Command::CMD_GET_COOLANT_TEMP[] = "0105\r";
-const char Command::CMD_GET_ENGINE_RPM[] = "010C\r";
-const char Command::CMD_GET_VEHICLE_SPEED[] = "010D\r";
-const char Command::CMD_GET_THROTTLE_POS[] = "0111\r";
+const char Command::CMD_SPACES_OFF[] = "AT S0\r";
+const char Command::CMD_LINEFEEDS_OFF[] = "AT L0\r";
+const char Command::CMD_ADAPTIVE_TIMING[] = "AT AT2\r";
+const char Command::CMD_SET_BAUD_DIVISOR[] = "AT BRD ";
+const char Command::CMD_SET_TIMEOUT[] = "AT ST ";
+const char Command::CMD_SUPPORTED_PIDS[] = "0100\r";
+const char Command::CMD_SET_PROTOCOL[] = "AT SP ";
+const char Command::CMD_PROTOCOL_NUMBER[] = "AT DPN\r";
+const char Command::CMD_HEADERS_ON[] = "AT H1\r";
+const char Command::CMD_HEADERS_OFF[] = "AT H0\r";
+const char Command::CMD_CAN_FORMATTING_ON[] = "AT CAF1\r";
+const char Command::CMD_CAN_FORMATTING_OFF[] = "AT CAF0\r";
+const char Command::CMD_SET_RECEIVE_ADDRESS[] = "AT CRA ";
+const char Command::CMD_SET_CAN_FILTER[] = "AT CF ";
+const char Command::CMD_SET_CAN_MASK[] = "AT CM ";
+const char Command::CMD_AUTO_RECEIVE[] = "AT AR\r";
+const char Command::CMD_MONITOR_ALL[] = "AT MA\r";
 
 const char Command::RET_NO_DATA[] = "NO DATA";
 const char Command::RET_EMPTY[] = "";
+const char Command::RET_TIMEOUT[] = "TIMEOUT";
+const char Command::RET_INVALID[] = "INVALID";
+
+// This function returns the ELM327 command string for a supported command
+std::string Command::get_command_string(COMMAND command)
+{
+	return std::string(get_info(command).command);
+}
 
-std::map<char, std::string> Command::dtc_prefixes = { 
-			{ '0', "P0" },
-			{ '1', "P1" },
-			{ '2', "P2" },
-			{ '3', "P3" },
-			{ '4', "C0" },
-			{ '5', "C1" },
-			{ '6', "C2" },
-			{ '7', "C3" },
-			{ '8', "B0" },
-			{ '9', "B1" },
-			{ 'A', "B2" },
-			{ 'B', "B3" },
-			{ 'C', "U0" },
-			{ 'D', "U1" },
-			{ 'E', "U2" },
-			{ 'F', "U3" }
-		};
-
-/* This function interprets the raw data returned from a command
-* It returns the data in a human-readable format
+/* This function checks whether a command can be packed into a batched request
+* Only Mode 01 (current data) commands can be combined
 */
-std::string Command::interpret_raw(std::string raw_data, COMMAND command)
+bool Command::is_batchable(COMMAND command)
 {
-	// If no data was returned, skip trimming and interpretation
-	if (raw_data.find(std::string(RET_NO_DATA)) != std::string::npos)
-	{
-		return std::string(RET_NO_DATA);
-	}
-	
-	// Do preliminary trimming
-	std:: string trimmed_data = trim_raw(raw_data);
-	
-	// Call the appropriate interpretation function
-	std::string readable_data;
-	
-	switch (command)
-	{
-		case GET_DTCS:
-			readable_data = interpret_dtcs(trimmed_data);
-			break;
-
-		case GET_COOLANT_TEMP:
-			readable_data = interpret_coolant_temp(trimmed_data);
-			break;
-
-		case GET_ENGINE_RPM: 
-			readable_data = interpret_engine_rpm(trimmed_data);
-			break;
-
-		case GET_VEHICLE_SPEED:
-			readable_data = interpret_vehicle_speed(trimmed_data);
-			break;
-		
-		case GET_THROTTLE_POS:
-			readable_data = interpret_throttle_pos(trimmed_data);
-			break;
-	}
-
-	return readable_data;
+	return get_info(command).mode == 0x01;
+}
+
+// This function returns the suffix used to display a value in the given unit
+const char* Command::get_unit_suffix(UNIT unit)
+{
+	switch (unit)
+	{
+		case UNIT_CELSIUS:
+			return "\370C";
+
+		case UNIT_RPM:
+			return " RPM";
+
+		case UNIT_KPH:
+			return " km/h";
+
+		case UNIT_PERCENT:
+			return "%";
+
+		case UNIT_KPA:
+			return " kPa";
+
+		case UNIT_PA:
+			return " Pa";
+
+		case UNIT_DEGREES:
+			return "\370";
+
+		case UNIT_GRAMS_PER_SEC:
+			return " g/s";
+
+		case UNIT_VOLTS:
+			return " V";
+
+		case UNIT_SECONDS:
+			return " s";
+
+		case UNIT_MINUTES:
+			return " min";
+
+		case UNIT_KM:
+			return " km";
+
+		case UNIT_LITERS_PER_HOUR:
+			return " L/h";
+
+		case UNIT_NEWTON_METERS:
+			return " Nm";
+
+		default:
+			return "";
+	}
 }
 
-/* This function does preliminary string trimming for data interpretation
-* Return data for all commands should be run through this function
+/* This function decodes the raw data returned from a command
+* It works directly on the raw ELM327 bytes and never allocates; converting the
+* reading to a human-readable string is left to the caller
 */
-std::string Command::trim_raw(std::string raw_data)
+Command::Reading Command::decode(std::string_view raw_data, COMMAND command)
 {
-		/* First, remove extraneous characters and whitespace from the string
-	* Removing whitespace with boost's string methods will save a significant
-	* amount of time over turning of spaces with an ELM327 AT command (AT S0)
-	*/
-	boost::erase_all(raw_data, "\r");
-	boost::erase_all(raw_data, "\n");
-	boost::erase_all(raw_data, " ");
-	boost::erase_all(raw_data, ">");
-	
-	/* Next, strip the first two return characters from the raw data string
-	* They indicate a returned PID but are meaningless for us
+	// If the device didn't respond before the deadline, there is nothing to decode
+	if (raw_data.empty())
+	{
+		return make_reading(STATUS_TIMEOUT, command);
+	}
+
+	// If no data was returned, skip decoding
+	if (raw_data.find(RET_NO_DATA) != std::string_view::npos)
+	{
+		return make_reading(STATUS_NO_DATA, command);
+	}
+
+	ResponseBytes response;
+	if (!decode_hex(raw_data, response))
+	{
+		return make_reading(STATUS_INVALID, command);
+	}
+
+	const PidInfo& info = get_info(command);
+	if (info.type == TYPE_DTCS)
+	{
+		return decode_dtcs(response, command);
+	}
+	else if (info.type == TYPE_TEXT)
+	{
+		return decode_text(response, command);
+	}
+
+	/* Mode 01 responses start with 41 and an echo of the requested PID, such as 41 0C,
+	* followed by the data bytes. If several ECUs answer, the first full answer is used
 	*/
-	std::string trimmed_data = raw_data.substr(2);
-	
-	return trimmed_data;
+	for (int m = 0; m < response.message_count; m++)
+	{
+		const unsigned char* message = response.bytes + response.message_starts[m];
+		if (response.message_lengths[m] >= 2 + info.data_length && message[0] == 0x41 && message[1] == info.pid)
+		{
+			return decode_value(message + 2, command);
+		}
+	}
+
+	return make_reading(STATUS_INVALID, command);
 }
 
-/* This function takes trimmed data and interprets it so that
-* human-readable diagnostic trouble codes (DTC's) can be returned
+/* This function decodes diagnostic trouble codes (DTC's) from a Mode 03 (stored), 07 (pending)
+* or 0A (permanent) response. Each DTC is 2 bytes following the 43, 47 or 4A response header.
+* CAN messages have a count of codes after the header, which makes the length of the message
+* even, while other protocols send codes three at a time, padded with 0000
+* Codes from every ECU that answers are collected, each code listed once
 */
-std::string Command::interpret_dtcs(std::string trimmed_data)
+Command::Reading Command::decode_dtcs(const ResponseBytes& response, COMMAND command)
 {
-	std::vector<std::string> raw_dtcs;
-	std::vector<std::string> dtc_strings;
+	Reading reading = make_reading(STATUS_OK, command);
+	unsigned char header = get_response_mode(command);
+
+	bool found = false;
+	for (int m = 0; m < response.message_count; m++)
+	{
+		const unsigned char* message = response.bytes + response.message_starts[m];
+		int length = response.message_lengths[m];
+		if (length < 1 || message[0] != header)
+		{
+			continue;
+		}
+		found = true;
+
+		int start = 1;
+		if (length % 2 == 0)
+		{
+			length = std::min(length, 2 + 2 * message[1]);
+			start = 2;
+		}
+
+		for (int i = start; i + 1 < length && reading.dtc_count < MAX_DTCS; i += 2)
+		{
+			unsigned short raw_dtc = (message[i] << 8) | message[i + 1];
+
+			/* 0000 indicates an empty slot in the message
+			* Any other value is a valid code, including the hex digits of codes such as P0A80
+			* that hybrids and newer ECUs report
+			*/
+			if (raw_dtc == 0)
+			{
+				continue;
+			}
+
+			if (std::find(reading.dtcs, reading.dtcs + reading.dtc_count, raw_dtc) == reading.dtcs + reading.dtc_count)
+			{
+				reading.dtcs[reading.dtc_count++] = raw_dtc;
+			}
+		}
+	}
 
-	if (trimmed_data.length() >= 12)
+	if (!found)
 	{
-		raw_dtcs.push_back(trimmed_data.substr(0,4));
-		raw_dtcs.push_back(trimmed_data.substr(4,4));
-		raw_dtcs.push_back(trimmed_data.substr(8,4));
+		reading.status = STATUS_INVALID;
 	}
-	else
+
+	return reading;
+}
+
+/* This function decodes text, such as the VIN or calibration IDs, from a Mode 09 response
+* Each message starts with 49, the PID and a byte that's the number of items on CAN or the
+* message number on other protocols, which send the text 4 bytes at a time
+* The text is split into strings of the command's data_length, separated by commas, and
+* the zero padding around each string is dropped
+*/
+Command::Reading Command::decode_text(const ResponseBytes& response, COMMAND command)
+{
+	Reading reading = make_reading(STATUS_INVALID, command);
+	const PidInfo& info = get_info(command);
+
+	// Join the data of every message, in the order they arrived
+	unsigned char data[MAX_RESPONSE_BYTES];
+	int length = 0;
+	for (int m = 0; m < response.message_count; m++)
 	{
-		return RET_EMPTY;
+		const unsigned char* message = response.bytes + response.message_starts[m];
+		if (response.message_lengths[m] < 3 || message[0] != get_response_mode(command) || message[1] != info.pid)
+		{
+			continue;
+		}
+
+		std::copy(message + 3, message + response.message_lengths[m], data + length);
+		length += response.message_lengths[m] - 3;
+		reading.status = STATUS_OK;
 	}
 
-	// Parse each raw DTC
-	std::regex dtc_regex("[PCBU][0123]\\d{3}");
-	std::vector<std::string>::iterator it;
-	for (it = raw_dtcs.begin(); it != raw_dtcs.end(); it++)
+	// Strings that don't divide the data evenly, such as a padded VIN, are read as one
+	int string_length = (info.data_length > 0 && length % info.data_length == 0) ? info.data_length : std::max(length, 1);
+
+	int text_length = 0;
+	for (int start = 0; start < length; start += string_length)
 	{
-		/* Up to 3 DTCs can be returned in one message, but the message is always 12 bytes
-		* 0000 indicates an empty slot in the message
-		*/
-		if (*it != "0000")
+		if (text_length > 0 && text_length + 2 < MAX_TEXT)
 		{
-			char prefix_char = (*it)[0];
-			std::string dtc = dtc_prefixes[prefix_char] + (*it).substr(1);
-			
-			/* Before pushing the DTC to the list, check and ensure
-			* that it's actually a valid trouble code. Some cars can
-			* return nonzero garbage that should be excluded
-			*/
-			if (std::regex_match(dtc, dtc_regex))
+			reading.text[text_length++] = ',';
+			reading.text[text_length++] = ' ';
+		}
+
+		for (int i = start; i < start + string_length && i < length && text_length + 1 < MAX_TEXT; i++)
+		{
+			if (data[i] >= 0x20 && data[i] < 0x7F)
 			{
-				dtc_strings.push_back(dtc);
+				reading.text[text_length++] = data[i];
 			}
 		}
 	}
-	
-	// Merge the parsed DTCs into a single return string
-	std::string joined_dtcs = boost::algorithm::join(dtc_strings, ", ");
-	
-	return joined_dtcs;
+	reading.text[text_length] = '\0';
+
+	return reading;
 }
 
-/* This helper function takes an individual 2 byte raw hexadecimal DTC 
-* (diagnostic trouble code) and converts it to a human-readable format
+/* This function decodes the data bytes of a Mode 01 response
+* using the formula from the command's PID_TABLE entry
 */
-std::string Command::parse_raw_dtc(std::string raw_dtc)
+Command::Reading Command::decode_value(const unsigned char* data, COMMAND command)
 {
-	std::string readable_dtc;
-	
-	char first = raw_dtc[0];
-	
-	
-	
-	return readable_dtc;
+	Reading reading = make_reading(STATUS_OK, command);
+	reading.value = get_info(command).formula(data);
+
+	return reading;
 }
 
-/* This function takes trimmed data and interprets it so that
-* a human-readable coolant temperature can be returned
-* The temperature will be returned in degrees Celcius
+/* This function builds a single request for up to MAX_BATCH_SIZE Mode 01 commands
+* For example, coolant temp and engine RPM become "01050C\r"
 */
-std::string Command::interpret_coolant_temp(std::string trimmed_data)
+std::string Command::build_batch_command(std::vector<COMMAND> commands)
 {
-	/* Further command-specific trimming - remove extraneous PID echo 05 if it's
-	* at the beginning of the data
-	*/
-	if (boost::starts_with(trimmed_data, "05"));
+	std::string batch_command = "01";
+
+	std::vector<COMMAND>::iterator it;
+	for (it = commands.begin(); it != commands.end(); it++)
 	{
-		trimmed_data = trimmed_data.substr(2);
+		unsigned char pid = get_info(*it).pid;
+		batch_command += format_hex_byte(pid);
 	}
-	
-	// Convert the data to an integer format
-	int int_data = hex_data_to_int(trimmed_data);
-	
-	/* Finally, perform the appropriate formula calculation specified by the OBDII standard
-	* The formula is X - 40 = temperature in degrees Celcius
-	*/
-	int_data = int_data - 40;
+	batch_command += "\r";
 
-	// Build the return string
-	std::stringstream ss;
-	ss << int_data;
-	
-	return ss.str();
+	return batch_command;
 }
 
-/* This function takes trimmed data and interprets it so that
-* a human-readable engine RPM can be returned
+/* This function decodes the raw data returned from a batched Mode 01 request
+* The response is a single 41 header followed by PID/data pairs in any order, such as
+* 41 05 7B 0C 1A F8, so each pair is matched back to its command by PID
+* The readings are written in the same order as the commands
 */
-std::string Command::interpret_engine_rpm(std::string trimmed_data)
+void Command::decode_batch(std::string_view raw_data, const COMMAND* commands, int count, Reading* readings)
 {
-	std::string readable_data;
-	
-	/* Further command-specific trimming - remove extraneous PID echo 0C if it's
-	* at the beginning of the data
-	*/
-	if (boost::starts_with(trimmed_data, "0C"));
+	STATUS initial_status = raw_data.empty() ? STATUS_TIMEOUT : STATUS_NO_DATA;
+	for (int i = 0; i < count; i++)
 	{
-		trimmed_data = trimmed_data.substr(2);
+		readings[i] = make_reading(initial_status, commands[i]);
 	}
-	
-	/* Next we have to split up the two response bytes
-	* each byte is represented by 2 hex characters and comprises the
-	* "X and Y" in the OBDII standard RPM formula
-	*/
-	std::string x_byte = trimmed_data.substr(0, 2);
-	std::string y_byte = trimmed_data.substr(2);
-	
-	// Convert the data to an integer format
-	int int_x = hex_data_to_int(x_byte);
-	int int_y = hex_data_to_int(y_byte);
-	
-	/* Finally, perform the appropriate formula calculation specified by the OBDII standard
-	* The formula is (256X + Y) / 4 = revolutions per minute
-	*/
-	int int_data = std::ceil( (256.0 * int_x + int_y) / 4.0 );
 
-	// Build the return string
-	std::stringstream ss;
-	ss << int_data;
-	
-	return ss.str();
+	// If no data was returned, none of the PIDs are available
+	if (raw_data.empty() || raw_data.find(RET_NO_DATA) != std::string_view::npos)
+	{
+		return;
+	}
 
-	readable_data = trimmed_data;
-	return readable_data;
+	ResponseBytes response;
+	if (!decode_hex(raw_data, response))
+	{
+		return;
+	}
 
+	// Every ECU that answers sends its own message, carrying the PIDs it supports
+	for (int m = 0; m < response.message_count; m++)
+	{
+		const unsigned char* message = response.bytes + response.message_starts[m];
+		int length = response.message_lengths[m];
+		if (message[0] != 0x41)
+		{
+			continue;
+		}
+
+		// Walk the PID/data pairs following the header
+		int pos = 1;
+		while (pos < length)
+		{
+			unsigned char pid = message[pos];
+
+			// Find the requested command for this PID. Anything else is padding or garbage
+			int i;
+			for (i = 0; i < count; i++)
+			{
+				if (get_info(commands[i]).pid == pid)
+				{
+					break;
+				}
+			}
+
+			if (i == count)
+			{
+				break;
+			}
+
+			int data_length = get_info(commands[i]).data_length;
+			if (pos + 1 + data_length > length)
+			{
+				break;
+			}
+
+			if (readings[i].status != STATUS_OK)
+			{
+				readings[i] = decode_value(message + pos + 1, commands[i]);
+			}
+			pos += 1 + data_length;
+		}
+	}
 }
 
-/* This function takes trimmed data and interprets it so that
-* a human-readable vehicle speed can be returned
-* The speed will returned in kilometers per hour
+/* This function parses a request sent to the ELM327, such as 010C0D\r, back into its commands
+* It's used to decode captured exchanges without knowing which items were polled
+* AT commands and unknown PIDs yield no commands, and a trailing response count digit is ignored
+* It returns the number of commands written
 */
-std::string Command::interpret_vehicle_speed(std::string trimmed_data)
+int Command::parse_request(std::string_view request, COMMAND* commands, int max_count)
 {
-	std::string readable_data;
-	
-	/* Further command-specific trimming - remove extraneous PID echo 0D if it's
-	* at the beginning of the data
-	*/
-	if (boost::starts_with(trimmed_data, "0D"));
+	unsigned char bytes[1 + MAX_BATCH_SIZE];
+	int digits = 0;
+	for (char c : request)
 	{
-		trimmed_data = trimmed_data.substr(2);
+		int value = hex_value(c);
+		if (c == ' ' || c == '\r')
+		{
+			continue;
+		}
+		else if (value < 0)
+		{
+			return 0;
+		}
+
+		if (digits / 2 < (int) sizeof(bytes))
+		{
+			bytes[digits / 2] = (digits % 2 == 0) ? (value << 4) : (bytes[digits / 2] | value);
+		}
+		digits++;
 	}
-	
-	// Convert the data to an integer format
-	int int_data = hex_data_to_int(trimmed_data);
 
-	// Build the return string
-	std::stringstream ss;
-	ss << int_data;
+	int length = std::min(digits / 2, (int) sizeof(bytes));
+	if (length == 0)
+	{
+		return 0;
+	}
 
-	return ss.str();
+	int count = 0;
+	if (bytes[0] == 0x01)
+	{
+		for (int i = 1; i < length && count < max_count; i++)
+		{
+			COMMAND command = find_command(0x01, bytes[i]);
+			if (command != INVALID_COMMAND)
+			{
+				commands[count++] = command;
+			}
+		}
+	}
+	else if (length <= 2 && max_count > 0)
+	{
+		COMMAND command = find_command(bytes[0], (length == 2) ? bytes[1] : 0x00);
+		if (command != INVALID_COMMAND)
+		{
+			commands[count++] = command;
+		}
+	}
+
+	return count;
 }
 
-/* This function takes trimmed data and interprets it so that
-* a human-readable throttle position can be returned
-* The throttle position is returned as a percentage
+/* This function counts the ECU messages in a raw response
+* Each data line is one message, except for multi-frame responses, where the byte count line
+* starts a message and the numbered frames that follow belong to it
+* Lines that aren't hex data, such as NO DATA, aren't counted
 */
-std::string Command::interpret_throttle_pos(std::string trimmed_data)
+int Command::count_messages(std::string_view raw_data)
 {
-	std::string readable_data;
-	
-	/* Further command-specific trimming - remove extraneous PID echo 0C if it's
-	* at the beginning of the data
-	*/
-	if (boost::starts_with(trimmed_data, "11"));
+	int messages = 0;
+
+	std::string_view::size_type start = 0;
+	while (start < raw_data.length())
 	{
-		trimmed_data = trimmed_data.substr(2);
+		std::string_view::size_type end = raw_data.find_first_of("\r\n", start);
+		if (end == std::string_view::npos)
+		{
+			end = raw_data.length();
+		}
+
+		std::string_view line = raw_data.substr(start, end - start);
+		start = end + 1;
+
+		if (line.find(':') != std::string_view::npos)
+		{
+			continue;
+		}
+
+		bool is_hex = false;
+		for (char c : line)
+		{
+			if (c == ' ' || c == '>')
+			{
+				continue;
+			}
+
+			is_hex = (hex_value(c) >= 0);
+			if (!is_hex)
+			{
+				break;
+			}
+		}
+
+		if (is_hex)
+		{
+			messages++;
+		}
 	}
 
-	// Convert the data to an integer format
-	int int_data = hex_data_to_int(trimmed_data);
-	
-	/* Finally, perform the appropriate formula calculation specified by the OBDII standard
-	* The formula is (100/255)X = percentage of throttle used
-	*/
-	int_data = std::ceil( ( 100.0 / 255.0 ) * int_data);
+	return messages;
+}
 
-	// Build the return string
-	std::stringstream ss;
-	ss << int_data;
-	
-	return ss.str();
+/* This function hex decodes the data bytes of a raw response
+* Spaces, carriage returns and the > prompt are skipped, and lines that aren't hex data
+* (such as SEARCHING...) are ignored
+* Responses longer than a single CAN frame are returned by the ELM327 as a byte count
+* followed by numbered frames, for example:
+* 00E
+* 0: 41 05 7B 0C 1A F8
+* 1: 0D 00 11 20 00 00 00
+* These are joined into one message, and the byte count is used to drop the padding at the
+* end of the last frame. See ResponseParser
+*/
+bool Command::decode_hex(std::string_view raw_data, ResponseBytes& response)
+{
+	ResponseParser parser(response);
+	parser.feed(raw_data);
+	parser.finish();
+
+	return response.length > 0;
 }
 
-// This function converts a hexadecimal string to a signed integer
-int Command::hex_data_to_int(std::string hex_string)
+// This function converts a single hexadecimal character to its value, or -1 if it isn't hex
+int Command::hex_value(char hex_char)
 {
-	std::stringstream ss;
-	ss << std::hex << hex_string;
-	
-	int int_data;
-	ss >> int_data;
+	if (hex_char >= '0' && hex_char <= '9')
+	{
+		return hex_char - '0';
+	}
+	else if (hex_char >= 'A' && hex_char <= 'F')
+	{
+		return hex_char - 'A' + 10;
+	}
+	else if (hex_char >= 'a' && hex_char <= 'f')
+	{
+		return hex_char - 'a' + 10;
+	}
+
+	return -1;
+}
+
+// This function formats the low byte of a value as two uppercase hex digits, such as 0C
+std::string Command::format_hex_byte(unsigned int byte)
+{
+	return std::string{ hex_digit(byte >> 4), hex_digit(byte) };
+}
+
+/* This function converts a raw 2 byte DTC (diagnostic trouble code) to a human-readable format
+* The top two bits select the system (P, C, B or U), the next two bits are the first digit,
+* and the remaining 12 bits are the last three digits, so 0x0133 becomes P0133
+* The dtc buffer must have room for 6 characters, including the terminator
+*/
+void Command::format_dtc(unsigned short raw_dtc, char* dtc)
+{
+	static const char systems[] = "PCBU";
+
+	dtc[0] = systems[raw_dtc >> 14];
+	dtc[1] = '0' + ((raw_dtc >> 12) & 0x3);
+	dtc[2] = hex_digit(raw_dtc >> 8);
+	dtc[3] = hex_digit(raw_dtc >> 4);
+	dtc[4] = hex_digit(raw_dtc);
+	dtc[5] = '\0';
+}
+
+// This function builds an empty reading for a command
+Command::Reading Command::make_reading(STATUS status, COMMAND command)
+{
+	Reading reading;
+	reading.status = status;
+	reading.type = get_info(command).type;
+	reading.unit = get_info(command).unit;
+	reading.value = 0;
+	reading.dtc_count = 0;
+	reading.text[0] = '\0';
+
+	return reading;
+}
+
+// This function returns the first byte of a positive response to a command, such as 43 for Mode 03
+unsigned char Command::get_response_mode(COMMAND command)
+{
+	return get_info(command).mode + 0x40;
+}
+
+// This constructor starts decoding into an empty response
+ResponseParser::ResponseParser(Command::ResponseBytes& response) : response(response)
+{
+	response.length = 0;
+	response.message_count = 0;
+
+	line_start = 0;
+	high = -1;
+	digits = 0;
+	frame_line = false;
+	invalid_line = false;
+
+	message_start = 0;
+	byte_count = -1;
+}
+
+/* This function decodes the next characters of a response
+* It can be called with as much or as little of the response as has arrived
+*/
+void ResponseParser::feed(std::string_view data)
+{
+	for (char c : data)
+	{
+		int value = Command::hex_value(c);
+		if (value >= 0)
+		{
+			digits++;
+			if (high < 0)
+			{
+				high = value;
+			}
+			else
+			{
+				if (response.length < Command::MAX_RESPONSE_BYTES)
+				{
+					response.bytes[response.length++] = (high << 4) | value;
+				}
+				high = -1;
+			}
+		}
+		else if (c == '\r' || c == '\n' || c == '>')
+		{
+			end_line();
+		}
+		else if (c == ':' && !frame_line && digits > 0 && digits <= 2)
+		{
+			// The digits so far were the frame number
+			frame_line = true;
+			response.length = line_start;
+			high = -1;
+			digits = 0;
+		}
+		else if (c != ' ')
+		{
+			invalid_line = true;
+		}
+	}
+}
+
+// This function ends the response, keeping any message that was cut short
+void ResponseParser::finish()
+{
+	end_line();
+
+	if (byte_count >= 0)
+	{
+		add_message(message_start, response.length - message_start);
+		byte_count = -1;
+	}
+}
+
+// This function keeps or drops the line just decoded, depending on what it turned out to be
+void ResponseParser::end_line()
+{
+	int line_length = response.length - line_start;
+
+	if (invalid_line || (digits % 2 == 1 && (digits != 3 || frame_line)))
+	{
+		response.length = line_start;
+	}
+	else if (frame_line)
+	{
+		// A numbered frame without a byte count starts a message of unknown length
+		if (byte_count < 0)
+		{
+			message_start = line_start;
+			byte_count = Command::MAX_RESPONSE_BYTES;
+		}
+
+		if (response.length - message_start >= byte_count)
+		{
+			response.length = message_start + byte_count;
+			add_message(message_start, byte_count);
+			byte_count = -1;
+		}
+	}
+	else if (digits == 3)
+	{
+		int count = (response.length > line_start) ? (response.bytes[line_start] << 4) | high : 0;
+		response.length = line_start;
+
+		if (byte_count >= 0)
+		{
+			add_message(message_start, line_start - message_start);
+		}
+
+		message_start = line_start;
+		byte_count = count;
+	}
+	else if (digits > 0)
+	{
+		// A single line message ends any multi-frame message that was cut short
+		if (byte_count >= 0)
+		{
+			add_message(message_start, line_start - message_start);
+			byte_count = -1;
+		}
+
+		add_message(line_start, line_length);
+	}
+
+	line_start = response.length;
+	high = -1;
+	digits = 0;
+	frame_line = false;
+	invalid_line = false;
+}
+
+// This function records a message, dropping its bytes if there's no room to record it
+void ResponseParser::add_message(int start, int length)
+{
+	if (length <= 0)
+	{
+		return;
+	}
+
+	if (response.message_count == Command::MAX_MESSAGES)
+	{
+		response.length = std::min(response.length, start);
+		return;
+	}
 
-	return int_data;
+	response.message_starts[response.message_count] = start;
+	response.message_lengths[response.message_count] = length;
+	response.message_count++;
 }
@@ -5,16 +5,15 @@
 *Author: Josh McIntyre
 */
 
+#ifndef COMMAND_H
+#define COMMAND_H
+
 #include <iostream>
 #include <vector>
-#include <map>
 #include <string>
-#include <sstream>
+#include <string_view>
 #include <cmath>
-#include <regex>
-#include <boost/algorithm/string/erase.hpp>
-#include <boost/algorithm/string/predicate.hpp>
-#include <boost/algorithm/string/join.hpp>
+#include <algorithm>
 
 /* This class abstracts away the details of generating ELM327 commands
 * and processing responses generated by the chip
@@ -22,45 +21,203 @@
 class Command
 {
 	//private:
-		
+
 	public:
-	
-		// Declare constant ELM327/OBDII command strings
+
+		// Declare constant ELM327 setting command strings. OBDII commands are listed in pid_table.h
 		static const char CMD_ECHO_OFF[];
-		
-		static const char CMD_GET_DTCS[];
-		static const char CMD_GET_COOLANT_TEMP[];
-		static const char CMD_GET_ENGINE_RPM[];
-		static const char CMD_GET_VEHICLE_SPEED[];
-		static const char CMD_GET_THROTTLE_POS[];
-		
+		static const char CMD_SPACES_OFF[];
+		static const char CMD_LINEFEEDS_OFF[];
+		static const char CMD_ADAPTIVE_TIMING[];
+		static const char CMD_SET_BAUD_DIVISOR[];
+		static const char CMD_SET_TIMEOUT[];
+		static const char CMD_SUPPORTED_PIDS[];
+		static const char CMD_SET_PROTOCOL[];
+		static const char CMD_PROTOCOL_NUMBER[];
+		static const char CMD_HEADERS_ON[];
+		static const char CMD_HEADERS_OFF[];
+		static const char CMD_CAN_FORMATTING_ON[];
+		static const char CMD_CAN_FORMATTING_OFF[];
+		static const char CMD_SET_RECEIVE_ADDRESS[];
+		static const char CMD_SET_CAN_FILTER[];
+		static const char CMD_SET_CAN_MASK[];
+		static const char CMD_AUTO_RECEIVE[];
+		static const char CMD_MONITOR_ALL[];
+
 		static const char RET_NO_DATA[];
 		static const char RET_EMPTY[];
+		static const char RET_TIMEOUT[];
+		static const char RET_INVALID[];
+
+		// The ELM327 accepts up to six Mode 01 PIDs in a single request
+		static const int MAX_BATCH_SIZE = 6;
+
+		// Upper bounds for decoded responses, so decoding never needs to allocate
+		static const int MAX_RESPONSE_BYTES = 256;
+		static const int MAX_MESSAGES = 16;
+		static const int MAX_DTCS = 32;
+		static const int MAX_TEXT = 64;
+
+		// Supported commands are identified by their index in PID_TABLE
+		typedef int COMMAND;
+		static const COMMAND INVALID_COMMAND = -1;
+
+		// Declare an enum of units for decoded values
+		enum UNIT { UNIT_NONE,
+					UNIT_CELSIUS,
+					UNIT_RPM,
+					UNIT_KPH,
+					UNIT_PERCENT,
+					UNIT_KPA,
+					UNIT_PA,
+					UNIT_DEGREES,
+					UNIT_GRAMS_PER_SEC,
+					UNIT_VOLTS,
+					UNIT_RATIO,
+					UNIT_SECONDS,
+					UNIT_MINUTES,
+					UNIT_KM,
+					UNIT_LITERS_PER_HOUR,
+					UNIT_NEWTON_METERS
+				  };
+
+		// Declare an enum of value types for a decoded response
+		enum TYPE { TYPE_INT,
+					TYPE_FLOAT,
+					TYPE_DTCS,
+					TYPE_TEXT
+				  };
+
+		// Declare an enum of outcomes for a decoded response
+		enum STATUS { STATUS_OK,
+					  STATUS_NO_DATA,
+					  STATUS_TIMEOUT,
+					  STATUS_INVALID
+					};
+
+		/* This struct describes a supported command. See PID_TABLE in pid_table.h
+		* The formula converts the data bytes following the PID echo into a value
+		* For text commands, data_length is the length of each string in the response
+		*/
+		struct PidInfo
+		{
+			const char* name;
+			const char* command;
+			unsigned char mode;
+			unsigned char pid;
+			int data_length;
+			TYPE type;
+			UNIT unit;
+			double (*formula)(const unsigned char* data);
+			const char* label;
+		};
+
+		// This struct gives the meaning of a generic trouble code. See DTC_TABLE in dtc_table.h
+		struct DtcInfo
+		{
+			unsigned short code;
+			const char* description;
+		};
+
+		/* This struct holds a decoded response
+		* Numeric commands fill in value, DTC commands fill in the raw 2 byte trouble codes,
+		* and text commands, such as the VIN, fill in a null-terminated string
+		*/
+		struct Reading
+		{
+			STATUS status;
+			TYPE type;
+			UNIT unit;
+			double value;
+			int dtc_count;
+			unsigned short dtcs[MAX_DTCS];
+			char text[MAX_TEXT];
+		};
+
+		/* This struct holds the data bytes of a response after hex decoding
+		* Each ECU message, with multi-frame messages reassembled, is a range of the bytes,
+		* given by its start and length. The messages are stored back to back in order
+		*/
+		struct ResponseBytes
+		{
+			unsigned char bytes[MAX_RESPONSE_BYTES];
+			int length;
+			int message_count;
+			int message_starts[MAX_MESSAGES];
+			int message_lengths[MAX_MESSAGES];
+		};
 
-		// Declare an enum of supported commands
-		enum COMMAND { GET_DTCS,
-						GET_COOLANT_TEMP, 
-						GET_ENGINE_RPM, 
-						GET_VEHICLE_SPEED, 
-						GET_THROTTLE_POS
-					  };	
-
-		// This map will contain a dictionary of prefix chars to DTC prefixes such as 0 -> P0
-		static std::map<char, std::string> dtc_prefixes;
-
-		// Main data interpretation functions
-		static std::string interpret_raw(std::string raw_data, COMMAND command);
-		
-		static std::string interpret_dtcs(std::string trimmed_data);
-		static std::string interpret_coolant_temp(std::string trimmed_data);
-		static std::string interpret_engine_rpm(std::string trimmed_data);
-		static std::string interpret_vehicle_speed(std::string trimmed_data);
-		static std::string interpret_throttle_pos(std::string trimmed_data);
-		
-		// Some helper functions for data interpretation
-		static std::string parse_raw_dtc(std::string raw_dtc);
-		static int hex_data_to_int(std::string hex_string);
-		static std::string trim_raw(std::string raw_data);
+		// Command lookup functions
+		static constexpr COMMAND find_command(std::string_view name);
+		static constexpr COMMAND find_command(unsigned char mode, unsigned char pid);
+		static constexpr const PidInfo& get_info(COMMAND command);
+		static std::string get_command_string(COMMAND command);
+		static bool is_batchable(COMMAND command);
+		static const char* get_unit_suffix(UNIT unit);
+
+		// Main data decoding functions
+		static Reading decode(std::string_view raw_data, COMMAND command);
+		static Reading decode_dtcs(const ResponseBytes& response, COMMAND command);
+		static Reading decode_text(const ResponseBytes& response, COMMAND command);
+		static Reading decode_value(const unsigned char* data, COMMAND command);
+
+		// Batched Mode 01 request generation and response demultiplexing
+		static std::string build_batch_command(std::vector<COMMAND> commands);
+		static void decode_batch(std::string_view raw_data, const COMMAND* commands, int count, Reading* readings);
+		static int parse_request(std::string_view request, COMMAND* commands, int max_count);
+
+		// Some helper functions for data decoding
+		static bool decode_hex(std::string_view raw_data, ResponseBytes& response);
+		static int count_messages(std::string_view raw_data);
+		static int hex_value(char hex_char);
+		static constexpr char hex_digit(unsigned int value);
+		static std::string format_hex_byte(unsigned int byte);
+		static void format_dtc(unsigned short raw_dtc, char* dtc);
+		static constexpr unsigned short parse_dtc(std::string_view dtc);
+		static constexpr const char* get_dtc_description(unsigned short raw_dtc);
+		static Reading make_reading(STATUS status, COMMAND command);
+		static unsigned char get_response_mode(COMMAND command);
+};
+
+// This function returns the uppercase hex digit for the low 4 bits of a value
+constexpr char Command::hex_digit(unsigned int value)
+{
+	return "0123456789ABCDEF"[value & 0xF];
+}
+
+/* This class hex decodes a raw ELM327 response incrementally, as its characters arrive
+* Each line is decoded straight into the response, and dropped again if it turns out not
+* to be data, such as SEARCHING... or NO DATA. A lone three digit line is the byte count of
+* a multi-frame message, and the numbered frames that follow (0:, 1:, ...) are joined into
+* that message and trimmed to its length. Every other data line is a message of its own,
+* so replies from several ECUs stay apart
+*/
+class ResponseParser
+{
+	private:
+		Command::ResponseBytes& response;
+
+		// The line being decoded
+		int line_start;
+		int high;
+		int digits;
+		bool frame_line;
+		bool invalid_line;
+
+		// The multi-frame message being assembled, if byte_count isn't -1
+		int message_start;
+		int byte_count;
+
+		void end_line();
+		void add_message(int start, int length);
+
+	public:
+		ResponseParser(Command::ResponseBytes& response);
+		void feed(std::string_view data);
+		void finish();
 };
 
+#include "pid_table.h"
+#include "dtc_table.h"
 
+#endif
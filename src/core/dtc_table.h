@@ -0,0 +1,269 @@
+/* This file contains the table of generic trouble code descriptions
+* Codes are the generic ones defined by SAE J2012, which mean the same on every vehicle.
+* Manufacturer specific codes, such as P1xxx, aren't listed
+* This file is included at the end of command.h and shouldn't be included directly
+*
+* Author: Josh McIntyre
+*/
+
+#ifndef DTC_TABLE_H
+#define DTC_TABLE_H
+
+/* This function converts a trouble code such as P0133 to its raw 2 byte form, 0x0133
+* It returns 0, which is never a stored code, if the text isn't a trouble code
+*/
+constexpr unsigned short Command::parse_dtc(std::string_view dtc)
+{
+	constexpr std::string_view systems = "PCBU";
+	if (dtc.length() != 5 || systems.find(dtc[0]) == std::string_view::npos || dtc[1] < '0' || dtc[1] > '3')
+	{
+		return 0;
+	}
+
+	unsigned short raw_dtc = (systems.find(dtc[0]) << 14) | ((dtc[1] - '0') << 12);
+	for (int i = 2; i < 5; i++)
+	{
+		constexpr std::string_view digits = "0123456789ABCDEF";
+		std::string_view::size_type digit = digits.find(dtc[i]);
+		if (digit == std::string_view::npos)
+		{
+			return 0;
+		}
+
+		raw_dtc |= digit << (4 * (4 - i));
+	}
+
+	return raw_dtc;
+}
+
+/* The table of trouble code descriptions, sorted by raw code so it can be binary searched
+* That puts the powertrain (P) codes first, then chassis (C), body (B) and network (U) codes
+*/
+inline constexpr Command::DtcInfo DTC_TABLE[] = {
+	{ Command::parse_dtc("P0010"), "Camshaft position actuator A circuit (bank 1)" },
+	{ Command::parse_dtc("P0011"), "Camshaft position A timing over-advanced or system performance (bank 1)" },
+	{ Command::parse_dtc("P0012"), "Camshaft position A timing over-retarded (bank 1)" },
+	{ Command::parse_dtc("P0013"), "Camshaft position actuator B circuit (bank 1)" },
+	{ Command::parse_dtc("P0014"), "Camshaft position B timing over-advanced or system performance (bank 1)" },
+	{ Command::parse_dtc("P0016"), "Crankshaft position / camshaft position correlation (bank 1 sensor A)" },
+	{ Command::parse_dtc("P0017"), "Crankshaft position / camshaft position correlation (bank 1 sensor B)" },
+	{ Command::parse_dtc("P0018"), "Crankshaft position / camshaft position correlation (bank 2 sensor A)" },
+	{ Command::parse_dtc("P0020"), "Camshaft position actuator A circuit (bank 2)" },
+	{ Command::parse_dtc("P0021"), "Camshaft position A timing over-advanced or system performance (bank 2)" },
+	{ Command::parse_dtc("P0030"), "O2 sensor heater control circuit (bank 1 sensor 1)" },
+	{ Command::parse_dtc("P0031"), "O2 sensor heater control circuit low (bank 1 sensor 1)" },
+	{ Command::parse_dtc("P0032"), "O2 sensor heater control circuit high (bank 1 sensor 1)" },
+	{ Command::parse_dtc("P0036"), "O2 sensor heater control circuit (bank 1 sensor 2)" },
+	{ Command::parse_dtc("P0037"), "O2 sensor heater control circuit low (bank 1 sensor 2)" },
+	{ Command::parse_dtc("P0038"), "O2 sensor heater control circuit high (bank 1 sensor 2)" },
+	{ Command::parse_dtc("P0050"), "O2 sensor heater control circuit (bank 2 sensor 1)" },
+	{ Command::parse_dtc("P0051"), "O2 sensor heater control circuit low (bank 2 sensor 1)" },
+	{ Command::parse_dtc("P0052"), "O2 sensor heater control circuit high (bank 2 sensor 1)" },
+	{ Command::parse_dtc("P0068"), "MAP / MAF / throttle position correlation" },
+	{ Command::parse_dtc("P0087"), "Fuel rail / system pressure too low" },
+	{ Command::parse_dtc("P0088"), "Fuel rail / system pressure too high" },
+	{ Command::parse_dtc("P0100"), "Mass air flow circuit malfunction" },
+	{ Command::parse_dtc("P0101"), "Mass air flow circuit range / performance" },
+	{ Command::parse_dtc("P0102"), "Mass air flow circuit low input" },
+	{ Command::parse_dtc("P0103"), "Mass air flow circuit high input" },
+	{ Command::parse_dtc("P0106"), "Manifold absolute pressure / barometric pressure circuit range / performance" },
+	{ Command::parse_dtc("P0107"), "Manifold absolute pressure / barometric pressure circuit low input" },
+	{ Command::parse_dtc("P0108"), "Manifold absolute pressure / barometric pressure circuit high input" },
+	{ Command::parse_dtc("P0110"), "Intake air temperature circuit malfunction" },
+	{ Command::parse_dtc("P0111"), "Intake air temperature circuit range / performance" },
+	{ Command::parse_dtc("P0112"), "Intake air temperature circuit low input" },
+	{ Command::parse_dtc("P0113"), "Intake air temperature circuit high input" },
+	{ Command::parse_dtc("P0115"), "Engine coolant temperature circuit malfunction" },
+	{ Command::parse_dtc("P0116"), "Engine coolant temperature circuit range / performance" },
+	{ Command::parse_dtc("P0117"), "Engine coolant temperature circuit low input" },
+	{ Command::parse_dtc("P0118"), "Engine coolant temperature circuit high input" },
+	{ Command::parse_dtc("P0120"), "Throttle / pedal position sensor A circuit malfunction" },
+	{ Command::parse_dtc("P0121"), "Throttle / pedal position sensor A circuit range / performance" },
+	{ Command::parse_dtc("P0122"), "Throttle / pedal position sensor A circuit low input" },
+	{ Command::parse_dtc("P0123"), "Throttle / pedal position sensor A circuit high input" },
+	{ Command::parse_dtc("P0125"), "Insufficient coolant temperature for closed loop fuel control" },
+	{ Command::parse_dtc("P0128"), "Coolant thermostat (coolant temperature below regulating temperature)" },
+	{ Command::parse_dtc("P0130"), "O2 sensor circuit malfunction (bank 1 sensor 1)" },
+	{ Command::parse_dtc("P0131"), "O2 sensor circuit low voltage (bank 1 sensor 1)" },
+	{ Command::parse_dtc("P0132"), "O2 sensor circuit high voltage (bank 1 sensor 1)" },
+	{ Command::parse_dtc("P0133"), "O2 sensor circuit slow response (bank 1 sensor 1)" },
+	{ Command::parse_dtc("P0134"), "O2 sensor circuit no activity detected (bank 1 sensor 1)" },
+	{ Command::parse_dtc("P0135"), "O2 sensor heater circuit malfunction (bank 1 sensor 1)" },
+	{ Command::parse_dtc("P0136"), "O2 sensor circuit malfunction (bank 1 sensor 2)" },
+	{ Command::parse_dtc("P0137"), "O2 sensor circuit low voltage (bank 1 sensor 2)" },
+	{ Command::parse_dtc("P0138"), "O2 sensor circuit high voltage (bank 1 sensor 2)" },
+	{ Command::parse_dtc("P0139"), "O2 sensor circuit slow response (bank 1 sensor 2)" },
+	{ Command::parse_dtc("P0140"), "O2 sensor circuit no activity detected (bank 1 sensor 2)" },
+	{ Command::parse_dtc("P0141"), "O2 sensor heater circuit malfunction (bank 1 sensor 2)" },
+	{ Command::parse_dtc("P0150"), "O2 sensor circuit malfunction (bank 2 sensor 1)" },
+	{ Command::parse_dtc("P0151"), "O2 sensor circuit low voltage (bank 2 sensor 1)" },
+	{ Command::parse_dtc("P0152"), "O2 sensor circuit high voltage (bank 2 sensor 1)" },
+	{ Command::parse_dtc("P0153"), "O2 sensor circuit slow response (bank 2 sensor 1)" },
+	{ Command::parse_dtc("P0154"), "O2 sensor circuit no activity detected (bank 2 sensor 1)" },
+	{ Command::parse_dtc("P0155"), "O2 sensor heater circuit malfunction (bank 2 sensor 1)" },
+	{ Command::parse_dtc("P0156"), "O2 sensor circuit malfunction (bank 2 sensor 2)" },
+	{ Command::parse_dtc("P0157"), "O2 sensor circuit low voltage (bank 2 sensor 2)" },
+	{ Command::parse_dtc("P0158"), "O2 sensor circuit high voltage (bank 2 sensor 2)" },
+	{ Command::parse_dtc("P0159"), "O2 sensor circuit slow response (bank 2 sensor 2)" },
+	{ Command::parse_dtc("P0160"), "O2 sensor circuit no activity detected (bank 2 sensor 2)" },
+	{ Command::parse_dtc("P0161"), "O2 sensor heater circuit malfunction (bank 2 sensor 2)" },
+	{ Command::parse_dtc("P0170"), "Fuel trim malfunction (bank 1)" },
+	{ Command::parse_dtc("P0171"), "System too lean (bank 1)" },
+	{ Command::parse_dtc("P0172"), "System too rich (bank 1)" },
+	{ Command::parse_dtc("P0173"), "Fuel trim malfunction (bank 2)" },
+	{ Command::parse_dtc("P0174"), "System too lean (bank 2)" },
+	{ Command::parse_dtc("P0175"), "System too rich (bank 2)" },
+	{ Command::parse_dtc("P0190"), "Fuel rail pressure sensor circuit malfunction" },
+	{ Command::parse_dtc("P0191"), "Fuel rail pressure sensor circuit range / performance" },
+	{ Command::parse_dtc("P0201"), "Injector circuit malfunction, cylinder 1" },
+	{ Command::parse_dtc("P0202"), "Injector circuit malfunction, cylinder 2" },
+	{ Command::parse_dtc("P0203"), "Injector circuit malfunction, cylinder 3" },
+	{ Command::parse_dtc("P0204"), "Injector circuit malfunction, cylinder 4" },
+	{ Command::parse_dtc("P0205"), "Injector circuit malfunction, cylinder 5" },
+	{ Command::parse_dtc("P0206"), "Injector circuit malfunction, cylinder 6" },
+	{ Command::parse_dtc("P0207"), "Injector circuit malfunction, cylinder 7" },
+	{ Command::parse_dtc("P0208"), "Injector circuit malfunction, cylinder 8" },
+	{ Command::parse_dtc("P0217"), "Engine over temperature condition" },
+	{ Command::parse_dtc("P0218"), "Transmission over temperature condition" },
+	{ Command::parse_dtc("P0219"), "Engine overspeed condition" },
+	{ Command::parse_dtc("P0220"), "Throttle / pedal position sensor B circuit malfunction" },
+	{ Command::parse_dtc("P0221"), "Throttle / pedal position sensor B circuit range / performance" },
+	{ Command::parse_dtc("P0222"), "Throttle / pedal position sensor B circuit low input" },
+	{ Command::parse_dtc("P0223"), "Throttle / pedal position sensor B circuit high input" },
+	{ Command::parse_dtc("P0230"), "Fuel pump primary circuit malfunction" },
+	{ Command::parse_dtc("P0234"), "Turbo / supercharger overboost condition" },
+	{ Command::parse_dtc("P0299"), "Turbo / supercharger underboost" },
+	{ Command::parse_dtc("P0300"), "Random / multiple cylinder misfire detected" },
+	{ Command::parse_dtc("P0301"), "Cylinder 1 misfire detected" },
+	{ Command::parse_dtc("P0302"), "Cylinder 2 misfire detected" },
+	{ Command::parse_dtc("P0303"), "Cylinder 3 misfire detected" },
+	{ Command::parse_dtc("P0304"), "Cylinder 4 misfire detected" },
+	{ Command::parse_dtc("P0305"), "Cylinder 5 misfire detected" },
+	{ Command::parse_dtc("P0306"), "Cylinder 6 misfire detected" },
+	{ Command::parse_dtc("P0307"), "Cylinder 7 misfire detected" },
+	{ Command::parse_dtc("P0308"), "Cylinder 8 misfire detected" },
+	{ Command::parse_dtc("P0325"), "Knock sensor 1 circuit malfunction (bank 1 or single sensor)" },
+	{ Command::parse_dtc("P0326"), "Knock sensor 1 circuit range / performance (bank 1 or single sensor)" },
+	{ Command::parse_dtc("P0327"), "Knock sensor 1 circuit low input (bank 1 or single sensor)" },
+	{ Command::parse_dtc("P0328"), "Knock sensor 1 circuit high input (bank 1 or single sensor)" },
+	{ Command::parse_dtc("P0335"), "Crankshaft position sensor A circuit malfunction" },
+	{ Command::parse_dtc("P0336"), "Crankshaft position sensor A circuit range / performance" },
+	{ Command::parse_dtc("P0340"), "Camshaft position sensor circuit malfunction" },
+	{ Command::parse_dtc("P0341"), "Camshaft position sensor circuit range / performance" },
+	{ Command::parse_dtc("P0351"), "Ignition coil A primary / secondary circuit malfunction" },
+	{ Command::parse_dtc("P0352"), "Ignition coil B primary / secondary circuit malfunction" },
+	{ Command::parse_dtc("P0353"), "Ignition coil C primary / secondary circuit malfunction" },
+	{ Command::parse_dtc("P0354"), "Ignition coil D primary / secondary circuit malfunction" },
+	{ Command::parse_dtc("P0400"), "Exhaust gas recirculation flow malfunction" },
+	{ Command::parse_dtc("P0401"), "Exhaust gas recirculation flow insufficient" },
+	{ Command::parse_dtc("P0402"), "Exhaust gas recirculation flow excessive" },
+	{ Command::parse_dtc("P0403"), "Exhaust gas recirculation circuit malfunction" },
+	{ Command::parse_dtc("P0404"), "Exhaust gas recirculation circuit range / performance" },
+	{ Command::parse_dtc("P0410"), "Secondary air injection system malfunction" },
+	{ Command::parse_dtc("P0411"), "Secondary air injection system incorrect flow detected" },
+	{ Command::parse_dtc("P0420"), "Catalyst system efficiency below threshold (bank 1)" },
+	{ Command::parse_dtc("P0421"), "Warm up catalyst efficiency below threshold (bank 1)" },
+	{ Command::parse_dtc("P0430"), "Catalyst system efficiency below threshold (bank 2)" },
+	{ Command::parse_dtc("P0440"), "Evaporative emission control system malfunction" },
+	{ Command::parse_dtc("P0441"), "Evaporative emission control system incorrect purge flow" },
+	{ Command::parse_dtc("P0442"), "Evaporative emission control system leak detected (small leak)" },
+	{ Command::parse_dtc("P0443"), "Evaporative emission control system purge control valve circuit malfunction" },
+	{ Command::parse_dtc("P0446"), "Evaporative emission control system vent control circuit malfunction" },
+	{ Command::parse_dtc("P0449"), "Evaporative emission control system vent valve / solenoid circuit malfunction" },
+	{ Command::parse_dtc("P0451"), "Evaporative emission control system pressure sensor range / performance" },
+	{ Command::parse_dtc("P0452"), "Evaporative emission control system pressure sensor low input" },
+	{ Command::parse_dtc("P0453"), "Evaporative emission control system pressure sensor high input" },
+	{ Command::parse_dtc("P0455"), "Evaporative emission control system leak detected (gross leak)" },
+	{ Command::parse_dtc("P0456"), "Evaporative emission control system leak detected (very small leak)" },
+	{ Command::parse_dtc("P0460"), "Fuel level sensor circuit malfunction" },
+	{ Command::parse_dtc("P0461"), "Fuel level sensor circuit range / performance" },
+	{ Command::parse_dtc("P0480"), "Cooling fan 1 control circuit malfunction" },
+	{ Command::parse_dtc("P0500"), "Vehicle speed sensor malfunction" },
+	{ Command::parse_dtc("P0505"), "Idle control system malfunction" },
+	{ Command::parse_dtc("P0506"), "Idle control system RPM lower than expected" },
+	{ Command::parse_dtc("P0507"), "Idle control system RPM higher than expected" },
+	{ Command::parse_dtc("P0520"), "Engine oil pressure sensor / switch circuit malfunction" },
+	{ Command::parse_dtc("P0521"), "Engine oil pressure sensor / switch range / performance" },
+	{ Command::parse_dtc("P0530"), "A/C refrigerant pressure sensor circuit malfunction" },
+	{ Command::parse_dtc("P0562"), "System voltage low" },
+	{ Command::parse_dtc("P0563"), "System voltage high" },
+	{ Command::parse_dtc("P0600"), "Serial communication link malfunction" },
+	{ Command::parse_dtc("P0601"), "Internal control module memory checksum error" },
+	{ Command::parse_dtc("P0602"), "Control module programming error" },
+	{ Command::parse_dtc("P0603"), "Internal control module keep alive memory (KAM) error" },
+	{ Command::parse_dtc("P0604"), "Internal control module random access memory (RAM) error" },
+	{ Command::parse_dtc("P0605"), "Internal control module read only memory (ROM) error" },
+	{ Command::parse_dtc("P0606"), "Control module processor fault" },
+	{ Command::parse_dtc("P0700"), "Transmission control system malfunction" },
+	{ Command::parse_dtc("P0705"), "Transmission range sensor circuit malfunction (PRNDL input)" },
+	{ Command::parse_dtc("P0715"), "Input / turbine speed sensor circuit malfunction" },
+	{ Command::parse_dtc("P0720"), "Output speed sensor circuit malfunction" },
+	{ Command::parse_dtc("P0730"), "Incorrect gear ratio" },
+	{ Command::parse_dtc("P0740"), "Torque converter clutch circuit malfunction" },
+	{ Command::parse_dtc("P0741"), "Torque converter clutch circuit performance or stuck off" },
+	{ Command::parse_dtc("P0750"), "Shift solenoid A malfunction" },
+	{ Command::parse_dtc("P0755"), "Shift solenoid B malfunction" },
+	{ Command::parse_dtc("P2096"), "Post catalyst fuel trim system too lean (bank 1)" },
+	{ Command::parse_dtc("P2097"), "Post catalyst fuel trim system too rich (bank 1)" },
+	{ Command::parse_dtc("P2135"), "Throttle / pedal position sensor A / B voltage correlation" },
+	{ Command::parse_dtc("P2187"), "System too lean at idle (bank 1)" },
+	{ Command::parse_dtc("P2188"), "System too rich at idle (bank 1)" },
+	{ Command::parse_dtc("P2195"), "O2 sensor signal stuck lean (bank 1 sensor 1)" },
+	{ Command::parse_dtc("P2196"), "O2 sensor signal stuck rich (bank 1 sensor 1)" },
+	{ Command::parse_dtc("P2270"), "O2 sensor signal stuck lean (bank 1 sensor 2)" },
+	{ Command::parse_dtc("P2271"), "O2 sensor signal stuck rich (bank 1 sensor 2)" },
+	{ Command::parse_dtc("C0035"), "Left front wheel speed sensor circuit" },
+	{ Command::parse_dtc("C0040"), "Right front wheel speed sensor circuit" },
+	{ Command::parse_dtc("C0045"), "Left rear wheel speed sensor circuit" },
+	{ Command::parse_dtc("C0050"), "Right rear wheel speed sensor circuit" },
+	{ Command::parse_dtc("U0001"), "High speed CAN communication bus" },
+	{ Command::parse_dtc("U0073"), "Control module communication bus A off" },
+	{ Command::parse_dtc("U0100"), "Lost communication with ECM / PCM A" },
+	{ Command::parse_dtc("U0101"), "Lost communication with TCM" },
+	{ Command::parse_dtc("U0121"), "Lost communication with anti-lock brake system (ABS) control module" },
+	{ Command::parse_dtc("U0140"), "Lost communication with body control module" },
+	{ Command::parse_dtc("U0155"), "Lost communication with instrument panel cluster (IPC) control module" }
+};
+
+inline constexpr int DTC_TABLE_SIZE = sizeof(DTC_TABLE) / sizeof(DTC_TABLE[0]);
+
+/* This function looks up the description of a raw trouble code, returning nullptr if it isn't in DTC_TABLE
+* It's a binary search, so a full set of codes is described in a few hundred comparisons
+*/
+constexpr const char* Command::get_dtc_description(unsigned short raw_dtc)
+{
+	int low = 0;
+	int high = DTC_TABLE_SIZE;
+	while (low < high)
+	{
+		int middle = low + (high - low) / 2;
+		if (DTC_TABLE[middle].code < raw_dtc)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	return (low < DTC_TABLE_SIZE && DTC_TABLE[low].code == raw_dtc) ? DTC_TABLE[low].description : nullptr;
+}
+
+// The binary search needs every code to be valid, and the table sorted with no duplicates
+constexpr bool check_dtc_table()
+{
+	for (int i = 0; i < DTC_TABLE_SIZE; i++)
+	{
+		if (DTC_TABLE[i].code == 0 || (i > 0 && DTC_TABLE[i - 1].code >= DTC_TABLE[i].code))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static_assert(check_dtc_table(), "DTC_TABLE contains an invalid, duplicate or out of order code");
+
+#endif
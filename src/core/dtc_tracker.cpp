@@ -0,0 +1,80 @@
+/* This file contains code that watches trouble codes and reports the ones that were set or cleared
+*
+* Author: Josh McIntyre
+*/
+
+#include "dtc_tracker.h"
+
+/* This function compares a reading of a trouble code item with the codes the device last
+* reported for it, adding a change for each code that appeared or went away
+* It returns whether anything changed. Readings of other items are ignored
+*/
+bool DtcTracker::update(int64_t timestamp_us, int device, Command::COMMAND cmd, const Command::Reading& reading, std::vector<DtcChange>& changes)
+{
+	if (reading.status != Command::STATUS_OK || reading.type != Command::TYPE_DTCS)
+	{
+		return false;
+	}
+
+	std::vector<unsigned short> codes(reading.dtcs, reading.dtcs + reading.dtc_count);
+	std::sort(codes.begin(), codes.end());
+
+	std::vector<unsigned short>& last = known[std::make_pair(device, cmd)];
+	if (codes == last)
+	{
+		return false;
+	}
+
+	// Both lists are sorted, so one pass finds the codes only in one or the other
+	std::vector<unsigned short>::size_type i = 0;
+	std::vector<unsigned short>::size_type j = 0;
+	while (i < codes.size() || j < last.size())
+	{
+		if (j == last.size() || (i < codes.size() && codes[i] < last[j]))
+		{
+			changes.push_back({ timestamp_us, device, cmd, codes[i++], true });
+		}
+		else if (i == codes.size() || last[j] < codes[i])
+		{
+			changes.push_back({ timestamp_us, device, cmd, last[j++], false });
+		}
+		else
+		{
+			i++;
+			j++;
+		}
+	}
+
+	last = codes;
+	return true;
+}
+
+// This function returns the codes a device last reported for a trouble code item, in code order
+std::vector<unsigned short> DtcTracker::get_codes(int device, Command::COMMAND cmd)
+{
+	std::map<std::pair<int, Command::COMMAND>, std::vector<unsigned short> >::iterator it = known.find(std::make_pair(device, cmd));
+	return (it != known.end()) ? it -> second : std::vector<unsigned short>();
+}
+
+// This function returns the CSV header for the lines written by format_change()
+std::string DtcTracker::format_header()
+{
+	return "timestamp_us,device,item,code,event,description";
+}
+
+/* This function formats a change as a CSV line, such as
+* 1700000000123456,0,pdtc,P0442,set,"Evaporative emission control system leak detected (small leak)"
+* The description is empty for codes that aren't in DTC_TABLE
+*/
+std::string DtcTracker::format_change(const DtcChange& change)
+{
+	char dtc[6];
+	Command::format_dtc(change.raw_dtc, dtc);
+	const char* description = Command::get_dtc_description(change.raw_dtc);
+
+	std::stringstream ss;
+	ss << change.timestamp_us << "," << change.device << "," << Command::get_info(change.cmd).name << "," << dtc << ","
+		<< (change.set ? "set" : "cleared") << ",\"" << (description != nullptr ? description : "") << "\"";
+
+	return ss.str();
+}
@@ -0,0 +1,54 @@
+/* This file contains function declarations and includes for watching trouble codes for changes
+*
+* Author: Josh McIntyre
+*/
+
+#ifndef DTC_TRACKER_H
+#define DTC_TRACKER_H
+
+#include <cstdint>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <utility>
+#include <algorithm>
+
+#include "command.h"
+
+// This struct describes a trouble code that was set or cleared on a device
+struct DtcChange
+{
+	int64_t timestamp_us;
+	int device;
+	Command::COMMAND cmd;
+	unsigned short raw_dtc;
+	bool set;
+};
+
+/* This class keeps the trouble codes each device last reported, and works out what changed
+* The stored, pending and permanent codes are polled like any other item, at the low rate
+* given in default_rates, so watching them continuously costs a few requests a minute.
+* Only readings that decoded are compared, since NO DATA or a timeout says nothing about
+* the codes. The first reading of each kind reports every code in it as set
+*/
+class DtcTracker
+{
+	private:
+		std::map<std::pair<int, Command::COMMAND>, std::vector<unsigned short> > known;
+
+	public:
+		// The trouble code items, in the order they're listed
+		static constexpr Command::COMMAND COMMANDS[] = {
+			Command::find_command("dtc"),
+			Command::find_command("pdtc"),
+			Command::find_command("perm")
+		};
+
+		bool update(int64_t timestamp_us, int device, Command::COMMAND cmd, const Command::Reading& reading, std::vector<DtcChange>& changes);
+		std::vector<unsigned short> get_codes(int device, Command::COMMAND cmd);
+		static std::string format_header();
+		static std::string format_change(const DtcChange& change);
+};
+
+#endif
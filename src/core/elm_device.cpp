@@ -8,11 +8,27 @@
 
 /* This constructor will initialize a serial connection -> and
 * then initialize the ELM327 device with our desired settings
+* Vehicles are remembered in the cache file at cache_path, if one is given
 */
-ElmDevice::ElmDevice(std::string port)
+ElmDevice::ElmDevice(std::string port, long baud, std::string cache_path) : cache_path(cache_path)
 {
 	// Initialize the connection -> and then the desired device settings
-	connection = new SerialConnection(port);
+	connection = new SerialConnection(port, baud);
+	batching_enabled = true;
+	batch_failures = 0;
+	response_counts_enabled = true;
+	init_settings();
+}
+
+/* This constructor initializes a device on a shared io_service, which must already be running
+* on other threads, since setting up the device waits for its responses
+*/
+ElmDevice::ElmDevice(boost::asio::io_service& io, std::string port, long baud, std::string cache_path) : cache_path(cache_path)
+{
+	connection = new SerialConnection(io, port, baud);
+	batching_enabled = true;
+	batch_failures = 0;
+	response_counts_enabled = true;
 	init_settings();
 }
 
@@ -23,40 +39,885 @@ ElmDevice::~ElmDevice()
 }
 
 // This function process an OBDII command and returns the response data
-std::string ElmDevice::get_data(Command::COMMAND cmd)
+Command::Reading ElmDevice::get_data(Command::COMMAND cmd)
 {
-	// Fetch the raw response via the command object
-	std::string raw_data;
-	switch (cmd)
+	return get_data_batch(std::vector<Command::COMMAND>(1, cmd))[0];
+}
+
+/* This function processes several OBDII commands and returns the response data for each,
+* in the same order as the commands
+* It waits for async_get_data_batch, running the connection's io_service if it has its own
+*/
+std::vector<Command::Reading> ElmDevice::get_data_batch(std::vector<Command::COMMAND> cmds)
+{
+	std::shared_ptr<std::promise<std::vector<Command::Reading> > > data(new std::promise<std::vector<Command::Reading> >());
+	async_get_data_batch(cmds, [data](std::vector<Command::Reading> readings)
 	{
-		case Command::GET_DTCS:
-			raw_data = connection -> fetch_response(std::string(Command::CMD_GET_DTCS), 20);
-			break;
+		data -> set_value(readings);
+	});
+	connection -> run();
 
-		case Command::GET_COOLANT_TEMP:
-			raw_data = connection -> fetch_response(std::string(Command::CMD_GET_COOLANT_TEMP), 20);
-			break;
+	return data -> get_future().get();
+}
 
-		case Command::GET_ENGINE_RPM: 
-			raw_data = connection -> fetch_response(std::string(Command::CMD_GET_ENGINE_RPM), 20);
-			break;
+/* This function starts fetching several OBDII commands and returns immediately
+* The handler is called with the response data for each, in the same order as the commands
+* Mode 01 commands are packed into as few requests as possible, saving a full
+* serial round-trip and ECU bus transaction for each command after the first
+* Commands the vehicle doesn't support are answered with NO DATA and never sent
+* If stopped is given and gets set, the groups of commands not yet sent are skipped,
+* and the handler is called early with only the readings fetched so far
+* It can be called from any thread. The batch is planned on the connection's strand, where
+* every later step runs too, since the learned response counts and batching state are shared
+* with the other requests in flight
+*/
+void ElmDevice::async_get_data_batch(std::vector<Command::COMMAND> cmds, BatchHandler handler, const std::atomic<bool>* stopped)
+{
+	connection -> post([this, cmds, handler, stopped]()
+	{
+		start_batch(cmds, handler, stopped);
+	});
+}
 
-		case Command::GET_VEHICLE_SPEED:
-			raw_data = connection -> fetch_response(std::string(Command::CMD_GET_VEHICLE_SPEED), 20);
-			break;
-		
-		case Command::GET_THROTTLE_POS:
-			raw_data = connection -> fetch_response(std::string(Command::CMD_GET_THROTTLE_POS), 20);
+// This function splits a request into groups of commands and starts fetching them, on the connection's strand
+void ElmDevice::start_batch(std::vector<Command::COMMAND> cmds, BatchHandler handler, const std::atomic<bool>* stopped)
+{
+	std::shared_ptr<BatchRequest> request(new BatchRequest());
+	request -> cmds = cmds;
+	request -> data.resize(cmds.size());
+	request -> next_group = 0;
+	request -> handler = handler;
+	request -> stopped = stopped;
+	request -> split_next = false;
+	request -> batch_answered = 0;
+	request -> singles_end = 0;
+	request -> singles_answered = 0;
+
+	std::vector<int> batch;
+	for (int i = 0; i < (int) cmds.size(); i++)
+	{
+		// PIDs the vehicle doesn't support are answered straight away, without a request
+		if (!is_supported(cmds[i]))
+		{
+			request -> data[i] = Command::make_reading(Command::STATUS_NO_DATA, cmds[i]);
+			continue;
+		}
+
+		// Anything other than a Mode 01 command is fetched individually
+		if (Command::is_batchable(cmds[i]))
+		{
+			batch.push_back(i);
+		}
+		else
+		{
+			request -> groups.push_back(std::vector<int>(1, i));
+		}
+
+		// Close the pending batch once it's full
+		if ((int) batch.size() == Command::MAX_BATCH_SIZE)
+		{
+			request -> groups.push_back(batch);
+			batch.clear();
+		}
+	}
+
+	if (!batch.empty())
+	{
+		request -> groups.push_back(batch);
+	}
+
+	fetch_next_group(request);
+}
+
+/* This function fetches the next group of commands in a request, then moves on to the one after
+* Vehicles that don't support multi-PID requests (most pre-CAN protocols) answer with
+* NO DATA or only the first PID. If a batch comes back empty, or with only its first PID,
+* it's fetched again one command at a time. Once that's shown batching failing
+* MAX_BATCH_FAILURES times in a row, batching is disabled for this device, and batches are
+* fetched one command at a time until it's tried again
+*/
+void ElmDevice::fetch_next_group(std::shared_ptr<BatchRequest> request)
+{
+	if (request -> stopped != nullptr && *(request -> stopped))
+	{
+		request -> next_group = request -> groups.size();
+	}
+
+	if (request -> next_group == request -> groups.size())
+	{
+		request -> handler(request -> data);
+		return;
+	}
+
+	std::vector<int> group = request -> groups[request -> next_group];
+	if (group.size() > 1 && (request -> split_next || !is_batching_enabled()))
+	{
+		std::vector<std::vector<int> > singles;
+		for (int index : group)
+		{
+			singles.push_back(std::vector<int>(1, index));
+		}
+
+		request -> groups.erase(request -> groups.begin() + request -> next_group);
+		request -> groups.insert(request -> groups.begin() + request -> next_group, singles.begin(), singles.end());
+		group = request -> groups[request -> next_group];
+
+		if (request -> split_next)
+		{
+			request -> split_next = false;
+			request -> singles_end = request -> next_group + singles.size();
+			request -> singles_answered = 0;
+		}
+	}
+
+	std::vector<Command::COMMAND> cmds;
+	for (int index : group)
+	{
+		cmds.push_back(request -> cmds[index]);
+	}
+
+	if (!Command::is_batchable(cmds[0]))
+	{
+		connection -> async_fetch_response(Command::get_command_string(cmds[0]), SerialConnection::DEFAULT_TIMEOUT_MS,
+			[this, request, group](const boost::system::error_code&, std::string raw_data)
+		{
+			std::chrono::steady_clock::time_point decode_start = std::chrono::steady_clock::now();
+			request -> data[group[0]] = Command::decode(raw_data, request -> cmds[group[0]]);
+			int64_t decode_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - decode_start).count();
+
+			record_stats(std::vector<Command::COMMAND>(1, request -> cmds[group[0]]), std::vector<Command::Reading>(1, request -> data[group[0]]), decode_ns);
+			request -> next_group++;
+			fetch_next_group(request);
+		});
+
+		return;
+	}
+
+	async_fetch_counted(cmds, [this, request, group](std::vector<Command::Reading> readings)
+	{
+		int answered = 0;
+		for (const Command::Reading& reading : readings)
+		{
+			answered += (reading.status != Command::STATUS_NO_DATA) ? 1 : 0;
+		}
+
+		// Fetch the same group again, now one command at a time
+		bool first_only = (answered == 1 && readings[0].status != Command::STATUS_NO_DATA);
+		if (group.size() > 1 && (answered == 0 || first_only))
+		{
+			request -> split_next = true;
+			request -> batch_answered = answered;
+			fetch_next_group(request);
+			return;
+		}
+
+		if (group.size() > 1)
+		{
+			batch_failures = 0;
+		}
+
+		for (int i = 0; i < (int) group.size(); i++)
+		{
+			request -> data[group[i]] = readings[i];
+		}
+
+		request -> next_group++;
+
+		// Once every command of a failed batch has been fetched singly, see whether batching was to blame
+		if (request -> next_group <= request -> singles_end)
+		{
+			request -> singles_answered += answered;
+			if (request -> next_group == request -> singles_end)
+			{
+				learn_batching(request -> batch_answered, request -> singles_answered);
+			}
+		}
+
+		fetch_next_group(request);
+	});
+}
+
+/* This coroutine fetches one OBDII command, for callers that co_await it
+* It completes as query_batch() does
+*/
+boost::asio::awaitable<Command::Reading> ElmDevice::query(Command::COMMAND cmd, long timeout_ms)
+{
+	std::vector<Command::Reading> data = co_await query_batch(std::vector<Command::COMMAND>(1, cmd), timeout_ms);
+	co_return data[0];
+}
+
+/* This function fetches several OBDII commands for callers that co_await it, batching them
+* as async_get_data_batch() does, and gives the response data in the same order as the commands
+* The device must be on a shared io_service being run by other threads or by the caller's event
+* loop, since a device with its own io_service only runs it during the blocking calls
+* Coroutines on any thread can query the same device at once. The device's own state is only
+* touched on its connection's strand, and each coroutine resumes on its own executor
+* If the readings take longer than timeout_ms, it throws boost::system::system_error with
+* timed_out, or operation_aborted if cancel_queries() is called first. Either way, the exchange
+* already on the wire finishes, since the ELM327 can't drop a request once it's sent, but the
+* rest of the batch isn't sent
+*/
+boost::asio::awaitable<std::vector<Command::Reading> > ElmDevice::query_batch(std::vector<Command::COMMAND> cmds, long timeout_ms)
+{
+	return boost::asio::async_initiate<const boost::asio::use_awaitable_t<>&, void(boost::system::error_code, std::vector<Command::Reading>)>(
+		[this, cmds, timeout_ms](auto handler)
+	{
+		// The coroutine resumes on its own executor, whichever thread its readings arrive on
+		typedef decltype(handler) Handler;
+		std::shared_ptr<Handler> waiting(new Handler(std::move(handler)));
+		boost::asio::any_io_executor executor = boost::asio::get_associated_executor(*waiting);
+
+		std::shared_ptr<PendingQuery> query(new PendingQuery(executor));
+		query -> complete = [waiting, executor](boost::system::error_code error, std::vector<Command::Reading> data)
+		{
+			boost::asio::post(executor, [waiting, error, data]()
+			{
+				(*waiting)(error, data);
+			});
+		};
+
+		query -> timer.expires_after(std::chrono::milliseconds(timeout_ms));
+		query -> timer.async_wait([query](const boost::system::error_code& error)
+		{
+			if (error != boost::asio::error::operation_aborted)
+			{
+				query -> finish(boost::asio::error::timed_out, std::vector<Command::Reading>());
+			}
+		});
+
+		{
+			std::lock_guard<std::mutex> guard(queries_lock);
+			queries.erase(std::remove_if(queries.begin(), queries.end(), [](const std::weak_ptr<PendingQuery>& pending)
+			{
+				return pending.expired();
+			}), queries.end());
+			queries.push_back(query);
+		}
+
+		async_get_data_batch(cmds, [query](std::vector<Command::Reading> readings)
+		{
+			query -> finish(boost::system::error_code(), readings);
+		}, &(query -> done));
+	}, boost::asio::use_awaitable);
+}
+
+// This function makes every coroutine query still waiting throw operation_aborted
+void ElmDevice::cancel_queries()
+{
+	std::vector<std::shared_ptr<PendingQuery> > waiting;
+	{
+		std::lock_guard<std::mutex> guard(queries_lock);
+		for (const std::weak_ptr<PendingQuery>& pending : queries)
+		{
+			std::shared_ptr<PendingQuery> query = pending.lock();
+			if (query)
+			{
+				waiting.push_back(query);
+			}
+		}
+		queries.clear();
+	}
+
+	for (std::shared_ptr<PendingQuery> query : waiting)
+	{
+		query -> finish(boost::asio::error::operation_aborted, std::vector<Command::Reading>());
+	}
+}
+
+/* This function completes a coroutine query, unless its readings, timeout or cancellation
+* already has. Only the first to get here touches the timer, so it's never used from two threads at once
+*/
+void ElmDevice::PendingQuery::finish(boost::system::error_code error, std::vector<Command::Reading> data)
+{
+	if (done.exchange(true))
+	{
+		return;
+	}
+
+	if (error != boost::asio::error::timed_out)
+	{
+		timer.cancel();
+	}
+	complete(error, data);
+}
+
+/* This function checks whether Mode 01 commands should be batched
+* Once batching has been disabled for RECHECK_INTERVAL_S, it's tried again, but one more failure disables it
+*/
+bool ElmDevice::is_batching_enabled()
+{
+	if (!batching_enabled && std::chrono::steady_clock::now() - batching_disabled_at >= std::chrono::seconds(RECHECK_INTERVAL_S))
+	{
+		batching_enabled = true;
+		batch_failures = MAX_BATCH_FAILURES - 1;
+	}
+
+	return batching_enabled;
+}
+
+/* This function learns from a failed batch, once its commands have been fetched singly
+* It only counts against batching if more of them answered singly than together
+*/
+void ElmDevice::learn_batching(int batch_answered, int singles_answered)
+{
+	if (singles_answered <= std::max(batch_answered, 1))
+	{
+		return;
+	}
+
+	batch_failures++;
+	if (batch_failures >= MAX_BATCH_FAILURES)
+	{
+		batching_enabled = false;
+		batching_disabled_at = std::chrono::steady_clock::now();
+	}
+}
+
+// This function records every raw exchange with the device to a capture file, for replay later
+bool ElmDevice::start_capture(std::string path)
+{
+	return connection -> start_capture(path);
+}
+
+/* This function fetches a single Mode 01 request for one or more commands
+* Without a response count, the ELM327 can't know when the last ECU has answered, so it waits
+* for its full response timeout before prompting. Once the number of ECU messages for a set of
+* PIDs has been learned, the count is appended to the request (010C1) and the chip prompts as
+* soon as they've arrived
+* If a counted request comes back with fewer values than expected, the count was too low and
+* some answers were cut off, so the request is sent again without it and the count relearned
+*/
+void ElmDevice::async_fetch_counted(std::vector<Command::COMMAND> cmds, BatchHandler handler)
+{
+	std::string request = (cmds.size() == 1) ? Command::get_command_string(cmds[0]) : Command::build_batch_command(cmds);
+
+	// Requests for the same PIDs in any order reach the same ECUs
+	std::string key = "";
+	for (Command::COMMAND cmd : cmds)
+	{
+		key += (char) Command::get_info(cmd).pid;
+	}
+	std::sort(key.begin(), key.end());
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	ResponseCount* learned = &response_counts.emplace(key, ResponseCount{ 0, 0, 0, 0, now }).first -> second;
+	bool counted = response_counts_enabled && learned -> confirmations >= COUNT_CONFIRMATIONS
+		&& learned -> failures < MAX_COUNT_FAILURES && now - learned -> last_learned < std::chrono::seconds(RECHECK_INTERVAL_S);
+
+	connection -> async_fetch_response(counted ? get_counted_request(request, learned -> messages) : request, SerialConnection::DEFAULT_TIMEOUT_MS,
+		[this, cmds, request, learned, counted, handler](const boost::system::error_code&, std::string raw_data)
+	{
+		std::vector<Command::Reading> readings(cmds.size());
+		std::chrono::steady_clock::time_point decode_start = std::chrono::steady_clock::now();
+		bool complete = decode_counted(*learned, counted, raw_data, cmds, readings);
+		int64_t decode_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - decode_start).count();
+
+		if (complete)
+		{
+			record_stats(cmds, readings, decode_ns);
+			handler(readings);
+			return;
+		}
+
+		connection -> async_fetch_response(request, SerialConnection::DEFAULT_TIMEOUT_MS,
+			[this, cmds, learned, handler](const boost::system::error_code&, std::string raw_data)
+		{
+			std::vector<Command::Reading> readings(cmds.size());
+			std::chrono::steady_clock::time_point decode_start = std::chrono::steady_clock::now();
+			decode_counted(*learned, false, raw_data, cmds, readings);
+			int64_t decode_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - decode_start).count();
+
+			record_stats(cmds, readings, decode_ns);
+			handler(readings);
+		});
+	});
+}
+
+/* This function decodes the response to a Mode 01 request and checks it against the learned count
+* It returns false if the request was counted and the count turned out to be too low, in which
+* case the request needs to be sent again without one
+*/
+bool ElmDevice::decode_counted(ResponseCount& learned, bool counted, const std::string& raw_data,
+	const std::vector<Command::COMMAND>& cmds, std::vector<Command::Reading>& readings)
+{
+	if (cmds.size() == 1)
+	{
+		readings[0] = Command::decode(raw_data, cmds[0]);
+	}
+	else
+	{
+		Command::decode_batch(raw_data, cmds.data(), cmds.size(), readings.data());
+	}
+
+	int messages = Command::count_messages(raw_data);
+	int answered = 0;
+	for (const Command::Reading& reading : readings)
+	{
+		if (reading.status == Command::STATUS_OK || reading.status == Command::STATUS_INVALID)
+		{
+			answered++;
+		}
+	}
+
+	if (!counted)
+	{
+		learn_response_count(learned, messages, answered);
+		return true;
+	}
+
+	// A timeout says nothing about the count, and fetching again would only wait twice
+	if (raw_data.empty())
+	{
+		return true;
+	}
+
+	if (answered >= learned.answered)
+	{
+		// Fewer messages than counted means the chip waited out its timeout anyway
+		learned.failures = 0;
+		if (messages < learned.messages)
+		{
+			learn_response_count(learned, messages, answered);
+		}
+
+		return true;
+	}
+
+	// Chips older than v1.3 and some clones reject requests with a count
+	if (raw_data.find('?') != std::string::npos)
+	{
+		response_counts_enabled = false;
+	}
+
+	learned.failures++;
+	learned.confirmations = 0;
+
+	return false;
+}
+
+// This function records the response to a request sent without a count
+void ElmDevice::learn_response_count(ResponseCount& learned, int messages, int answered)
+{
+	// Nothing can be learned from NO DATA or a timeout
+	if (answered == 0 || messages == 0)
+	{
+		return;
+	}
+
+	learned.last_learned = std::chrono::steady_clock::now();
+	if (messages == learned.messages && answered == learned.answered)
+	{
+		learned.confirmations++;
+	}
+	else
+	{
+		learned.messages = messages;
+		learned.answered = answered;
+		learned.confirmations = (messages <= MAX_RESPONSE_COUNT) ? 1 : 0;
+	}
+}
+
+// This function appends a response count to a request, such as 010C\r to 010C1\r
+std::string ElmDevice::get_counted_request(std::string request, int messages)
+{
+	return request.substr(0, request.length() - 1) + Command::hex_digit(messages) + "\r";
+}
+
+long ElmDevice::get_baud_rate()
+{
+	return connection -> get_baud_rate();
+}
+
+/* This function checks whether the vehicle supports a command, from its supported PID bitmaps
+* Commands other than Mode 01, and every command on a vehicle whose bitmaps aren't known,
+* count as supported
+*/
+bool ElmDevice::is_supported(Command::COMMAND cmd)
+{
+	const Command::PidInfo& info = Command::get_info(cmd);
+	if (!supported_pids_known || info.mode != 0x01 || info.pid == 0x00)
+	{
+		return true;
+	}
+
+	int bit = info.pid - 1;
+	return (vehicle.supported_pids[bit / 32] >> (31 - bit % 32)) & 1;
+}
+
+// This function returns the vehicle identified during setup. The VIN is empty if it couldn't be read
+const VehicleInfo& ElmDevice::get_vehicle()
+{
+	return vehicle;
+}
+
+// This function checks whether the vehicle was set up from the cache
+bool ElmDevice::is_vehicle_cached()
+{
+	return vehicle_cached;
+}
+
+/* This function returns the latency statistics for every command fetched so far
+* It must not be called while a fetch is in progress on another thread
+*/
+const LatencyStats& ElmDevice::get_stats()
+{
+	return stats;
+}
+
+void ElmDevice::clear_stats()
+{
+	stats.clear();
+}
+
+/* This function monitors all traffic on the bus, passing the raw output to the handler until stop_monitor()
+* Headers are turned on, so every frame shows its ID, and CAN formatting is turned off, so
+* every data byte is shown as it was sent. The filter picks the frames to show: an ID such as
+* 7E8, where X is a wildcard digit (AT CRA), or an ID and mask such as 7E0/7F0 (AT CF, AT CM)
+* The ELM327 stops monitoring by itself when its buffer fills, so monitoring is started again
+* until it's stopped. The settings are restored afterwards
+* It returns false if the adapter doesn't accept the filter. No other requests can be made
+* while monitoring
+*/
+bool ElmDevice::monitor(std::string filter, MonitorHandler handler)
+{
+	monitor_stopped = false;
+
+	connection -> fetch_response(std::string(Command::CMD_HEADERS_ON));
+	connection -> fetch_response(std::string(Command::CMD_CAN_FORMATTING_OFF));
+	if (!set_monitor_filter(filter))
+	{
+		reset_monitor_settings(filter);
+		return false;
+	}
+
+	while (!monitor_stopped)
+	{
+		std::shared_ptr<std::promise<boost::system::error_code> > done(new std::promise<boost::system::error_code>());
+		connection -> async_stream(std::string(Command::CMD_MONITOR_ALL), handler,
+			[done](const boost::system::error_code& error, std::string)
+		{
+			done -> set_value(error);
+		}, monitor_stopped);
+		connection -> run();
+
+		if (done -> get_future().get())
+		{
 			break;
+		}
 	}
-	
-	// Convert the raw data into a human-readable format again via the command object
-	std::string data = Command::interpret_raw(raw_data, cmd);
 
-	return data;
+	reset_monitor_settings(filter);
+	return true;
+}
+
+/* This function stops monitoring, and can be called from any thread
+* monitor() returns once the adapter has stopped
+*/
+void ElmDevice::stop_monitor()
+{
+	monitor_stopped = true;
+	connection -> stop_stream();
 }
 
+// This function sets up the monitor filter. It returns false if the adapter rejects it
+bool ElmDevice::set_monitor_filter(std::string filter)
+{
+	if (filter.empty())
+	{
+		return true;
+	}
+
+	std::string::size_type slash = filter.find('/');
+	if (slash == std::string::npos)
+	{
+		return connection -> fetch_response(Command::CMD_SET_RECEIVE_ADDRESS + filter + "\r").find("OK") != std::string::npos;
+	}
+
+	return connection -> fetch_response(Command::CMD_SET_CAN_FILTER + filter.substr(0, slash) + "\r").find("OK") != std::string::npos
+		&& connection -> fetch_response(Command::CMD_SET_CAN_MASK + filter.substr(slash + 1) + "\r").find("OK") != std::string::npos;
+}
+
+/* This function goes back to the settings used for requests
+* A mask of all zeros lets every ID through, which clears the AT CF filter
+*/
+void ElmDevice::reset_monitor_settings(std::string filter)
+{
+	if (filter.find('/') != std::string::npos)
+	{
+		connection -> fetch_response(Command::CMD_SET_CAN_MASK + std::string(filter.length() - filter.find('/') - 1, '0') + "\r");
+	}
+	else if (!filter.empty())
+	{
+		connection -> fetch_response(std::string(Command::CMD_AUTO_RECEIVE));
+	}
+
+	connection -> fetch_response(std::string(Command::CMD_CAN_FORMATTING_ON));
+	connection -> fetch_response(std::string(Command::CMD_HEADERS_OFF));
+}
+
+/* This function records the timings of the exchange that just finished against each of its commands
+* It's called from the exchange's response handler, so the connection's last timing is this exchange's
+*/
+void ElmDevice::record_stats(const std::vector<Command::COMMAND>& cmds, const std::vector<Command::Reading>& readings, int64_t decode_ns)
+{
+	const ExchangeTiming& timing = connection -> get_last_timing();
+	for (std::vector<Command::COMMAND>::size_type i = 0; i < cmds.size(); i++)
+	{
+		stats.record(cmds[i], timing, decode_ns, readings[i]);
+	}
+}
+
+/* This function sets up the ELM327 for fast polling
+* Echo, spaces and linefeeds are turned off so every response carries only data,
+* adaptive timing is enabled, and the link is switched to the fastest baud rate
+* the chip accepts. Then the last vehicle's protocol is tried first, the response
+* timeout is tuned to the vehicle, and the vehicle's supported PIDs are looked up
+* Settings the chip doesn't support are answered with ? and left as they were
+*/
 void ElmDevice::init_settings()
-{	
-	connection -> fetch_response(std::string(Command::CMD_ECHO_OFF), 25);
+{
+	vehicle.vin = "";
+	vehicle.protocol = 0;
+	vehicle.supported_pids.fill(0);
+	supported_pids_known = false;
+	vehicle_cached = false;
+	monitor_stopped = false;
+
+	connection -> fetch_response(std::string(Command::CMD_ECHO_OFF));
+	connection -> fetch_response(std::string(Command::CMD_LINEFEEDS_OFF));
+	connection -> fetch_response(std::string(Command::CMD_SPACES_OFF));
+	connection -> fetch_response(std::string(Command::CMD_ADAPTIVE_TIMING));
+
+	negotiate_baud_rate();
+	select_protocol();
+	tune_timeout();
+	identify_vehicle();
+}
+
+/* This function has the ELM327 try the last vehicle's protocol before searching
+* An automatic protocol search tries each protocol in turn and can take several seconds.
+* AT SP A<n> connects straight away if the vehicle uses protocol n, and still falls back
+* to a search if it doesn't, such as when the adapter has moved to another vehicle
+*/
+void ElmDevice::select_protocol()
+{
+	VehicleInfo last;
+	if (cache_path.empty() || !VehicleCache::load_last(cache_path, last) || last.protocol <= 0)
+	{
+		return;
+	}
+
+	connection -> fetch_response(std::string(Command::CMD_SET_PROTOCOL) + "A" + Command::hex_digit(last.protocol) + "\r");
+}
+
+/* This function identifies the vehicle by its VIN and protocol, and finds the PIDs it supports
+* A vehicle in the cache has its supported PID bitmaps loaded from there. Otherwise they're
+* requested from the vehicle and cached for next time, if it has a VIN
+* Nothing is known if the vehicle doesn't answer, and every PID is polled
+*/
+void ElmDevice::identify_vehicle()
+{
+	vehicle.protocol = get_protocol_number();
+	if (vehicle.protocol <= 0)
+	{
+		return;
+	}
+
+	Command::COMMAND vin_cmd = Command::find_command("vin");
+	Command::Reading vin = Command::decode(connection -> fetch_response(Command::get_command_string(vin_cmd)), vin_cmd);
+	vehicle.vin = (vin.status == Command::STATUS_OK) ? std::string(vin.text) : std::string();
+
+	VehicleInfo cached;
+	if (!vehicle.vin.empty() && !cache_path.empty() && VehicleCache::load(cache_path, vehicle.vin, vehicle.protocol, cached))
+	{
+		vehicle = cached;
+		supported_pids_known = true;
+		vehicle_cached = true;
+
+		// Storing it again makes it the most recently used vehicle
+		VehicleCache::store(cache_path, vehicle);
+		return;
+	}
+
+	supported_pids_known = query_supported_pids();
+	if (supported_pids_known && !vehicle.vin.empty() && !cache_path.empty())
+	{
+		VehicleCache::store(cache_path, vehicle);
+	}
+}
+
+/* This function requests the vehicle's supported PID bitmaps, for PIDs 00, 20, 40, ...
+* The last bit of each bitmap says whether the next one is supported. Where several ECUs
+* answer, a PID counts as supported if any of them supports it
+* It returns false if the vehicle doesn't answer PID 00
+*/
+bool ElmDevice::query_supported_pids()
+{
+	for (int i = 0; i < (int) vehicle.supported_pids.size(); i++)
+	{
+		unsigned char pid = i * 0x20;
+		std::string request = std::string("01") + Command::format_hex_byte(pid) + "\r";
+
+		Command::ResponseBytes response;
+		if (!Command::decode_hex(connection -> fetch_response(request), response))
+		{
+			return i > 0;
+		}
+
+		uint32_t bitmap = 0;
+		for (int m = 0; m < response.message_count; m++)
+		{
+			const unsigned char* message = response.bytes + response.message_starts[m];
+			if (response.message_lengths[m] >= 6 && message[0] == 0x41 && message[1] == pid)
+			{
+				bitmap |= ((uint32_t) message[2] << 24) | ((uint32_t) message[3] << 16) | ((uint32_t) message[4] << 8) | message[5];
+			}
+		}
+
+		if (i == 0 && bitmap == 0)
+		{
+			return false;
+		}
+
+		vehicle.supported_pids[i] = bitmap;
+		if ((bitmap & 0x01) == 0)
+		{
+			break;
+		}
+	}
+
+	return true;
+}
+
+/* This function asks the ELM327 which protocol it's connected with, such as A6 for CAN 11/500
+* found by an automatic search. It returns 0 if it hasn't connected to the vehicle
+*/
+int ElmDevice::get_protocol_number()
+{
+	std::string response = connection -> fetch_response(std::string(Command::CMD_PROTOCOL_NUMBER));
+
+	std::string number = "";
+	for (char c : response)
+	{
+		if (Command::hex_value(c) >= 0)
+		{
+			number += c;
+		}
+	}
+
+	// A leading A marks a protocol that was found automatically
+	if (number.length() == 2 && number[0] == 'A')
+	{
+		number.erase(0, 1);
+	}
+
+	return (number.length() == 1) ? Command::hex_value(number[0]) : 0;
+}
+
+// This function switches to the fastest baud rate in BAUD_RATES the chip and port accept
+void ElmDevice::negotiate_baud_rate()
+{
+	for (long baud : BAUD_RATES)
+	{
+		if (baud <= connection -> get_baud_rate() || try_baud_rate(baud))
+		{
+			return;
+		}
+	}
+}
+
+/* This function asks the ELM327 to switch to a new baud rate with AT BRD
+* The chip answers OK at the old rate, switches, and sends its ID at the new rate.
+* It keeps the new rate only if it receives a carriage return at that rate in time,
+* otherwise it goes back to the old rate and prompts there
+* Clones that can't change rate answer ? instead of OK
+*/
+bool ElmDevice::try_baud_rate(long baud)
+{
+	long old_baud = connection -> get_baud_rate();
+	int divisor = (BAUD_CLOCK + baud / 2) / baud;
+	std::string command = std::string(Command::CMD_SET_BAUD_DIVISOR) + Command::format_hex_byte(divisor) + "\r";
+
+	std::string response = connection -> fetch_response(command, BAUD_TIMEOUT_MS, '\r');
+	if (response.find("OK") == std::string::npos)
+	{
+		// Read the rest of the rejection, up to the prompt
+		if (!response.empty())
+		{
+			connection -> fetch_response("", BAUD_TIMEOUT_MS);
+		}
+
+		return false;
+	}
+
+	if (connection -> set_baud_rate(baud))
+	{
+		std::string id = connection -> fetch_response("", BAUD_TIMEOUT_MS, '\r');
+		if (id.find("ELM") != std::string::npos)
+		{
+			std::string confirm = connection -> fetch_response("\r", BAUD_TIMEOUT_MS);
+			if (confirm.find("OK") != std::string::npos)
+			{
+				return true;
+			}
+		}
+	}
+
+	// The chip has gone back to the old rate, so follow it and read its prompt
+	connection -> set_baud_rate(old_baud);
+	connection -> fetch_response("", BAUD_TIMEOUT_MS);
+
+	return false;
+}
+
+/* This function sets the ELM327's response timeout (AT ST) from the measured response latency
+* The chip waits up to this long for more ECU responses before prompting, so a default
+* of 200 ms on a vehicle that answers in 20 ms wastes most of every round-trip
+* The requests are timed with a response count where possible, so the chip's own timeout
+* isn't part of the measurement
+* Nothing is changed if the vehicle doesn't answer, such as with the ignition off
+*/
+void ElmDevice::tune_timeout()
+{
+	// The first request may include the ELM327's protocol search, so it isn't timed
+	Command::ResponseBytes response;
+	std::string request = std::string(Command::CMD_SUPPORTED_PIDS);
+	std::string raw_data = connection -> fetch_response(request);
+	if (!Command::decode_hex(raw_data, response) || response.length == 0 || response.bytes[0] != 0x41)
+	{
+		return;
+	}
+
+	int messages = Command::count_messages(raw_data);
+	if (messages <= MAX_RESPONSE_COUNT)
+	{
+		std::string counted_request = get_counted_request(request, messages);
+		std::string counted_data = connection -> fetch_response(counted_request);
+		if (Command::count_messages(counted_data) == messages)
+		{
+			request = counted_request;
+		}
+		else if (counted_data.find('?') != std::string::npos)
+		{
+			response_counts_enabled = false;
+		}
+	}
+
+	double max_latency_ms = 0;
+	for (int i = 0; i < LATENCY_SAMPLES; i++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (connection -> fetch_response(request).empty())
+		{
+			return;
+		}
+
+		max_latency_ms = std::max(max_latency_ms, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	long timeout_ms = std::min(MAX_TIMEOUT_MS, std::max(MIN_TIMEOUT_MS, (long) std::ceil(max_latency_ms * TIMEOUT_LATENCY_MULTIPLE)));
+
+	int units = (timeout_ms + 3) / 4;
+	std::string command = std::string(Command::CMD_SET_TIMEOUT) + Command::format_hex_byte(units) + "\r";
+	connection -> fetch_response(command);
 }
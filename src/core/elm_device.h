@@ -5,27 +5,182 @@
 *Author: Josh McIntyre
 */
 
+#ifndef ELM_DEVICE_H
+#define ELM_DEVICE_H
+
 #include <iostream>
+#include <chrono>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <algorithm>
 
 #include "serial.h"
 #include "command.h"
+#include "stats.h"
+#include "vehicle_cache.h"
+
+/* This struct holds what's been learned about the responses to one set of Mode 01 PIDs
+* messages is how many ECU messages arrive, and answered is how many of the PIDs get a value
+*/
+struct ResponseCount
+{
+	int messages;
+	int answered;
+	int confirmations;
+	int failures;
+	std::chrono::steady_clock::time_point last_learned;
+};
 
 /* This class abstracts away the details of generating ELM327 commands
 * and processing responses generated by the chip
 */
 class ElmDevice
 {
+	public:
+		// Completion handler for asynchronous requests, called with a reading for each command
+		typedef std::function<void(std::vector<Command::Reading>)> BatchHandler;
+
+		// Handler for bus monitor output, called with each chunk of raw text as it arrives
+		typedef std::function<void(std::string_view)> MonitorHandler;
+
 	private:
+		// A request for several commands, fetched one group of commands at a time
+		struct BatchRequest
+		{
+			std::vector<Command::COMMAND> cmds;
+			std::vector<Command::Reading> data;
+			std::vector<std::vector<int> > groups;
+			std::vector<std::vector<int> >::size_type next_group;
+			BatchHandler handler;
+			const std::atomic<bool>* stopped;
+
+			/* After a batch fails, its commands are fetched one at a time, as the groups up to
+			* singles_end, to check whether they answer singly when they didn't together
+			*/
+			bool split_next;
+			int batch_answered;
+			std::vector<std::vector<int> >::size_type singles_end;
+			int singles_answered;
+		};
+
+		/* A coroutine query waiting for its readings, a timeout or cancel_queries(), whichever
+		* comes first. Whichever sets done first completes the query, and the others do nothing
+		*/
+		struct PendingQuery
+		{
+			std::atomic<bool> done;
+			boost::asio::steady_timer timer;
+			std::function<void(boost::system::error_code, std::vector<Command::Reading>)> complete;
+
+			PendingQuery(const boost::asio::any_io_executor& executor) : done(false), timer(executor) {}
+			void finish(boost::system::error_code error, std::vector<Command::Reading> data);
+		};
+
 		SerialConnection* connection;
 
+		// Batching is disabled after MAX_BATCH_FAILURES batches in a row fail, and tried again after RECHECK_INTERVAL_S
+		bool batching_enabled;
+		int batch_failures;
+		std::chrono::steady_clock::time_point batching_disabled_at;
+
+		// Learned response counts, keyed by the sorted PIDs of a request
+		std::map<std::string, ResponseCount> response_counts;
+		bool response_counts_enabled;
+
+		LatencyStats stats;
+		std::atomic<bool> monitor_stopped;
+
+		// Coroutine queries that may still be waiting, for cancel_queries()
+		std::mutex queries_lock;
+		std::vector<std::weak_ptr<PendingQuery> > queries;
+
+		// The vehicle, identified during setup. Supported PIDs are only checked if they're known
+		std::string cache_path;
+		VehicleInfo vehicle;
+		bool supported_pids_known;
+		bool vehicle_cached;
+
 		void init_settings();
+		void negotiate_baud_rate();
+		bool try_baud_rate(long baud);
+		void tune_timeout();
+		void select_protocol();
+		void identify_vehicle();
+		bool query_supported_pids();
+		int get_protocol_number();
+		bool set_monitor_filter(std::string filter);
+		void reset_monitor_settings(std::string filter);
+		void start_batch(std::vector<Command::COMMAND> cmds, BatchHandler handler, const std::atomic<bool>* stopped);
+		void fetch_next_group(std::shared_ptr<BatchRequest> request);
+		bool is_batching_enabled();
+		void learn_batching(int batch_answered, int singles_answered);
+		void async_fetch_counted(std::vector<Command::COMMAND> cmds, BatchHandler handler);
+		bool decode_counted(ResponseCount& learned, bool counted, const std::string& raw_data,
+			const std::vector<Command::COMMAND>& cmds, std::vector<Command::Reading>& readings);
+		void learn_response_count(ResponseCount& learned, int messages, int answered);
+		std::string get_counted_request(std::string request, int messages);
+		void record_stats(const std::vector<Command::COMMAND>& cmds, const std::vector<Command::Reading>& readings, int64_t decode_ns);
 		
 	public:
-		ElmDevice(std::string port);
+		// Baud rates to try with AT BRD, fastest first. Rates the chip or port reject are skipped
+		static constexpr long BAUD_RATES[] = { 500000, 115200 };
+
+		// The ELM327's baud rate divisor is relative to this clock
+		static constexpr long BAUD_CLOCK = 4000000;
+
+		// How long to wait for each step of the AT BRD handshake
+		static constexpr long BAUD_TIMEOUT_MS = 500;
+
+		/* AT ST is set to a multiple of the slowest measured response, in 4 ms units
+		* It's only ever lowered from the ELM327's 200 ms default, and never below MIN_TIMEOUT_MS
+		*/
+		static constexpr int LATENCY_SAMPLES = 3;
+		static constexpr int TIMEOUT_LATENCY_MULTIPLE = 2;
+		static constexpr long MIN_TIMEOUT_MS = 48;
+		static constexpr long MAX_TIMEOUT_MS = 200;
+
+		/* A response count is only sent once the same count has been seen COUNT_CONFIRMATIONS
+		* times in a row. Every RECHECK_INTERVAL_S, the request is sent without it again to
+		* catch ECUs that have started answering. After MAX_COUNT_FAILURES wrong counts in a
+		* row, the request is always sent without one
+		*/
+		static constexpr int COUNT_CONFIRMATIONS = 2;
+		static constexpr long RECHECK_INTERVAL_S = 60;
+		static constexpr int MAX_COUNT_FAILURES = 3;
+
+		/* A batch has failed when it's answered with NO DATA or only its first PID, while the same
+		* PIDs answer when sent one at a time. A batch that fails alongside its single requests,
+		* such as while the bus is waking up, says nothing about batching
+		*/
+		static constexpr int MAX_BATCH_FAILURES = 3;
+
+		// The response count is a single digit
+		static constexpr int MAX_RESPONSE_COUNT = 9;
+
+		// Default deadline for a coroutine query, covering every exchange it takes
+		static constexpr long DEFAULT_QUERY_TIMEOUT_MS = 10000;
+
+		ElmDevice(std::string port, long baud = SerialConnection::DEFAULT_BAUD_RATE, std::string cache_path = "");
+		ElmDevice(boost::asio::io_service& io, std::string port, long baud = SerialConnection::DEFAULT_BAUD_RATE, std::string cache_path = "");
 		~ElmDevice();
-		std::string get_data(Command::COMMAND cmd);
+		Command::Reading get_data(Command::COMMAND cmd);
+		std::vector<Command::Reading> get_data_batch(std::vector<Command::COMMAND> cmds);
+		void async_get_data_batch(std::vector<Command::COMMAND> cmds, BatchHandler handler, const std::atomic<bool>* stopped = nullptr);
+		boost::asio::awaitable<Command::Reading> query(Command::COMMAND cmd, long timeout_ms = DEFAULT_QUERY_TIMEOUT_MS);
+		boost::asio::awaitable<std::vector<Command::Reading> > query_batch(std::vector<Command::COMMAND> cmds, long timeout_ms = DEFAULT_QUERY_TIMEOUT_MS);
+		void cancel_queries();
+		bool start_capture(std::string path);
+		long get_baud_rate();
+		bool is_supported(Command::COMMAND cmd);
+		const VehicleInfo& get_vehicle();
+		bool is_vehicle_cached();
+		const LatencyStats& get_stats();
+		void clear_stats();
+		bool monitor(std::string filter, MonitorHandler handler);
+		void stop_monitor();
 		
 
 };
 
-
+#endif
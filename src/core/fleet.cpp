@@ -0,0 +1,185 @@
+/* This file contains code that polls several ELM327 adapters from one process
+*
+* Author: Josh McIntyre
+*/
+
+#include "fleet.h"
+
+/* This constructor connects to and initializes every device
+* The pool threads are started first, since device setup waits on responses delivered
+* through the shared io_service. The devices are set up in parallel, so a slow protocol
+* search on one adapter doesn't hold up the others. They share the vehicle cache at cache_path
+*/
+Fleet::Fleet(std::vector<std::string> ports, long baud, int thread_count, std::string cache_path)
+{
+	stopped = false;
+	work.reset(new boost::asio::io_service::work(io));
+	for (int i = 0; i < std::max(thread_count, 1); i++)
+	{
+		threads.push_back(std::thread([this]()
+		{
+			io.run();
+		}));
+	}
+
+	std::vector<std::future<ElmDevice*> > setups;
+	for (std::string port : ports)
+	{
+		setups.push_back(std::async(std::launch::async, [this, port, baud, cache_path]()
+		{
+			return new ElmDevice(io, port, baud, cache_path);
+		}));
+	}
+
+	for (std::vector<std::string>::size_type i = 0; i < ports.size(); i++)
+	{
+		std::unique_ptr<FleetDevice> device(new FleetDevice());
+		device -> port = ports[i];
+		device -> elm_device.reset(setups[i].get());
+		device -> timer.reset(new boost::asio::steady_timer(io));
+		device -> strand.reset(new boost::asio::io_service::strand(io));
+		devices.push_back(std::move(device));
+	}
+}
+
+// This destructor stops polling before the devices are freed
+Fleet::~Fleet()
+{
+	stop();
+}
+
+// This function adds an item to the schedule of every device whose vehicle supports it
+void Fleet::add_item(Command::COMMAND cmd, double rate_hz, int priority)
+{
+	for (std::unique_ptr<FleetDevice>& device : devices)
+	{
+		if (device -> elm_device -> is_supported(cmd))
+		{
+			device -> scheduler.add_item(cmd, rate_hz, priority);
+		}
+	}
+}
+
+/* This function captures every device's raw exchanges, each to its own file
+* The files are named after the path with the device number appended, such as run.cap.0
+*/
+bool Fleet::start_capture(std::string path)
+{
+	for (int i = 0; i < size(); i++)
+	{
+		if (!devices[i] -> elm_device -> start_capture(path + "." + std::to_string(i)))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* This function starts polling every device and returns immediately
+* The handler is called from the pool threads after each fetch, until stop() is called
+*/
+void Fleet::start(UpdateHandler handler)
+{
+	update_handler = handler;
+	for (int i = 0; i < size(); i++)
+	{
+		schedule_next(i);
+	}
+}
+
+/* This function stops polling and waits for the pool threads to finish
+* Fetches already on the wire are allowed to complete, so their samples aren't lost
+*/
+void Fleet::stop()
+{
+	if (threads.empty())
+	{
+		return;
+	}
+
+	stopped = true;
+	for (std::unique_ptr<FleetDevice>& device : devices)
+	{
+		boost::asio::steady_timer* timer = device -> timer.get();
+		boost::asio::post(*device -> strand, [timer]()
+		{
+			timer -> cancel();
+		});
+	}
+
+	work.reset();
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	threads.clear();
+}
+
+int Fleet::size()
+{
+	return devices.size();
+}
+
+std::string Fleet::get_port(int device)
+{
+	return devices[device] -> port;
+}
+
+long Fleet::get_baud_rate(int device)
+{
+	return devices[device] -> elm_device -> get_baud_rate();
+}
+
+/* This function sets a device's timer for its next deadline
+* The timer is armed on the device's strand, after checking stopped there, so a cancel
+* posted by stop() either finds the wait to cancel or keeps it from being armed
+*/
+void Fleet::schedule_next(int device)
+{
+	boost::asio::io_service::strand& strand = *devices[device] -> strand;
+	boost::asio::post(strand, [this, device, &strand]()
+	{
+		if (stopped || devices[device] -> scheduler.get_items().empty())
+		{
+			return;
+		}
+
+		boost::asio::steady_timer& timer = *devices[device] -> timer;
+		timer.expires_at(devices[device] -> scheduler.get_next_deadline());
+		timer.async_wait(boost::asio::bind_executor(strand, [this, device](const boost::system::error_code& error)
+		{
+			if (!error)
+			{
+				poll_device(device);
+			}
+		}));
+	});
+}
+
+/* This function fetches the due batch for a device, then reports it and schedules the next
+* A device only ever has one fetch or timer outstanding, so its scheduler is never used
+* from two threads at once
+*/
+void Fleet::poll_device(int device)
+{
+	if (stopped)
+	{
+		return;
+	}
+
+	PollScheduler& scheduler = devices[device] -> scheduler;
+	std::vector<int> batch = scheduler.select_batch(std::chrono::steady_clock::now());
+	devices[device] -> elm_device -> async_get_data_batch(scheduler.get_commands(batch), [this, device, batch](std::vector<Command::Reading> readings)
+	{
+		PollScheduler& scheduler = devices[device] -> scheduler;
+		scheduler.complete_batch(batch, readings, std::chrono::steady_clock::now());
+
+		if (update_handler)
+		{
+			update_handler(device, scheduler, batch);
+		}
+
+		schedule_next(device);
+	});
+}
@@ -0,0 +1,71 @@
+/* This file contains function declarations and includes for polling several devices at once
+*
+* Author: Josh McIntyre
+*/
+
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <future>
+#include <memory>
+#include <functional>
+#include <atomic>
+
+#include "elm_device.h"
+#include "scheduler.h"
+
+/* This class polls the same items on several ELM327 adapters from one process
+* Every device shares one io_service, run by a small pool of threads, instead of a thread
+* per device. Each device has its own scheduler and timer: when its next item is due, the
+* batch is fetched asynchronously and the timer is set for the following deadline
+* A device's timer is only touched from its strand, so stop() can cancel it from any thread
+*/
+class Fleet
+{
+	public:
+		/* Called from a pool thread after each fetch, with the device number, its scheduler
+		* and the indices of the items that were updated
+		* Handlers for different devices can run at the same time
+		*/
+		typedef std::function<void(int device, PollScheduler& scheduler, const std::vector<int>& updated)> UpdateHandler;
+
+		// A couple of threads is plenty, since the devices spend nearly all their time waiting on the serial link
+		static const int DEFAULT_THREADS = 2;
+
+	private:
+		// One adapter and its polling state
+		struct FleetDevice
+		{
+			std::string port;
+			std::unique_ptr<ElmDevice> elm_device;
+			PollScheduler scheduler;
+			std::unique_ptr<boost::asio::steady_timer> timer;
+			std::unique_ptr<boost::asio::io_service::strand> strand;
+		};
+
+		boost::asio::io_service io;
+		std::unique_ptr<boost::asio::io_service::work> work;
+		std::vector<std::thread> threads;
+		std::vector<std::unique_ptr<FleetDevice> > devices;
+		UpdateHandler update_handler;
+		std::atomic<bool> stopped;
+
+		void schedule_next(int device);
+		void poll_device(int device);
+
+	public:
+		Fleet(std::vector<std::string> ports, long baud = SerialConnection::DEFAULT_BAUD_RATE, int thread_count = DEFAULT_THREADS, std::string cache_path = "");
+		~Fleet();
+		void add_item(Command::COMMAND cmd, double rate_hz = 0, int priority = -1);
+		bool start_capture(std::string path);
+		void start(UpdateHandler handler);
+		void stop();
+		int size();
+		std::string get_port(int device);
+		long get_baud_rate(int device);
+};
+
+#endif
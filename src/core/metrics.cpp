@@ -0,0 +1,437 @@
+/* This file contains code that works out rolling statistics and derived values from samples as they arrive
+*
+* Author: Josh McIntyre
+*/
+
+#include "metrics.h"
+
+RollingWindow::RollingWindow(double window_s)
+{
+	window_us = (int64_t) (window_s * 1e6);
+	sum = 0;
+}
+
+/* This function adds a sample and drops those that have fallen out of the window
+* Samples must arrive in time order. The newest sample is always kept
+*/
+void RollingWindow::add(int64_t timestamp_us, double value)
+{
+	samples.push_back(std::make_pair(timestamp_us, value));
+	sum += value;
+
+	// A value can't be the min (or max) once a smaller (or larger) one has arrived after it
+	while (!minima.empty() && minima.back().second >= value)
+	{
+		minima.pop_back();
+	}
+	minima.push_back(std::make_pair(timestamp_us, value));
+
+	while (!maxima.empty() && maxima.back().second <= value)
+	{
+		maxima.pop_back();
+	}
+	maxima.push_back(std::make_pair(timestamp_us, value));
+
+	int64_t cutoff = timestamp_us - window_us;
+	while (samples.size() > 1 && samples.front().first <= cutoff)
+	{
+		sum -= samples.front().second;
+		samples.pop_front();
+	}
+	while (minima.size() > 1 && minima.front().first <= cutoff)
+	{
+		minima.pop_front();
+	}
+	while (maxima.size() > 1 && maxima.front().first <= cutoff)
+	{
+		maxima.pop_front();
+	}
+
+	// Start the sum again whenever the window empties out, so rounding errors don't build up
+	if (samples.size() == 1)
+	{
+		sum = samples.front().second;
+	}
+}
+
+bool RollingWindow::is_empty()
+{
+	return samples.empty();
+}
+
+double RollingWindow::get_min()
+{
+	return minima.front().second;
+}
+
+double RollingWindow::get_max()
+{
+	return maxima.front().second;
+}
+
+double RollingWindow::get_mean()
+{
+	return sum / samples.size();
+}
+
+MetricsEngine::MetricsEngine()
+{
+	maf_cmd = Command::find_command("maf");
+	speed_cmd = Command::find_command("spd");
+	load_cmd = Command::find_command("lod");
+	maf = {};
+	speed = {};
+	load = {};
+	acceleration_known = false;
+	acceleration = 0;
+	fuel_l = 0;
+	distance_km = 0;
+	load_s = 0;
+}
+
+// This function looks up a derived channel by name, returning -1 if there is none
+int MetricsEngine::find_derived(std::string_view name)
+{
+	for (int i = 0; i < DERIVED_TABLE_SIZE; i++)
+	{
+		if (name == DERIVED_TABLE[i].name)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/* This function adds a metric, such as rpm:mean@10, setting up its channel if it's the first to use it
+* It returns false if the metric isn't valid
+*/
+bool MetricsEngine::add_metric(std::string spec)
+{
+	std::string channel_name = spec;
+	std::string stat_name = "value";
+	double window_s = DEFAULT_WINDOW_S;
+
+	std::string::size_type colon = spec.find(':');
+	if (colon != std::string::npos)
+	{
+		channel_name = spec.substr(0, colon);
+		stat_name = spec.substr(colon + 1);
+
+		std::string::size_type at = stat_name.find('@');
+		if (at != std::string::npos)
+		{
+			window_s = std::atof(stat_name.substr(at + 1).c_str());
+			stat_name = stat_name.substr(0, at);
+		}
+	}
+
+	STAT stat;
+	if (stat_name == "value")
+	{
+		stat = STAT_VALUE;
+	}
+	else if (stat_name == "min")
+	{
+		stat = STAT_MIN;
+	}
+	else if (stat_name == "max")
+	{
+		stat = STAT_MAX;
+	}
+	else if (stat_name == "mean")
+	{
+		stat = STAT_MEAN;
+	}
+	else if (stat_name == "ewma")
+	{
+		stat = STAT_EWMA;
+	}
+	else
+	{
+		return false;
+	}
+
+	// Trouble codes and text have no value to take statistics of
+	Command::COMMAND cmd = Command::find_command(channel_name);
+	int derived = find_derived(channel_name);
+	if ((cmd == Command::INVALID_COMMAND && derived < 0) || window_s <= 0
+		|| (cmd != Command::INVALID_COMMAND && (Command::get_info(cmd).type == Command::TYPE_DTCS || Command::get_info(cmd).type == Command::TYPE_TEXT)))
+	{
+		return false;
+	}
+
+	Metric metric;
+	metric.channel = add_channel(cmd, derived);
+	metric.stat = stat;
+	metric.window_s = window_s;
+	if (stat == STAT_MIN || stat == STAT_MAX || stat == STAT_MEAN)
+	{
+		metric.window.reset(new RollingWindow(window_s));
+	}
+	metric.known = false;
+	metric.timestamp_us = 0;
+	metric.value = 0;
+
+	channels[metric.channel].metrics.push_back(metrics.size());
+	metrics.push_back(std::move(metric));
+
+	return true;
+}
+
+// This function returns the items that need polling for the metrics
+std::vector<Command::COMMAND> MetricsEngine::get_required_commands()
+{
+	std::vector<Command::COMMAND> cmds;
+	for (const std::pair<const Command::COMMAND, std::vector<int> >& entry : dependents)
+	{
+		cmds.push_back(entry.first);
+	}
+
+	return cmds;
+}
+
+/* This function updates every metric that depends on a sample's item
+* Samples of items no metric depends on, and failed readings, are ignored
+*/
+void MetricsEngine::add_sample(int64_t timestamp_us, Command::COMMAND cmd, const Command::Reading& reading)
+{
+	std::map<Command::COMMAND, std::vector<int> >::iterator found = dependents.find(cmd);
+	if (found == dependents.end() || reading.status != Command::STATUS_OK)
+	{
+		return;
+	}
+
+	update_inputs(timestamp_us, cmd, reading.value);
+
+	for (int index : found -> second)
+	{
+		double value;
+		if (get_channel_value(channels[index], reading.value, value))
+		{
+			for (int metric : channels[index].metrics)
+			{
+				update_metric(metrics[metric], timestamp_us, value);
+			}
+		}
+	}
+}
+
+int MetricsEngine::size()
+{
+	return metrics.size();
+}
+
+// This function gets a metric's current value. It returns false until the metric has one
+bool MetricsEngine::get_value(int metric, double& value)
+{
+	value = metrics[metric].value;
+	return metrics[metric].known;
+}
+
+// This function describes a metric for display, such as "Engine RPM mean over 10 s"
+std::string MetricsEngine::get_label(int metric)
+{
+	const Metric& entry = metrics[metric];
+	const Channel& channel = channels[entry.channel];
+
+	std::stringstream ss;
+	ss << ((channel.derived < 0) ? Command::get_info(channel.cmd).label : DERIVED_TABLE[channel.derived].label);
+	switch (entry.stat)
+	{
+		case STAT_MIN:
+			ss << " min over " << entry.window_s << " s";
+			break;
+
+		case STAT_MAX:
+			ss << " max over " << entry.window_s << " s";
+			break;
+
+		case STAT_MEAN:
+			ss << " mean over " << entry.window_s << " s";
+			break;
+
+		case STAT_EWMA:
+			ss << " average (" << entry.window_s << " s)";
+			break;
+
+		default:
+			break;
+	}
+
+	return ss.str();
+}
+
+// This function returns the unit suffix of a metric's values, such as " L/100km"
+std::string MetricsEngine::get_unit(int metric)
+{
+	const Channel& channel = channels[metrics[metric].channel];
+	return (channel.derived < 0) ? Command::get_unit_suffix(Command::get_info(channel.cmd).unit) : DERIVED_TABLE[channel.derived].unit;
+}
+
+// This function returns the channel for an item or derived channel, adding it if it's new
+int MetricsEngine::add_channel(Command::COMMAND cmd, int derived)
+{
+	for (int i = 0; i < (int) channels.size(); i++)
+	{
+		if ((derived < 0 && channels[i].derived < 0 && channels[i].cmd == cmd) || (derived >= 0 && channels[i].derived == derived))
+		{
+			return i;
+		}
+	}
+
+	Channel channel;
+	channel.cmd = (derived < 0) ? cmd : Command::INVALID_COMMAND;
+	channel.derived = derived;
+	channels.push_back(channel);
+
+	int index = channels.size() - 1;
+	if (derived < 0)
+	{
+		dependents[cmd].push_back(index);
+	}
+	else
+	{
+		for (const char* input : DERIVED_TABLE[derived].inputs)
+		{
+			if (input != nullptr)
+			{
+				dependents[Command::find_command(input)].push_back(index);
+			}
+		}
+	}
+
+	return index;
+}
+
+/* This function updates the inputs of the derived channels with a sample
+* Trip totals are integrated with the trapezoidal rule between consecutive samples
+*/
+void MetricsEngine::update_inputs(int64_t timestamp_us, Command::COMMAND cmd, double value)
+{
+	if (cmd == maf_cmd)
+	{
+		fuel_l += integrate(maf, timestamp_us, value) / (STOICHIOMETRIC_AFR * FUEL_DENSITY_G_PER_L);
+		maf = { true, timestamp_us, value };
+	}
+	else if (cmd == speed_cmd)
+	{
+		distance_km += integrate(speed, timestamp_us, value) / 3600.0;
+
+		double elapsed_s = (timestamp_us - speed.timestamp_us) / 1e6;
+		if (speed.known && elapsed_s > 0 && elapsed_s <= MAX_INTEGRATION_GAP_S)
+		{
+			acceleration = (value - speed.value) / 3.6 / elapsed_s;
+			acceleration_known = true;
+		}
+		speed = { true, timestamp_us, value };
+	}
+	else if (cmd == load_cmd)
+	{
+		load_s += integrate(load, timestamp_us, value) / 100.0;
+		load = { true, timestamp_us, value };
+	}
+}
+
+// This function works out a channel's value after one of its inputs changed. It returns false if it has none yet
+bool MetricsEngine::get_channel_value(const Channel& channel, double input, double& value)
+{
+	switch (channel.derived)
+	{
+		case DERIVED_FUEL_RATE:
+			value = get_fuel_rate(maf.value);
+			return maf.known;
+
+		case DERIVED_ECONOMY:
+			if (!maf.known || !speed.known || speed.value < MIN_ECONOMY_KPH)
+			{
+				return false;
+			}
+			value = 100.0 * get_fuel_rate(maf.value) / speed.value;
+			return true;
+
+		case DERIVED_TRIP_ECONOMY:
+			value = 100.0 * fuel_l / distance_km;
+			return distance_km >= MIN_TRIP_KM;
+
+		case DERIVED_FUEL_USED:
+			value = fuel_l;
+			return true;
+
+		case DERIVED_DISTANCE:
+			value = distance_km;
+			return true;
+
+		case DERIVED_ACCELERATION:
+			value = acceleration;
+			return acceleration_known;
+
+		case DERIVED_LOAD_TIME:
+			value = load_s;
+			return true;
+
+		default:
+			value = input;
+			return true;
+	}
+}
+
+// This function updates a metric with a new value of its channel
+void MetricsEngine::update_metric(Metric& metric, int64_t timestamp_us, double value)
+{
+	switch (metric.stat)
+	{
+		case STAT_MIN:
+			metric.window -> add(timestamp_us, value);
+			metric.value = metric.window -> get_min();
+			break;
+
+		case STAT_MAX:
+			metric.window -> add(timestamp_us, value);
+			metric.value = metric.window -> get_max();
+			break;
+
+		case STAT_MEAN:
+			metric.window -> add(timestamp_us, value);
+			metric.value = metric.window -> get_mean();
+			break;
+
+		// The weight of each sample depends on the time since the last, so uneven polling doesn't skew it
+		case STAT_EWMA:
+			if (metric.known)
+			{
+				double elapsed_s = std::max((timestamp_us - metric.timestamp_us) / 1e6, 0.0);
+				metric.value += (1.0 - std::exp(-elapsed_s / metric.window_s)) * (value - metric.value);
+			}
+			else
+			{
+				metric.value = value;
+			}
+			break;
+
+		default:
+			metric.value = value;
+			break;
+	}
+
+	metric.known = true;
+	metric.timestamp_us = timestamp_us;
+}
+
+// This function converts mass air flow in g/s to fuel flow in L/h
+double MetricsEngine::get_fuel_rate(double maf_g_per_s)
+{
+	return maf_g_per_s * 3600.0 / (STOICHIOMETRIC_AFR * FUEL_DENSITY_G_PER_L);
+}
+
+// This function returns the area under an input between its previous sample and a new one, in value-seconds
+double MetricsEngine::integrate(const Input& previous, int64_t timestamp_us, double value)
+{
+	double elapsed_s = (timestamp_us - previous.timestamp_us) / 1e6;
+	if (!previous.known || elapsed_s <= 0 || elapsed_s > MAX_INTEGRATION_GAP_S)
+	{
+		return 0;
+	}
+
+	return elapsed_s * (previous.value + value) / 2.0;
+}
@@ -0,0 +1,177 @@
+/* This file contains function declarations and includes for metrics derived from the sample stream
+*
+* Author: Josh McIntyre
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <utility>
+#include <string_view>
+#include <algorithm>
+
+#include "command.h"
+
+/* This class keeps the min, max and mean of the values seen over the last window_s seconds
+* Each sample takes O(1) time on average: the sum is kept as values come and go, and the
+* min and max come from queues holding only the values that could still become the min or max
+*/
+class RollingWindow
+{
+	private:
+		int64_t window_us;
+		std::deque<std::pair<int64_t, double> > samples;
+		std::deque<std::pair<int64_t, double> > minima;
+		std::deque<std::pair<int64_t, double> > maxima;
+		double sum;
+
+	public:
+		RollingWindow(double window_s);
+		void add(int64_t timestamp_us, double value);
+		bool is_empty();
+		double get_min();
+		double get_max();
+		double get_mean();
+};
+
+/* This struct describes a channel that's worked out from other items rather than read directly
+* Each takes up to two items as inputs, by name
+*/
+struct DerivedInfo
+{
+	const char* name;
+	const char* label;
+	const char* unit;
+	const char* inputs[2];
+};
+
+/* The derived channels, in the order of MetricsEngine::DERIVED
+* Fuel is worked out from the mass air flow, assuming a stoichiometric gasoline engine, so it
+* reads high under enrichment and means little for diesels. Acceleration is from speed deltas,
+* which the 1 km/h resolution of PID 0D makes noisy, so it's best smoothed with ewma
+*/
+inline constexpr DerivedInfo DERIVED_TABLE[] = {
+	{ "fuel_rate", "Fuel rate", " L/h", { "maf", nullptr } },
+	{ "economy", "Fuel economy", " L/100km", { "maf", "spd" } },
+	{ "trip_economy", "Trip fuel economy", " L/100km", { "maf", "spd" } },
+	{ "fuel_used", "Trip fuel used", " L", { "maf", nullptr } },
+	{ "distance", "Trip distance", " km", { "spd", nullptr } },
+	{ "accel", "Acceleration", " m/s^2", { "spd", nullptr } },
+	{ "load_time", "Full load time", " s", { "lod", nullptr } }
+};
+
+inline constexpr int DERIVED_TABLE_SIZE = sizeof(DERIVED_TABLE) / sizeof(DERIVED_TABLE[0]);
+
+/* This class computes metrics from the samples of polled items, one sample at a time
+* A metric is a statistic of a channel, given as <channel>[:<stat>[@<window s>]], such as
+* rpm:mean@10 or economy:ewma@30. A channel is an item from PID_TABLE, or one of
+* DERIVED_TABLE. The stats are value (the latest), min, max and mean over the window, and
+* ewma, an exponentially weighted moving average with the window as its time constant
+* Only the channels some metric uses are worked out, and only when one of their inputs changes
+*/
+class MetricsEngine
+{
+	public:
+		enum STAT { STAT_VALUE,
+					STAT_MIN,
+					STAT_MAX,
+					STAT_MEAN,
+					STAT_EWMA
+				  };
+
+		// The derived channels, by their index in DERIVED_TABLE
+		enum DERIVED { DERIVED_FUEL_RATE,
+					   DERIVED_ECONOMY,
+					   DERIVED_TRIP_ECONOMY,
+					   DERIVED_FUEL_USED,
+					   DERIVED_DISTANCE,
+					   DERIVED_ACCELERATION,
+					   DERIVED_LOAD_TIME
+					 };
+
+		// Windows, in seconds, for metrics that don't give one
+		static constexpr double DEFAULT_WINDOW_S = 10.0;
+
+		// Fuel is worked out from air mass with the stoichiometric air-fuel ratio and density of gasoline
+		static constexpr double STOICHIOMETRIC_AFR = 14.7;
+		static constexpr double FUEL_DENSITY_G_PER_L = 745.0;
+
+		// Instant economy isn't shown below this speed, nor trip economy before this distance
+		static constexpr double MIN_ECONOMY_KPH = 5.0;
+		static constexpr double MIN_TRIP_KM = 0.1;
+
+		// Trip totals aren't carried across gaps longer than this, such as when an item stops answering
+		static constexpr double MAX_INTEGRATION_GAP_S = 5.0;
+
+	private:
+		// The latest sample of an input item
+		struct Input
+		{
+			bool known;
+			int64_t timestamp_us;
+			double value;
+		};
+
+		// A channel is a PID_TABLE entry, or a DERIVED_TABLE entry if derived isn't -1. Its metrics are updated whenever it changes
+		struct Channel
+		{
+			Command::COMMAND cmd;
+			int derived;
+			std::vector<int> metrics;
+		};
+
+		struct Metric
+		{
+			int channel;
+			STAT stat;
+			double window_s;
+			std::unique_ptr<RollingWindow> window;
+			bool known;
+			int64_t timestamp_us;
+			double value;
+		};
+
+		std::vector<Channel> channels;
+		std::vector<Metric> metrics;
+		std::map<Command::COMMAND, std::vector<int> > dependents;
+
+		Command::COMMAND maf_cmd;
+		Command::COMMAND speed_cmd;
+		Command::COMMAND load_cmd;
+		Input maf;
+		Input speed;
+		Input load;
+		bool acceleration_known;
+		double acceleration;
+		double fuel_l;
+		double distance_km;
+		double load_s;
+
+		int add_channel(Command::COMMAND cmd, int derived);
+		void update_inputs(int64_t timestamp_us, Command::COMMAND cmd, double value);
+		bool get_channel_value(const Channel& channel, double input, double& value);
+		void update_metric(Metric& metric, int64_t timestamp_us, double value);
+		static double get_fuel_rate(double maf_g_per_s);
+		static double integrate(const Input& previous, int64_t timestamp_us, double value);
+
+	public:
+		MetricsEngine();
+		bool add_metric(std::string spec);
+		std::vector<Command::COMMAND> get_required_commands();
+		void add_sample(int64_t timestamp_us, Command::COMMAND cmd, const Command::Reading& reading);
+		int size();
+		bool get_value(int metric, double& value);
+		std::string get_label(int metric);
+		std::string get_unit(int metric);
+		static int find_derived(std::string_view name);
+};
+
+#endif
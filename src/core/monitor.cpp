@@ -0,0 +1,356 @@
+/* This file contains code that monitors raw bus traffic through the ELM327
+*
+* Author: Josh McIntyre
+*/
+
+#include "monitor.h"
+
+// Hex digit values by character, or -1, since looking them up is most of the parsing work
+static constexpr std::array<signed char, 256> HEX_VALUES = []()
+{
+	std::array<signed char, 256> values = {};
+	for (int c = 0; c < 256; c++)
+	{
+		values[c] = -1;
+	}
+	for (int digit = 0; digit < 16; digit++)
+	{
+		values["0123456789ABCDEF"[digit]] = digit;
+		values["0123456789abcdef"[digit]] = digit;
+	}
+	return values;
+}();
+
+// This constructor allocates a ring, rounding the capacity up to a power of two
+FrameRing::FrameRing(std::size_t capacity)
+{
+	std::size_t size = 1;
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+
+	slots.resize(size);
+	mask = size - 1;
+	head = 0;
+	tail = 0;
+	dropped = 0;
+}
+
+/* This function returns the next free slot for the producer to fill, or nullptr if the ring is full
+* The slot isn't seen by the consumer until publish()
+*/
+CanFrame* FrameRing::claim()
+{
+	std::size_t position = head.load(std::memory_order_relaxed);
+	if (position - tail.load(std::memory_order_acquire) == slots.size())
+	{
+		return nullptr;
+	}
+
+	return &slots[position & mask];
+}
+
+// This function hands the claimed slot to the consumer
+void FrameRing::publish()
+{
+	head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// This function counts a frame that didn't fit in the ring
+void FrameRing::drop()
+{
+	dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+/* This function points frames at the oldest published frames, for the consumer to read in place
+* It returns how many follow on from it, up to the end of the ring, or 0 if the ring is empty.
+* They stay valid until release()
+*/
+std::size_t FrameRing::read(const CanFrame*& frames)
+{
+	std::size_t position = tail.load(std::memory_order_relaxed);
+	std::size_t available = head.load(std::memory_order_acquire) - position;
+	std::size_t offset = position & mask;
+
+	frames = &slots[offset];
+	return std::min(available, slots.size() - offset);
+}
+
+// This function frees frames the consumer has finished with
+void FrameRing::release(std::size_t count)
+{
+	tail.store(tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+}
+
+// This function returns how many frames were dropped because the consumer fell behind
+unsigned long FrameRing::get_dropped()
+{
+	return dropped.load(std::memory_order_relaxed);
+}
+
+FrameParser::FrameParser(FrameRing& ring, int id_digits) : ring(ring), id_digits(id_digits)
+{
+	id = 0;
+	payload = 0;
+	digits = 0;
+	invalid = false;
+	tail = 0;
+	frames = 0;
+	errors = 0;
+	overflows = 0;
+}
+
+/* This function parses a chunk of monitor output. Lines can be split across chunks
+* Every frame that ends in the chunk gets its timestamp
+*/
+void FrameParser::feed(std::string_view data, int64_t timestamp_us)
+{
+	for (char c : data)
+	{
+		int value = HEX_VALUES[(unsigned char) c];
+		if (value >= 0)
+		{
+			if (digits < id_digits)
+			{
+				id = (id << 4) | value;
+			}
+			else
+			{
+				payload = (payload << 4) | value;
+			}
+
+			digits++;
+		}
+		else if (c == '\r' || c == '\n')
+		{
+			end_line(timestamp_us);
+			continue;
+		}
+		else if (c == ' ')
+		{
+			continue;
+		}
+		else
+		{
+			invalid = true;
+		}
+
+		tail = (tail << 8) | (unsigned char) c;
+	}
+}
+
+/* This function publishes the line's frame, or counts the line as an error if it isn't one
+* The counts are only written from this thread, so they don't need atomic increments
+*/
+void FrameParser::end_line(int64_t timestamp_us)
+{
+	if (digits == 0 && !invalid)
+	{
+		return;
+	}
+
+	int length = (digits - id_digits) / 2;
+	if (invalid || digits < id_digits || (digits - id_digits) % 2 != 0 || length > CanFrame::MAX_DATA_BYTES)
+	{
+		// The last 8 characters of BUFFER FULL, without the space
+		static const uint64_t buffer_full = 0x4646455246554C4CULL;
+		if (tail == buffer_full)
+		{
+			overflows.store(overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+		else
+		{
+			errors.store(errors.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+	}
+	else
+	{
+		CanFrame* frame = ring.claim();
+		if (frame == nullptr)
+		{
+			ring.drop();
+		}
+		else
+		{
+			frame -> timestamp_us = timestamp_us;
+			frame -> id = id;
+			frame -> length = length;
+			for (int i = 0; i < CanFrame::MAX_DATA_BYTES; i++)
+			{
+				frame -> data[i] = (i < length) ? (uint8_t) (payload >> (8 * (length - 1 - i))) : 0;
+			}
+
+			ring.publish();
+			frames.store(frames.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+	}
+
+	id = 0;
+	payload = 0;
+	digits = 0;
+	invalid = false;
+	tail = 0;
+}
+
+unsigned long FrameParser::get_frames()
+{
+	return frames.load(std::memory_order_relaxed);
+}
+
+unsigned long FrameParser::get_errors()
+{
+	return errors.load(std::memory_order_relaxed);
+}
+
+unsigned long FrameParser::get_overflows()
+{
+	return overflows.load(std::memory_order_relaxed);
+}
+
+/* This function returns how many hex digits the ID takes up in monitor output for an ELM327 protocol
+* 29 bit CAN IDs (7, 9 and J1939) take 8, 11 bit CAN IDs take 3, and the older protocols
+* show a 3 byte header
+*/
+int FrameParser::get_id_digits(int protocol)
+{
+	switch (protocol)
+	{
+		case 1:
+		case 2:
+		case 3:
+		case 4:
+		case 5:
+			return 6;
+
+		case 7:
+		case 9:
+		case 0xA:
+			return 8;
+
+		default:
+			return 3;
+	}
+}
+
+/* This constructor sets up monitoring for a device, with a filter as for ElmDevice::monitor()
+* Frame IDs are parsed for the protocol the device found during setup
+*/
+CanMonitor::CanMonitor(ElmDevice& elm_device, std::string filter, std::size_t capacity)
+	: elm_device(elm_device), filter(filter), ring(capacity),
+	parser(ring, FrameParser::get_id_digits(elm_device.get_vehicle().protocol))
+{
+	running = false;
+	failed = false;
+}
+
+// This destructor stops the monitor thread if it's still running
+CanMonitor::~CanMonitor()
+{
+	stop();
+}
+
+// This function starts monitoring on the monitor thread
+void CanMonitor::start()
+{
+	running = true;
+	thread = std::thread([this]()
+	{
+		bool started = elm_device.monitor(filter, [this](std::string_view data)
+		{
+			parser.feed(data, Capture::now_us());
+		});
+
+		failed = !started;
+		running = false;
+	});
+}
+
+// This function stops monitoring and waits for the adapter to go back to accepting requests
+void CanMonitor::stop()
+{
+	if (thread.joinable())
+	{
+		elm_device.stop_monitor();
+		thread.join();
+	}
+}
+
+// This function checks whether monitoring is still going, since it ends by itself if the adapter fails
+bool CanMonitor::is_running()
+{
+	return running;
+}
+
+// This function checks whether the adapter rejected the filter
+bool CanMonitor::has_failed()
+{
+	return failed;
+}
+
+FrameRing& CanMonitor::get_ring()
+{
+	return ring;
+}
+
+FrameParser& CanMonitor::get_parser()
+{
+	return parser;
+}
+
+int CanMonitor::get_id_digits()
+{
+	return FrameParser::get_id_digits(elm_device.get_vehicle().protocol);
+}
+
+/* This function formats a frame as a candump log line, such as (1700000000.123456) elm 7E8#03410C1AF8
+* so it can be replayed and analysed with the Linux can-utils
+* The line is written to a buffer of at least MAX_LINE_LENGTH characters, and its length returned
+*/
+int CanMonitor::format_frame(const CanFrame& frame, int id_digits, char* line)
+{
+	char* out = line;
+	*out++ = '(';
+
+	int64_t seconds = frame.timestamp_us / 1000000;
+	int64_t micros = frame.timestamp_us % 1000000;
+	char digits[20];
+	int count = 0;
+	do
+	{
+		digits[count++] = '0' + seconds % 10;
+		seconds /= 10;
+	} while (seconds > 0 && count < (int) sizeof(digits));
+	while (count > 0)
+	{
+		*out++ = digits[--count];
+	}
+
+	*out++ = '.';
+	for (int64_t divisor = 100000; divisor > 0; divisor /= 10)
+	{
+		*out++ = '0' + (micros / divisor) % 10;
+	}
+
+	static const char device[] = ") elm ";
+	for (const char* c = device; *c != '\0'; c++)
+	{
+		*out++ = *c;
+	}
+
+	for (int shift = (id_digits - 1) * 4; shift >= 0; shift -= 4)
+	{
+		*out++ = Command::hex_digit(frame.id >> shift);
+	}
+
+	*out++ = '#';
+	for (int i = 0; i < frame.length; i++)
+	{
+		*out++ = Command::hex_digit(frame.data[i] >> 4);
+		*out++ = Command::hex_digit(frame.data[i]);
+	}
+
+	*out++ = '\n';
+
+	return (int) (out - line);
+}
@@ -0,0 +1,129 @@
+/* This file contains function declarations and includes for the raw bus monitor
+*
+* Author: Josh McIntyre
+*/
+
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include "elm_device.h"
+
+/* This struct holds one frame seen on the bus
+* The ID is the CAN ID, or the header bytes on older protocols. Frames that finish arriving
+* in the same chunk share a timestamp, in microseconds since the epoch
+*/
+struct CanFrame
+{
+	// The most data bytes a CAN frame can carry
+	static const int MAX_DATA_BYTES = 8;
+
+	int64_t timestamp_us;
+	uint32_t id;
+	uint8_t length;
+	uint8_t data[MAX_DATA_BYTES];
+};
+
+/* This class is a lock-free ring buffer of frames with one producer and one consumer
+* Frames are never copied in or out: the producer fills in a claimed slot and publishes it,
+* and the consumer reads the published slots in place and releases them
+* When the ring is full, the producer's frame is dropped and counted
+*/
+class FrameRing
+{
+	private:
+		std::vector<CanFrame> slots;
+		std::size_t mask;
+
+		// The producer and consumer positions are kept on separate cache lines
+		alignas(64) std::atomic<std::size_t> head;
+		alignas(64) std::atomic<std::size_t> tail;
+		alignas(64) std::atomic<unsigned long> dropped;
+
+	public:
+		// Several seconds of a busy 500 kbit/s bus
+		static const std::size_t DEFAULT_CAPACITY = 16384;
+
+		FrameRing(std::size_t capacity = DEFAULT_CAPACITY);
+		CanFrame* claim();
+		void publish();
+		void drop();
+		std::size_t read(const CanFrame*& frames);
+		void release(std::size_t count);
+		unsigned long get_dropped();
+};
+
+/* This class parses raw ELM327 monitor output into frames, as it arrives
+* Each line is a frame: the ID in id_digits hex digits, followed by the data bytes, with or
+* without spaces. Every character is looked at once, building the ID and data up in place,
+* and each finished frame is written straight into its ring slot. Lines that aren't frames,
+* such as <DATA ERROR, are counted as errors, and BUFFER FULL, where the adapter couldn't
+* keep up with the bus, as an overflow
+*/
+class FrameParser
+{
+	private:
+		FrameRing& ring;
+		int id_digits;
+
+		// The line being parsed, with the data as one big-endian number, and its last 8 characters
+		uint32_t id;
+		uint64_t payload;
+		int digits;
+		bool invalid;
+		uint64_t tail;
+
+		std::atomic<unsigned long> frames;
+		std::atomic<unsigned long> errors;
+		std::atomic<unsigned long> overflows;
+
+		void end_line(int64_t timestamp_us);
+
+	public:
+		FrameParser(FrameRing& ring, int id_digits);
+		void feed(std::string_view data, int64_t timestamp_us);
+		unsigned long get_frames();
+		unsigned long get_errors();
+		unsigned long get_overflows();
+		static int get_id_digits(int protocol);
+};
+
+/* This class monitors a device's bus on its own thread, publishing every frame to a ring
+* The consumer reads the ring at its own pace, such as to write the frames out
+*/
+class CanMonitor
+{
+	private:
+		ElmDevice& elm_device;
+		std::string filter;
+		FrameRing ring;
+		FrameParser parser;
+		std::thread thread;
+		std::atomic<bool> running;
+		std::atomic<bool> failed;
+
+	public:
+		// A candump log line: (1700000000.123456) elm 18DAF110#0011223344556677
+		static const int MAX_LINE_LENGTH = 64;
+
+		CanMonitor(ElmDevice& elm_device, std::string filter, std::size_t capacity = FrameRing::DEFAULT_CAPACITY);
+		~CanMonitor();
+		void start();
+		void stop();
+		bool is_running();
+		bool has_failed();
+		FrameRing& get_ring();
+		FrameParser& get_parser();
+		int get_id_digits();
+		static int format_frame(const CanFrame& frame, int id_digits, char* line);
+};
+
+#endif
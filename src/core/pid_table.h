@@ -0,0 +1,252 @@
+/* This file contains the table of supported OBDII commands
+* Every command the utility can send is described by a single entry here: its ELM327
+* command string, the number of data bytes returned, the formula used to decode them,
+* and the units and label used to display the result
+* This file is included at the end of command.h and shouldn't be included directly
+*
+* Mode 01 PIDs left out on purpose:
+* 00, 20, 40 and 60 are the supported PID bitmaps, which ElmDevice queries itself
+* 4F packs four unrelated maximums (equivalence ratio, O2 voltage, O2 current and manifold
+* pressure) into one response, and an entry holds a single value
+* 64 and up are mostly multi-sensor records with the same problem
+*
+* Author: Josh McIntyre
+*/
+
+#ifndef PID_TABLE_H
+#define PID_TABLE_H
+
+/* The following functions implement the decoding formulas shared by several PIDs
+* as specified by SAE J1979. A, B, C and D are the data bytes in order
+*/
+
+// A
+constexpr double formula_a(const unsigned char* data) { return data[0]; }
+
+// 256A + B
+constexpr double formula_ab(const unsigned char* data) { return 256.0 * data[0] + data[1]; }
+
+// (100/255)A = percentage
+constexpr double formula_percent(const unsigned char* data) { return 100.0 * data[0] / 255.0; }
+
+// A - 40 = temperature in degrees Celcius
+constexpr double formula_temp(const unsigned char* data) { return data[0] - 40.0; }
+
+// (100/128)A - 100 = fuel trim percentage
+constexpr double formula_trim(const unsigned char* data) { return 100.0 * data[0] / 128.0 - 100.0; }
+
+// A/200 = oxygen sensor voltage
+constexpr double formula_o2_voltage(const unsigned char* data) { return data[0] / 200.0; }
+
+// (2/65536)(256A + B) = air-fuel equivalence ratio (lambda)
+constexpr double formula_lambda(const unsigned char* data) { return 2.0 * formula_ab(data) / 65536.0; }
+
+// (256A + B)/10 - 40 = catalyst temperature in degrees Celcius
+constexpr double formula_cat_temp(const unsigned char* data) { return formula_ab(data) / 10.0 - 40.0; }
+
+// A - 125 = torque percentage
+constexpr double formula_torque(const unsigned char* data) { return data[0] - 125.0; }
+
+// Monitors not yet complete this drive cycle: B bits 4-6 and D bits 0-7 are set while a test is incomplete
+constexpr double formula_incomplete_monitors(const unsigned char* data)
+{
+	int count = 0;
+	for (int bit = 4; bit < 7; bit++)
+	{
+		count += (data[1] >> bit) & 1;
+	}
+	for (int bit = 0; bit < 8; bit++)
+	{
+		count += (data[3] >> bit) & 1;
+	}
+
+	return count;
+}
+
+/* The table of supported commands
+* The trouble code entries (Modes 03, 07 and 0A) come first, then the Mode 01 entries
+* ordered by PID, followed by the Mode 09 vehicle information entries
+* Names are the short item names used on the command line
+*/
+inline constexpr Command::PidInfo PID_TABLE[] = {
+	{ "dtc", "03\r", 0x03, 0x00, 0, Command::TYPE_DTCS, Command::UNIT_NONE, nullptr, "Diagnostic code(s)" },
+	{ "pdtc", "07\r", 0x07, 0x00, 0, Command::TYPE_DTCS, Command::UNIT_NONE, nullptr, "Pending code(s)" },
+	{ "perm", "0A\r", 0x0A, 0x00, 0, Command::TYPE_DTCS, Command::UNIT_NONE, nullptr, "Permanent code(s)" },
+
+	{ "mon", "0101\r", 0x01, 0x01, 4, Command::TYPE_INT, Command::UNIT_NONE,
+		[](const unsigned char* data) { return (double) (data[0] & 0x7F); }, "Stored DTC count" },
+	{ "fss", "0103\r", 0x01, 0x03, 2, Command::TYPE_INT, Command::UNIT_NONE, formula_a, "Fuel system status" },
+	{ "lod", "0104\r", 0x01, 0x04, 1, Command::TYPE_INT, Command::UNIT_PERCENT, formula_percent, "Engine load" },
+	{ "coo", "0105\r", 0x01, 0x05, 1, Command::TYPE_INT, Command::UNIT_CELSIUS, formula_temp, "Coolant temp" },
+	{ "sft1", "0106\r", 0x01, 0x06, 1, Command::TYPE_FLOAT, Command::UNIT_PERCENT, formula_trim, "Short term fuel trim (bank 1)" },
+	{ "lft1", "0107\r", 0x01, 0x07, 1, Command::TYPE_FLOAT, Command::UNIT_PERCENT, formula_trim, "Long term fuel trim (bank 1)" },
+	{ "sft2", "0108\r", 0x01, 0x08, 1, Command::TYPE_FLOAT, Command::UNIT_PERCENT, formula_trim, "Short term fuel trim (bank 2)" },
+	{ "lft2", "0109\r", 0x01, 0x09, 1, Command::TYPE_FLOAT, Command::UNIT_PERCENT, formula_trim, "Long term fuel trim (bank 2)" },
+	{ "frp", "010A\r", 0x01, 0x0A, 1, Command::TYPE_INT, Command::UNIT_KPA,
+		[](const unsigned char* data) { return 3.0 * data[0]; }, "Fuel pressure" },
+	{ "map", "010B\r", 0x01, 0x0B, 1, Command::TYPE_INT, Command::UNIT_KPA, formula_a, "Intake manifold pressure" },
+	{ "rpm", "010C\r", 0x01, 0x0C, 2, Command::TYPE_INT, Command::UNIT_RPM,
+		[](const unsigned char* data) { return formula_ab(data) / 4.0; }, "Engine RPM" },
+	{ "spd", "010D\r", 0x01, 0x0D, 1, Command::TYPE_INT, Command::UNIT_KPH, formula_a, "Vehicle speed" },
+	{ "tim", "010E\r", 0x01, 0x0E, 1, Command::TYPE_FLOAT, Command::UNIT_DEGREES,
+		[](const unsigned char* data) { return data[0] / 2.0 - 64.0; }, "Timing advance" },
+	{ "iat", "010F\r", 0x01, 0x0F, 1, Command::TYPE_INT, Command::UNIT_CELSIUS, formula_temp, "Intake air temp" },
+	{ "maf", "0110\r", 0x01, 0x10, 2, Command::TYPE_FLOAT, Command::UNIT_GRAMS_PER_SEC,
+		[](const unsigned char* data) { return formula_ab(data) / 100.0; }, "MAF air flow rate" },
+	{ "thr", "0111\r", 0x01, 0x11, 1, Command::TYPE_INT, Command::UNIT_PERCENT, formula_percent, "Throttle position" },
+	{ "sas", "0112\r", 0x01, 0x12, 1, Command::TYPE_INT, Command::UNIT_NONE, formula_a, "Secondary air status" },
+	{ "o2p", "0113\r", 0x01, 0x13, 1, Command::TYPE_INT, Command::UNIT_NONE, formula_a, "Oxygen sensors present" },
+	{ "o2v1", "0114\r", 0x01, 0x14, 2, Command::TYPE_FLOAT, Command::UNIT_VOLTS, formula_o2_voltage, "Oxygen sensor 1 voltage" },
+	{ "o2v2", "0115\r", 0x01, 0x15, 2, Command::TYPE_FLOAT, Command::UNIT_VOLTS, formula_o2_voltage, "Oxygen sensor 2 voltage" },
+	{ "o2v3", "0116\r", 0x01, 0x16, 2, Command::TYPE_FLOAT, Command::UNIT_VOLTS, formula_o2_voltage, "Oxygen sensor 3 voltage" },
+	{ "o2v4", "0117\r", 0x01, 0x17, 2, Command::TYPE_FLOAT, Command::UNIT_VOLTS, formula_o2_voltage, "Oxygen sensor 4 voltage" },
+	{ "o2v5", "0118\r", 0x01, 0x18, 2, Command::TYPE_FLOAT, Command::UNIT_VOLTS, formula_o2_voltage, "Oxygen sensor 5 voltage" },
+	{ "o2v6", "0119\r", 0x01, 0x19, 2, Command::TYPE_FLOAT, Command::UNIT_VOLTS, formula_o2_voltage, "Oxygen sensor 6 voltage" },
+	{ "o2v7", "011A\r", 0x01, 0x1A, 2, Command::TYPE_FLOAT, Command::UNIT_VOLTS, formula_o2_voltage, "Oxygen sensor 7 voltage" },
+	{ "o2v8", "011B\r", 0x01, 0x1B, 2, Command::TYPE_FLOAT, Command::UNIT_VOLTS, formula_o2_voltage, "Oxygen sensor 8 voltage" },
+	{ "std", "011C\r", 0x01, 0x1C, 1, Command::TYPE_INT, Command::UNIT_NONE, formula_a, "OBD standard" },
+	{ "o2p4", "011D\r", 0x01, 0x1D, 1, Command::TYPE_INT, Command::UNIT_NONE, formula_a, "Oxygen sensors present (4 banks)" },
+	{ "aux", "011E\r", 0x01, 0x1E, 1, Command::TYPE_INT, Command::UNIT_NONE, formula_a, "Auxiliary input status" },
+	{ "run", "011F\r", 0x01, 0x1F, 2, Command::TYPE_INT, Command::UNIT_SECONDS, formula_ab, "Run time since engine start" },
+	{ "dmil", "0121\r", 0x01, 0x21, 2, Command::TYPE_INT, Command::UNIT_KM, formula_ab, "Distance with MIL on" },
+	{ "frv", "0122\r", 0x01, 0x22, 2, Command::TYPE_FLOAT, Command::UNIT_KPA,
+		[](const unsigned char* data) { return 0.079 * formula_ab(data); }, "Fuel rail pressure (vacuum)" },
+	{ "frg", "0123\r", 0x01, 0x23, 2, Command::TYPE_INT, Command::UNIT_KPA,
+		[](const unsigned char* data) { return 10.0 * formula_ab(data); }, "Fuel rail gauge pressure" },
+	{ "o2l1", "0124\r", 0x01, 0x24, 4, Command::TYPE_FLOAT, Command::UNIT_RATIO, formula_lambda, "Oxygen sensor 1 lambda" },
+	{ "o2l2", "0125\r", 0x01, 0x25, 4, Command::TYPE_FLOAT, Command::UNIT_RATIO, formula_lambda, "Oxygen sensor 2 lambda" },
+	{ "o2l3", "0126\r", 0x01, 0x26, 4, Command::TYPE_FLOAT, Command::UNIT_RATIO, formula_lambda, "Oxygen sensor 3 lambda" },
+	{ "o2l4", "0127\r", 0x01, 0x27, 4, Command::TYPE_FLOAT, Command::UNIT_RATIO, formula_lambda, "Oxygen sensor 4 lambda" },
+	{ "o2l5", "0128\r", 0x01, 0x28, 4, Command::TYPE_FLOAT, Command::UNIT_RATIO, formula_lambda, "Oxygen sensor 5 lambda" },
+	{ "o2l6", "0129\r", 0x01, 0x29, 4, Command::TYPE_FLOAT, Command::UNIT_RATIO, formula_lambda, "Oxygen sensor 6 lambda" },
+	{ "o2l7", "012A\r", 0x01, 0x2A, 4, Command::TYPE_FLOAT, Command::UNIT_RATIO, formula_lambda, "Oxygen sensor 7 lambda" },
+	{ "o2l8", "012B\r", 0x01, 0x2B, 4, Command::TYPE_FLOAT, Command::UNIT_RATIO, formula_lambda, "Oxygen sensor 8 lambda" },
+	{ "egr", "012C\r", 0x01, 0x2C, 1, Command::TYPE_INT, Command::UNIT_PERCENT, formula_percent, "Commanded EGR" },
+	{ "egre", "012D\r", 0x01, 0x2D, 1, Command::TYPE_FLOAT, Command::UNIT_PERCENT, formula_trim, "EGR error" },
+	{ "evp", "012E\r", 0x01, 0x2E, 1, Command::TYPE_INT, Command::UNIT_PERCENT, formula_percent, "Commanded evaporative purge" },
+	{ "fue", "012F\r", 0x01, 0x2F, 1, Command::TYPE_INT, Command::UNIT_PERCENT, formula_percent, "Fuel tank level" },
+	{ "wup", "0130\r", 0x01, 0x30, 1, Command::TYPE_INT, Command::UNIT_NONE, formula_a, "Warm-ups since codes cleared" },
+	{ "dclr", "0131\r", 0x01, 0x31, 2, Command::TYPE_INT, Command::UNIT_KM, formula_ab, "Distance since codes cleared" },
+	{ "evps", "0132\r", 0x01, 0x32, 2, Command::TYPE_FLOAT, Command::UNIT_PA,
+		[](const unsigned char* data) { return (short) ((data[0] << 8) | data[1]) / 4.0; }, "Evap system vapor pressure" },
+	{ "bar", "0133\r", 0x01, 0x33, 1, Command::TYPE_INT, Command::UNIT_KPA, formula_a, "Barometric pressure" },
+	{ "o2c1", "0134\r", 0x01, 0x34, 4, Command::TYPE_FLOAT, Command::UNIT_RATIO, formula_lambda, "Oxygen sensor 1 lambda (current)" },
+	{ "o2c2", "0135\r", 0x01, 0x35, 4, Command::TYPE_FLOAT, Command::UNIT_RATIO, formula_lambda, "Oxygen sensor 2 lambda (current)" },
+	{ "o2c3", "0136\r", 0x01, 0x36, 4, Command::TYPE_FLOAT, Command::UNIT_RATIO, formula_lambda, "Oxygen sensor 3 lambda (current)" },
+	{ "o2c4", "0137\r", 0x01, 0x37, 4, Command::TYPE_FLOAT, Command::UNIT_RATIO, formula_lambda, "Oxygen sensor 4 lambda (current)" },
+	{ "o2c5", "0138\r", 0x01, 0x38, 4, Command::TYPE_FLOAT, Command::UNIT_RATIO, formula_lambda, "Oxygen sensor 5 lambda (current)" },
+	{ "o2c6", "0139\r", 0x01, 0x39, 4, Command::TYPE_FLOAT, Command::UNIT_RATIO, formula_lambda, "Oxygen sensor 6 lambda (current)" },
+	{ "o2c7", "013A\r", 0x01, 0x3A, 4, Command::TYPE_FLOAT, Command::UNIT_RATIO, formula_lambda, "Oxygen sensor 7 lambda (current)" },
+	{ "o2c8", "013B\r", 0x01, 0x3B, 4, Command::TYPE_FLOAT, Command::UNIT_RATIO, formula_lambda, "Oxygen sensor 8 lambda (current)" },
+	{ "cat11", "013C\r", 0x01, 0x3C, 2, Command::TYPE_FLOAT, Command::UNIT_CELSIUS, formula_cat_temp, "Catalyst temp (bank 1, sensor 1)" },
+	{ "cat21", "013D\r", 0x01, 0x3D, 2, Command::TYPE_FLOAT, Command::UNIT_CELSIUS, formula_cat_temp, "Catalyst temp (bank 2, sensor 1)" },
+	{ "cat12", "013E\r", 0x01, 0x3E, 2, Command::TYPE_FLOAT, Command::UNIT_CELSIUS, formula_cat_temp, "Catalyst temp (bank 1, sensor 2)" },
+	{ "cat22", "013F\r", 0x01, 0x3F, 2, Command::TYPE_FLOAT, Command::UNIT_CELSIUS, formula_cat_temp, "Catalyst temp (bank 2, sensor 2)" },
+	{ "mcyc", "0141\r", 0x01, 0x41, 4, Command::TYPE_INT, Command::UNIT_NONE, formula_incomplete_monitors, "Monitors incomplete this drive cycle" },
+	{ "vlt", "0142\r", 0x01, 0x42, 2, Command::TYPE_FLOAT, Command::UNIT_VOLTS,
+		[](const unsigned char* data) { return formula_ab(data) / 1000.0; }, "Control module voltage" },
+	{ "ald", "0143\r", 0x01, 0x43, 2, Command::TYPE_INT, Command::UNIT_PERCENT,
+		[](const unsigned char* data) { return 100.0 * formula_ab(data) / 255.0; }, "Absolute load" },
+	{ "afr", "0144\r", 0x01, 0x44, 2, Command::TYPE_FLOAT, Command::UNIT_RATIO, formula_lambda, "Commanded air-fuel ratio" },
+	{ "rtp", "0145\r", 0x01, 0x45, 1, Command::TYPE_INT, Command::UNIT_PERCENT, formula_percent, "Relative throttle position" },
+	{ "amb", "0146\r", 0x01, 0x46, 1, Command::TYPE_INT, Command::UNIT_CELSIUS, formula_temp, "Ambient air temp" },
+	{ "thb", "0147\r", 0x01, 0x47, 1, Command::TYPE_INT, Command::UNIT_PERCENT, formula_percent, "Absolute throttle position B" },
+	{ "thc", "0148\r", 0x01, 0x48, 1, Command::TYPE_INT, Command::UNIT_PERCENT, formula_percent, "Absolute throttle position C" },
+	{ "ppd", "0149\r", 0x01, 0x49, 1, Command::TYPE_INT, Command::UNIT_PERCENT, formula_percent, "Accelerator pedal position D" },
+	{ "ppe", "014A\r", 0x01, 0x4A, 1, Command::TYPE_INT, Command::UNIT_PERCENT, formula_percent, "Accelerator pedal position E" },
+	{ "ppf", "014B\r", 0x01, 0x4B, 1, Command::TYPE_INT, Command::UNIT_PERCENT, formula_percent, "Accelerator pedal position F" },
+	{ "tac", "014C\r", 0x01, 0x4C, 1, Command::TYPE_INT, Command::UNIT_PERCENT, formula_percent, "Commanded throttle actuator" },
+	{ "tmil", "014D\r", 0x01, 0x4D, 2, Command::TYPE_INT, Command::UNIT_MINUTES, formula_ab, "Time run with MIL on" },
+	{ "tclr", "014E\r", 0x01, 0x4E, 2, Command::TYPE_INT, Command::UNIT_MINUTES, formula_ab, "Time since codes cleared" },
+	{ "mafx", "0150\r", 0x01, 0x50, 4, Command::TYPE_INT, Command::UNIT_GRAMS_PER_SEC,
+		[](const unsigned char* data) { return 10.0 * data[0]; }, "Maximum MAF air flow rate" },
+	{ "fty", "0151\r", 0x01, 0x51, 1, Command::TYPE_INT, Command::UNIT_NONE, formula_a, "Fuel type" },
+	{ "eth", "0152\r", 0x01, 0x52, 1, Command::TYPE_INT, Command::UNIT_PERCENT, formula_percent, "Ethanol fuel percentage" },
+	{ "evpa", "0153\r", 0x01, 0x53, 2, Command::TYPE_FLOAT, Command::UNIT_KPA,
+		[](const unsigned char* data) { return formula_ab(data) / 200.0; }, "Absolute evap system vapor pressure" },
+	{ "evpw", "0154\r", 0x01, 0x54, 2, Command::TYPE_INT, Command::UNIT_PA,
+		[](const unsigned char* data) { return (double) (short) ((data[0] << 8) | data[1]); }, "Evap system vapor pressure (wide)" },
+	{ "sst13", "0155\r", 0x01, 0x55, 2, Command::TYPE_FLOAT, Command::UNIT_PERCENT, formula_trim, "Short term secondary O2 trim (bank 1)" },
+	{ "lst13", "0156\r", 0x01, 0x56, 2, Command::TYPE_FLOAT, Command::UNIT_PERCENT, formula_trim, "Long term secondary O2 trim (bank 1)" },
+	{ "sst24", "0157\r", 0x01, 0x57, 2, Command::TYPE_FLOAT, Command::UNIT_PERCENT, formula_trim, "Short term secondary O2 trim (bank 2)" },
+	{ "lst24", "0158\r", 0x01, 0x58, 2, Command::TYPE_FLOAT, Command::UNIT_PERCENT, formula_trim, "Long term secondary O2 trim (bank 2)" },
+	{ "fra", "0159\r", 0x01, 0x59, 2, Command::TYPE_INT, Command::UNIT_KPA,
+		[](const unsigned char* data) { return 10.0 * formula_ab(data); }, "Fuel rail absolute pressure" },
+	{ "rpp", "015A\r", 0x01, 0x5A, 1, Command::TYPE_INT, Command::UNIT_PERCENT, formula_percent, "Relative accelerator pedal position" },
+	{ "hyb", "015B\r", 0x01, 0x5B, 1, Command::TYPE_INT, Command::UNIT_PERCENT, formula_percent, "Hybrid battery remaining life" },
+	{ "oil", "015C\r", 0x01, 0x5C, 1, Command::TYPE_INT, Command::UNIT_CELSIUS, formula_temp, "Engine oil temp" },
+	{ "inj", "015D\r", 0x01, 0x5D, 2, Command::TYPE_FLOAT, Command::UNIT_DEGREES,
+		[](const unsigned char* data) { return formula_ab(data) / 128.0 - 210.0; }, "Fuel injection timing" },
+	{ "frt", "015E\r", 0x01, 0x5E, 2, Command::TYPE_FLOAT, Command::UNIT_LITERS_PER_HOUR,
+		[](const unsigned char* data) { return formula_ab(data) / 20.0; }, "Engine fuel rate" },
+	{ "emr", "015F\r", 0x01, 0x5F, 1, Command::TYPE_INT, Command::UNIT_NONE, formula_a, "Emission requirements" },
+	{ "dtq", "0161\r", 0x01, 0x61, 1, Command::TYPE_INT, Command::UNIT_PERCENT, formula_torque, "Driver's demand torque" },
+	{ "atq", "0162\r", 0x01, 0x62, 1, Command::TYPE_INT, Command::UNIT_PERCENT, formula_torque, "Actual engine torque" },
+	{ "rtq", "0163\r", 0x01, 0x63, 2, Command::TYPE_INT, Command::UNIT_NEWTON_METERS, formula_ab, "Engine reference torque" },
+
+	{ "vin", "0902\r", 0x09, 0x02, 17, Command::TYPE_TEXT, Command::UNIT_NONE, nullptr, "Vehicle identification number" },
+	{ "cal", "0904\r", 0x09, 0x04, 16, Command::TYPE_TEXT, Command::UNIT_NONE, nullptr, "Calibration ID(s)" }
+};
+
+inline constexpr int PID_TABLE_SIZE = sizeof(PID_TABLE) / sizeof(PID_TABLE[0]);
+
+// This function looks up a command by its short item name, returning INVALID_COMMAND if there is none
+constexpr Command::COMMAND Command::find_command(std::string_view name)
+{
+	for (int i = 0; i < PID_TABLE_SIZE; i++)
+	{
+		if (name == PID_TABLE[i].name)
+		{
+			return i;
+		}
+	}
+
+	return INVALID_COMMAND;
+}
+
+// This function looks up a command by its OBDII mode and PID, returning INVALID_COMMAND if there is none
+constexpr Command::COMMAND Command::find_command(unsigned char mode, unsigned char pid)
+{
+	for (int i = 0; i < PID_TABLE_SIZE; i++)
+	{
+		if (PID_TABLE[i].mode == mode && PID_TABLE[i].pid == pid)
+		{
+			return i;
+		}
+	}
+
+	return INVALID_COMMAND;
+}
+
+// This function returns the table entry for a command
+constexpr const Command::PidInfo& Command::get_info(COMMAND command)
+{
+	return PID_TABLE[command];
+}
+
+// Catch table mistakes at compile time rather than on the road
+constexpr bool check_pid_table()
+{
+	for (int i = 0; i < PID_TABLE_SIZE; i++)
+	{
+		const Command::PidInfo& info = PID_TABLE[i];
+
+		// Every entry must be reachable by name and by mode/PID, so neither can be duplicated
+		if (Command::find_command(info.name) != i || Command::find_command(info.mode, info.pid) != i)
+		{
+			return false;
+		}
+
+		// Mode 01 entries need a formula and must fit in a single batched response
+		if (info.mode == 0x01 && (info.formula == nullptr || info.data_length < 1 || info.data_length > 4))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static_assert(check_pid_table(), "PID_TABLE contains a duplicate or incomplete entry");
+
+#endif
@@ -0,0 +1,738 @@
+/* This file contains code that records decoded samples to a compact binary file
+* and reads them back
+*
+* Author: Josh McIntyre
+*/
+
+#include "recorder.h"
+
+const char Recording::FILE_MAGIC[] = "OBDREC01";
+const char Recording::FOOTER_MAGIC[] = "OBDIDX01";
+
+// This function converts a command to the PID code stored in recordings, such as 0x010C for engine RPM
+uint16_t Recording::get_pid_code(Command::COMMAND cmd)
+{
+	const Command::PidInfo& info = Command::get_info(cmd);
+	return (info.mode << 8) | info.pid;
+}
+
+/* This function returns the size of a block on disk: the block header followed by the
+* timestamp, value, PID code, status and (from version 2) device columns, padded to 8 bytes
+*/
+std::size_t Recording::get_block_size(uint32_t block_capacity, uint32_t version)
+{
+	std::size_t sample_size = sizeof(int64_t) + sizeof(double) + sizeof(uint16_t) + sizeof(uint8_t);
+	if (version >= 2)
+	{
+		sample_size += sizeof(uint8_t);
+	}
+
+	std::size_t size = sizeof(BlockHeader) + block_capacity * sample_size;
+	return (size + 7) & ~((std::size_t) 7);
+}
+
+// This function returns the size of a compressed block on disk: the block header followed by length bytes of samples, padded to 8 bytes
+std::size_t Recording::get_compressed_block_size(uint32_t length)
+{
+	return sizeof(BlockHeader) + ((length + 7) & ~((std::size_t) 7));
+}
+
+// This function checks a block's PID bitmaps for a PID code
+bool Recording::block_has_pid(const uint64_t* pid_bits, uint32_t other_modes, int pid_code)
+{
+	if (pid_code == ANY_PID)
+	{
+		return true;
+	}
+
+	int mode = pid_code >> 8;
+	int pid = pid_code & 0xFF;
+	if (mode == 0x01)
+	{
+		return (pid_bits[pid / 64] >> (pid % 64)) & 1;
+	}
+
+	return (other_modes >> (mode & 0x1F)) & 1;
+}
+
+/* This constructor opens a new recording and writes its header
+* A compressed recording only keeps the block header in block, with the samples in the encoder
+*/
+Recorder::Recorder(std::string path, uint32_t capacity, bool compressed) : compressed(compressed)
+{
+	block_capacity = capacity;
+	block.resize(compressed ? sizeof(BlockHeader) : Recording::get_block_size(block_capacity));
+	block_header() -> magic = Recording::BLOCK_MAGIC;
+
+	file.open(path, std::ios::binary | std::ios::trunc);
+
+	RecordingHeader header;
+	std::memcpy(header.magic, Recording::FILE_MAGIC, sizeof(header.magic));
+	header.version = compressed ? Recording::COMPRESSED_VERSION : Recording::VERSION;
+	header.block_capacity = block_capacity;
+	file.write((const char*) &header, sizeof(header));
+	offset = sizeof(header);
+}
+
+// This destructor writes any pending samples and the footer index
+Recorder::~Recorder()
+{
+	close();
+}
+
+bool Recorder::is_open()
+{
+	return file.is_open() && file.good();
+}
+
+/* This function records a decoded reading
+* Numeric readings become one sample. Trouble code readings become one sample per code,
+* with the raw 2 byte code as the value. Failed readings keep their status with a value of 0
+* Text readings, such as the VIN, have no numeric value and aren't recorded
+*/
+void Recorder::record(int64_t timestamp_us, Command::COMMAND cmd, const Command::Reading& reading, uint8_t device)
+{
+	if (reading.type == Command::TYPE_TEXT)
+	{
+		return;
+	}
+
+	uint16_t pid_code = Recording::get_pid_code(cmd);
+
+	if (reading.status == Command::STATUS_OK && reading.type == Command::TYPE_DTCS)
+	{
+		for (int i = 0; i < reading.dtc_count; i++)
+		{
+			record_sample(timestamp_us, pid_code, reading.dtcs[i], reading.status, device);
+		}
+	}
+	else
+	{
+		double value = (reading.status == Command::STATUS_OK) ? reading.value : 0;
+		record_sample(timestamp_us, pid_code, value, reading.status, device);
+	}
+}
+
+// This function adds a single sample to the current block, writing the block out once it's full
+void Recorder::record_sample(int64_t timestamp_us, uint16_t pid_code, double value, uint8_t status, uint8_t device)
+{
+	if (!file.is_open())
+	{
+		return;
+	}
+
+	BlockHeader* header = block_header();
+	uint32_t i = header -> count;
+
+	if (compressed)
+	{
+		if (i > 0 && timestamp_us - header -> first_timestamp >= Recording::MAX_BLOCK_SPAN_S * 1000000)
+		{
+			write_block();
+			i = 0;
+		}
+
+		if (i == 0)
+		{
+			encoder.reset(timestamp_us);
+		}
+		encoder.add(timestamp_us, pid_code, value, status, device);
+	}
+	else
+	{
+		unsigned char* columns = block.data() + sizeof(BlockHeader);
+		std::memcpy(columns + i * sizeof(int64_t), &timestamp_us, sizeof(int64_t));
+		columns += block_capacity * sizeof(int64_t);
+		std::memcpy(columns + i * sizeof(double), &value, sizeof(double));
+		columns += block_capacity * sizeof(double);
+		std::memcpy(columns + i * sizeof(uint16_t), &pid_code, sizeof(uint16_t));
+		columns += block_capacity * sizeof(uint16_t);
+		columns[i] = status;
+		columns += block_capacity * sizeof(uint8_t);
+		columns[i] = device;
+	}
+
+	if (i == 0)
+	{
+		header -> first_timestamp = timestamp_us;
+	}
+	header -> last_timestamp = std::max(header -> last_timestamp, timestamp_us);
+
+	int mode = pid_code >> 8;
+	int pid = pid_code & 0xFF;
+	if (mode == 0x01)
+	{
+		header -> pid_bits[pid / 64] |= (uint64_t) 1 << (pid % 64);
+	}
+	else
+	{
+		header -> other_modes |= (uint32_t) 1 << (mode & 0x1F);
+	}
+
+	header -> count++;
+	if (header -> count == block_capacity)
+	{
+		write_block();
+	}
+}
+
+/* This function writes any pending samples, followed by the footer index, and closes the file
+* Recording can't continue after it's closed
+*/
+void Recorder::close()
+{
+	if (!file.is_open())
+	{
+		return;
+	}
+
+	if (block_header() -> count > 0)
+	{
+		write_block();
+	}
+
+	uint64_t index_offset = offset;
+	file.write((const char*) index.data(), index.size() * sizeof(IndexEntry));
+
+	RecordingFooter footer;
+	footer.index_offset = index_offset;
+	footer.block_count = index.size();
+	footer.reserved = 0;
+	std::memcpy(footer.magic, Recording::FOOTER_MAGIC, sizeof(footer.magic));
+	file.write((const char*) &footer, sizeof(footer));
+
+	file.close();
+}
+
+BlockHeader* Recorder::block_header()
+{
+	return (BlockHeader*) block.data();
+}
+
+// This function appends the current block to the file, adds it to the index and starts a new one
+void Recorder::write_block()
+{
+	BlockHeader* header = block_header();
+
+	IndexEntry entry;
+	entry.offset = offset;
+	entry.first_timestamp = header -> first_timestamp;
+	entry.last_timestamp = header -> last_timestamp;
+	entry.count = header -> count;
+	entry.other_modes = header -> other_modes;
+	std::memcpy(entry.pid_bits, header -> pid_bits, sizeof(entry.pid_bits));
+	index.push_back(entry);
+
+	if (compressed)
+	{
+		const std::vector<unsigned char>& samples = encoder.get_data();
+		header -> reserved = samples.size();
+		std::size_t block_size = Recording::get_compressed_block_size(samples.size());
+		static const char padding[8] = {};
+
+		file.write((const char*) block.data(), block.size());
+		file.write((const char*) samples.data(), samples.size());
+		file.write(padding, block_size - sizeof(BlockHeader) - samples.size());
+		offset += block_size;
+	}
+	else
+	{
+		file.write((const char*) block.data(), block.size());
+		offset += block.size();
+	}
+
+	std::fill(block.begin(), block.end(), 0);
+	header -> magic = Recording::BLOCK_MAGIC;
+}
+
+/* This constructor opens a recording for reading
+* On Linux the file is memory-mapped, elsewhere it's read into memory
+*/
+RecordingReader::RecordingReader(std::string path)
+{
+	data = nullptr;
+	size = 0;
+	block_capacity = 0;
+	version = 0;
+
+	#ifdef LINUX
+		int fd = open(path.c_str(), O_RDONLY);
+		struct stat file_stat;
+		if (fd >= 0 && fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+		{
+			void* mapped = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapped != MAP_FAILED)
+			{
+				data = (const unsigned char*) mapped;
+				size = file_stat.st_size;
+			}
+		}
+
+		if (fd >= 0)
+		{
+			::close(fd);
+		}
+	#else
+		std::ifstream file(path, std::ios::binary);
+		buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		data = buffer.data();
+		size = buffer.size();
+	#endif
+
+	if (!load_index())
+	{
+		rebuild_index();
+	}
+}
+
+RecordingReader::~RecordingReader()
+{
+	#ifdef LINUX
+		if (data != nullptr)
+		{
+			munmap((void*) data, size);
+		}
+	#endif
+}
+
+// This function checks that the file is a recording
+bool RecordingReader::is_open()
+{
+	return block_capacity > 0;
+}
+
+const std::vector<IndexEntry>& RecordingReader::get_index()
+{
+	return index;
+}
+
+// This function reads the header and the footer index
+bool RecordingReader::load_index()
+{
+	if (data == nullptr || size < sizeof(RecordingHeader))
+	{
+		return false;
+	}
+
+	const RecordingHeader* header = (const RecordingHeader*) data;
+	if (std::memcmp(header -> magic, Recording::FILE_MAGIC, sizeof(header -> magic)) != 0 || header -> block_capacity == 0)
+	{
+		return false;
+	}
+
+	block_capacity = header -> block_capacity;
+	version = header -> version;
+
+	if (size < sizeof(RecordingHeader) + sizeof(RecordingFooter))
+	{
+		return false;
+	}
+
+	const RecordingFooter* footer = (const RecordingFooter*) (data + size - sizeof(RecordingFooter));
+	if (std::memcmp(footer -> magic, Recording::FOOTER_MAGIC, sizeof(footer -> magic)) != 0
+		|| footer -> index_offset > size || footer -> block_count > size / sizeof(IndexEntry)
+		|| footer -> index_offset + footer -> block_count * sizeof(IndexEntry) + sizeof(RecordingFooter) != size)
+	{
+		return false;
+	}
+
+	/* Every entry must point at a whole block before the index, since scan() trusts them
+	* A footer that doesn't hold up is ignored, so the blocks are walked instead
+	*/
+	const IndexEntry* entries = (const IndexEntry*) (data + footer -> index_offset);
+	std::size_t block_size = (version >= Recording::COMPRESSED_VERSION) ? sizeof(BlockHeader) : Recording::get_block_size(block_capacity, version);
+	for (uint64_t i = 0; i < footer -> block_count; i++)
+	{
+		if (entries[i].offset < sizeof(RecordingHeader) || entries[i].offset > footer -> index_offset
+			|| entries[i].offset + block_size > footer -> index_offset || entries[i].count > block_capacity)
+		{
+			return false;
+		}
+	}
+
+	index.assign(entries, entries + footer -> block_count);
+
+	return true;
+}
+
+/* This function rebuilds the index of a recording that has no footer, such as one cut short
+* by a power loss, by walking the blocks from the start of the file. Compressed blocks are
+* found from the length in each block header
+*/
+void RecordingReader::rebuild_index()
+{
+	index.clear();
+	if (block_capacity == 0)
+	{
+		return;
+	}
+
+	std::size_t block_size = Recording::get_block_size(block_capacity, version);
+	for (std::size_t offset = sizeof(RecordingHeader); offset + sizeof(BlockHeader) <= size; offset += block_size)
+	{
+		const BlockHeader* header = (const BlockHeader*) (data + offset);
+		if (version >= Recording::COMPRESSED_VERSION)
+		{
+			block_size = Recording::get_compressed_block_size(header -> reserved);
+		}
+
+		if (header -> magic != Recording::BLOCK_MAGIC || header -> count > block_capacity || offset + block_size > size)
+		{
+			break;
+		}
+
+		IndexEntry entry;
+		entry.offset = offset;
+		entry.first_timestamp = header -> first_timestamp;
+		entry.last_timestamp = header -> last_timestamp;
+		entry.count = header -> count;
+		entry.other_modes = header -> other_modes;
+		std::memcpy(entry.pid_bits, header -> pid_bits, sizeof(entry.pid_bits));
+		index.push_back(entry);
+	}
+}
+
+/* This function calls the handler for every sample with a timestamp in [start_us, end_us]
+* and a matching PID code, in recorded order. Blocks outside the range, or without the
+* PID, are skipped using the index
+* Samples in version 1 recordings, which have no device column, come from device 0
+*/
+void RecordingReader::scan(int64_t start_us, int64_t end_us, int pid_code, SampleHandler handler)
+{
+	for (const IndexEntry& entry : index)
+	{
+		if (entry.last_timestamp < start_us || entry.first_timestamp > end_us
+			|| !Recording::block_has_pid(entry.pid_bits, entry.other_modes, pid_code))
+		{
+			continue;
+		}
+
+		if (version >= Recording::COMPRESSED_VERSION)
+		{
+			scan_compressed(entry, start_us, end_us, pid_code, handler);
+			continue;
+		}
+
+		const unsigned char* columns = data + entry.offset + sizeof(BlockHeader);
+		const unsigned char* values = columns + block_capacity * sizeof(int64_t);
+		const unsigned char* pid_codes = values + block_capacity * sizeof(double);
+		const unsigned char* statuses = pid_codes + block_capacity * sizeof(uint16_t);
+		const unsigned char* devices = (version >= 2) ? statuses + block_capacity * sizeof(uint8_t) : nullptr;
+
+		for (uint32_t i = 0; i < entry.count; i++)
+		{
+			int64_t timestamp_us;
+			uint16_t sample_pid_code;
+			std::memcpy(&timestamp_us, columns + i * sizeof(int64_t), sizeof(int64_t));
+			std::memcpy(&sample_pid_code, pid_codes + i * sizeof(uint16_t), sizeof(uint16_t));
+
+			if (timestamp_us < start_us || timestamp_us > end_us || (pid_code != Recording::ANY_PID && sample_pid_code != pid_code))
+			{
+				continue;
+			}
+
+			double value;
+			std::memcpy(&value, values + i * sizeof(double), sizeof(double));
+			handler(timestamp_us, (devices != nullptr) ? devices[i] : 0, sample_pid_code, value, statuses[i]);
+		}
+	}
+}
+
+// This function calls the handler for every matching sample in a compressed block, decoding the whole block
+void RecordingReader::scan_compressed(const IndexEntry& entry, int64_t start_us, int64_t end_us, int pid_code, SampleHandler handler)
+{
+	const BlockHeader* header = (const BlockHeader*) (data + entry.offset);
+	if (entry.offset + Recording::get_compressed_block_size(header -> reserved) > size)
+	{
+		return;
+	}
+
+	BlockDecoder decoder(data + entry.offset + sizeof(BlockHeader), header -> reserved, header -> first_timestamp);
+	int64_t timestamp_us;
+	uint8_t device;
+	uint16_t sample_pid_code;
+	double value;
+	uint8_t status;
+	for (uint32_t i = 0; i < entry.count && decoder.next(timestamp_us, device, sample_pid_code, value, status); i++)
+	{
+		if (timestamp_us < start_us || timestamp_us > end_us || (pid_code != Recording::ANY_PID && sample_pid_code != pid_code))
+		{
+			continue;
+		}
+
+		handler(timestamp_us, device, sample_pid_code, value, status);
+	}
+}
+
+BlockEncoder::BlockEncoder()
+{
+	reset(0);
+}
+
+// This function starts a new block, whose first sample is at first_timestamp
+void BlockEncoder::reset(int64_t first_timestamp)
+{
+	data.clear();
+	streams.clear();
+	last_timestamp = first_timestamp;
+	last_delta = 0;
+}
+
+// This function encodes a sample. See the class description for the format
+void BlockEncoder::add(int64_t timestamp_us, uint16_t pid_code, double value, uint8_t status, uint8_t device)
+{
+	int stream = 0;
+	while (stream < (int) streams.size() && (streams[stream].pid_code != pid_code || streams[stream].device != device))
+	{
+		stream++;
+	}
+
+	// A new stream starts from a value of 0 in the first scale, with no status
+	bool new_stream = (stream == (int) streams.size());
+	if (new_stream)
+	{
+		streams.push_back({ pid_code, device, 0xFF, 0, 0, 0 });
+	}
+	Stream& last = streams[stream];
+
+	int64_t delta = timestamp_us - last_timestamp;
+	int timestamp_kind = (delta == 0) ? TIMESTAMP_SAME : ((delta == last_delta) ? TIMESTAMP_SAME_DELTA : TIMESTAMP_DELTA);
+
+	int64_t scaled = 0;
+	int scale = last.scale;
+	int value_kind = VALUE_RAW;
+	if (status == last.status && std::memcmp(&value, &last.value, sizeof(double)) == 0)
+	{
+		value_kind = VALUE_REPEAT;
+	}
+	else if (status == Command::STATUS_OK && last.status == Command::STATUS_OK && get_scaled(value, last.scale, scaled))
+	{
+		value_kind = VALUE_DELTA;
+	}
+	else if (status == Command::STATUS_OK)
+	{
+		for (scale = 0; scale < SCALE_COUNT; scale++)
+		{
+			if (get_scaled(value, scale, scaled))
+			{
+				value_kind = VALUE_SCALED;
+				break;
+			}
+		}
+	}
+
+	data.push_back((std::min(stream, DIRECT_STREAMS) << 4) | (value_kind << 2) | timestamp_kind);
+	if (stream >= DIRECT_STREAMS)
+	{
+		put_varint(stream);
+	}
+	if (new_stream)
+	{
+		data.push_back(pid_code & 0xFF);
+		data.push_back(pid_code >> 8);
+		data.push_back(device);
+	}
+
+	if (timestamp_kind == TIMESTAMP_DELTA)
+	{
+		put_varint(zigzag(delta - last_delta));
+	}
+	if (delta != 0)
+	{
+		last_delta = delta;
+	}
+	last_timestamp = timestamp_us;
+
+	if (value_kind == VALUE_DELTA)
+	{
+		put_varint(zigzag(scaled - last.scaled));
+	}
+	else if (value_kind == VALUE_SCALED)
+	{
+		data.push_back(scale);
+		put_varint(zigzag(scaled));
+	}
+	else if (value_kind == VALUE_RAW)
+	{
+		data.push_back(status);
+		unsigned char raw[sizeof(double)];
+		std::memcpy(raw, &value, sizeof(double));
+		data.insert(data.end(), raw, raw + sizeof(double));
+	}
+
+	if (value_kind == VALUE_DELTA || value_kind == VALUE_SCALED)
+	{
+		last.scale = scale;
+		last.scaled = scaled;
+	}
+	last.value = value;
+	last.status = status;
+}
+
+const std::vector<unsigned char>& BlockEncoder::get_data()
+{
+	return data;
+}
+
+// This function appends a number 7 bits at a time, low bits first, with the top bit set on all but the last byte
+void BlockEncoder::put_varint(uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		data.push_back((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	data.push_back(value);
+}
+
+// This function maps signed numbers to unsigned ones, small magnitudes first: 0, -1, 1, -2 to 0, 1, 2, 3
+uint64_t BlockEncoder::zigzag(int64_t value)
+{
+	return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+int64_t BlockEncoder::unzigzag(uint64_t value)
+{
+	return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+// This function works out a value from its integer form in a scale, the same way as the decoding formulas do
+double BlockEncoder::unscale(int64_t scaled, int scale)
+{
+	return (double) scaled * SCALES[scale][0] / SCALES[scale][1];
+}
+
+// This function finds the integer form of a value in a scale, if there's one that gives back exactly the same value
+bool BlockEncoder::get_scaled(double value, int scale, int64_t& scaled)
+{
+	double estimate = std::round(value * SCALES[scale][1] / SCALES[scale][0]);
+	if (!(std::fabs(estimate) < 9007199254740992.0))
+	{
+		return false;
+	}
+
+	scaled = (int64_t) estimate;
+	double decoded = unscale(scaled, scale);
+	return std::memcmp(&decoded, &value, sizeof(double)) == 0;
+}
+
+BlockDecoder::BlockDecoder(const unsigned char* data, std::size_t length, int64_t first_timestamp) : data(data), end(data + length)
+{
+	last_timestamp = first_timestamp;
+	last_delta = 0;
+}
+
+/* This function decodes the next sample, mirroring BlockEncoder::add()
+* It returns false at the end of the block, or if the block is corrupt
+*/
+bool BlockDecoder::next(int64_t& timestamp_us, uint8_t& device, uint16_t& pid_code, double& value, uint8_t& status)
+{
+	if (data >= end)
+	{
+		return false;
+	}
+
+	unsigned char tag = *data++;
+	uint64_t stream = tag >> 4;
+	int value_kind = (tag >> 2) & 3;
+	int timestamp_kind = tag & 3;
+
+	if (stream == BlockEncoder::DIRECT_STREAMS && !get_varint(stream))
+	{
+		return false;
+	}
+	if (stream == streams.size())
+	{
+		if (end - data < 3)
+		{
+			return false;
+		}
+		streams.push_back({ (uint16_t) (data[0] | (data[1] << 8)), data[2], 0xFF, 0, 0, 0 });
+		data += 3;
+	}
+	else if (stream > streams.size())
+	{
+		return false;
+	}
+	BlockEncoder::Stream& last = streams[stream];
+
+	int64_t delta = 0;
+	uint64_t encoded;
+	if (timestamp_kind == BlockEncoder::TIMESTAMP_SAME_DELTA)
+	{
+		delta = last_delta;
+	}
+	else if (timestamp_kind == BlockEncoder::TIMESTAMP_DELTA)
+	{
+		if (!get_varint(encoded))
+		{
+			return false;
+		}
+		delta = last_delta + BlockEncoder::unzigzag(encoded);
+	}
+	if (delta != 0)
+	{
+		last_delta = delta;
+	}
+	last_timestamp += delta;
+
+	if (value_kind == BlockEncoder::VALUE_DELTA)
+	{
+		if (!get_varint(encoded))
+		{
+			return false;
+		}
+		last.scaled += BlockEncoder::unzigzag(encoded);
+		last.value = BlockEncoder::unscale(last.scaled, last.scale);
+		last.status = Command::STATUS_OK;
+	}
+	else if (value_kind == BlockEncoder::VALUE_SCALED)
+	{
+		if (data >= end || *data >= BlockEncoder::SCALE_COUNT)
+		{
+			return false;
+		}
+		last.scale = *data++;
+		if (!get_varint(encoded))
+		{
+			return false;
+		}
+		last.scaled = BlockEncoder::unzigzag(encoded);
+		last.value = BlockEncoder::unscale(last.scaled, last.scale);
+		last.status = Command::STATUS_OK;
+	}
+	else if (value_kind == BlockEncoder::VALUE_RAW)
+	{
+		if (end - data < 1 + (std::ptrdiff_t) sizeof(double))
+		{
+			return false;
+		}
+		last.status = *data++;
+		std::memcpy(&last.value, data, sizeof(double));
+		data += sizeof(double);
+	}
+
+	timestamp_us = last_timestamp;
+	device = last.device;
+	pid_code = last.pid_code;
+	value = last.value;
+	status = last.status;
+
+	return true;
+}
+
+bool BlockDecoder::get_varint(uint64_t& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64 && data < end; shift += 7)
+	{
+		unsigned char byte = *data++;
+		value |= (uint64_t) (byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
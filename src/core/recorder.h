@@ -0,0 +1,239 @@
+/* This file contains function declarations and includes for the binary sample recorder
+*
+* Author: Josh McIntyre
+*/
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <functional>
+#include <cmath>
+
+#ifdef LINUX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "command.h"
+
+/* A recording is a header, a sequence of fixed-size blocks and a footer index
+* Each block holds up to block_capacity samples in columns: timestamps (int64 microseconds
+* since the epoch), values (double), PID codes (uint16, mode << 8 | PID), statuses (uint8)
+* and, from version 2, the number of the device the sample came from (uint8)
+* Every block has the same size, so the blocks can be found without the footer if a
+* recording was cut short. All fields are little-endian
+*
+* Version 3 recordings are compressed. Each block holds a header followed by the encoded
+* samples, whose length is in the header's reserved field, padded to 8 bytes. Blocks are
+* written once they hold block_capacity samples or span MAX_BLOCK_SPAN_S seconds, and each
+* one is a keyframe that can be decoded on its own. See BlockEncoder for the encoding
+*/
+struct RecordingHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t block_capacity;
+};
+
+/* Block headers and index entries carry the time range of the block and a bitmap of
+* the Mode 01 PIDs in it, plus a bitmap of any other modes, so scans can skip blocks
+*/
+struct BlockHeader
+{
+	uint32_t magic;
+	uint32_t count;
+	int64_t first_timestamp;
+	int64_t last_timestamp;
+	uint64_t pid_bits[4];
+	uint32_t other_modes;
+	uint32_t reserved;
+};
+
+struct IndexEntry
+{
+	uint64_t offset;
+	int64_t first_timestamp;
+	int64_t last_timestamp;
+	uint32_t count;
+	uint32_t other_modes;
+	uint64_t pid_bits[4];
+};
+
+struct RecordingFooter
+{
+	uint64_t index_offset;
+	uint32_t block_count;
+	uint32_t reserved;
+	char magic[8];
+};
+
+static_assert(sizeof(RecordingHeader) == 16, "RecordingHeader must be packed");
+static_assert(sizeof(BlockHeader) == 64, "BlockHeader must be packed");
+static_assert(sizeof(IndexEntry) == 64, "IndexEntry must be packed");
+static_assert(sizeof(RecordingFooter) == 24, "RecordingFooter must be packed");
+
+// This class holds the constants and helpers shared by the recording writer and reader
+class Recording
+{
+	public:
+		static const char FILE_MAGIC[];
+		static const char FOOTER_MAGIC[];
+		static const uint32_t BLOCK_MAGIC = 0x4B4C4230;
+		static const uint32_t VERSION = 2;
+		static const uint32_t COMPRESSED_VERSION = 3;
+
+		// 4096 samples make a block of about 76 KB, so SD card writes stay large and infrequent
+		static const uint32_t DEFAULT_BLOCK_CAPACITY = 4096;
+
+		// Compressed blocks are cut at this span, so a reader can seek to within a minute and a power cut loses at most that
+		static const int64_t MAX_BLOCK_SPAN_S = 60;
+
+		// Matches samples of any PID in a scan
+		static const int ANY_PID = -1;
+
+		static uint16_t get_pid_code(Command::COMMAND cmd);
+		static std::size_t get_block_size(uint32_t block_capacity, uint32_t version = VERSION);
+		static std::size_t get_compressed_block_size(uint32_t length);
+		static bool block_has_pid(const uint64_t* pid_bits, uint32_t other_modes, int pid_code);
+};
+
+/* This class encodes the samples of a compressed block, one at a time
+* Each sample is a tag byte, optionally followed by the stream, the timestamp and the value:
+*   bits 0-1: the timestamp is the same as the last sample's (0), or the last change in
+*             timestamp is repeated (1), or a zigzag varint of the difference follows (2)
+*   bits 2-3: the value and status are the same as the stream's last (0), or a zigzag varint
+*             of the change in the value's integer form follows (1), or a new scale follows,
+*             as a byte, with a zigzag varint of the integer form (2), or the status byte and
+*             the raw double follow (3)
+*   bits 4-7: the stream, or 15 for a varint stream number after the tag. The first sample of
+*             each new stream is followed by its PID code (2 bytes) and device (1 byte)
+* A stream is the samples of one PID from one device. Values are kept as integers n where
+* value = n * numerator / denominator for one of SCALES, which covers most OBDII formulas
+* exactly, so a slowly changing value costs a byte or two, and an unchanged one only its tag
+*/
+class BlockEncoder
+{
+	public:
+		// Exact scales for values, as numerator and denominator
+		static constexpr double SCALES[][2] = { { 1, 1 }, { 1, 4 }, { 1, 10 }, { 1, 100 }, { 1, 200 },
+			{ 1, 1000 }, { 100, 255 }, { 100, 128 }, { 2, 65536 } };
+		static constexpr int SCALE_COUNT = sizeof(SCALES) / sizeof(SCALES[0]);
+
+		static constexpr int DIRECT_STREAMS = 15;
+
+		enum TIMESTAMP { TIMESTAMP_SAME, TIMESTAMP_SAME_DELTA, TIMESTAMP_DELTA };
+		enum VALUE { VALUE_REPEAT, VALUE_DELTA, VALUE_SCALED, VALUE_RAW };
+
+		// The last sample of a stream, as the encoder and decoder both track it
+		struct Stream
+		{
+			uint16_t pid_code;
+			uint8_t device;
+			uint8_t status;
+			double value;
+			int scale;
+			int64_t scaled;
+		};
+
+	private:
+		std::vector<unsigned char> data;
+		std::vector<Stream> streams;
+		int64_t last_timestamp;
+		int64_t last_delta;
+
+		void put_varint(uint64_t value);
+		static bool get_scaled(double value, int scale, int64_t& scaled);
+
+	public:
+		BlockEncoder();
+		void reset(int64_t first_timestamp);
+		void add(int64_t timestamp_us, uint16_t pid_code, double value, uint8_t status, uint8_t device);
+		const std::vector<unsigned char>& get_data();
+		static uint64_t zigzag(int64_t value);
+		static int64_t unzigzag(uint64_t value);
+		static double unscale(int64_t scaled, int scale);
+};
+
+// This class decodes the samples of a compressed block in order
+class BlockDecoder
+{
+	private:
+		const unsigned char* data;
+		const unsigned char* end;
+		std::vector<BlockEncoder::Stream> streams;
+		int64_t last_timestamp;
+		int64_t last_delta;
+
+		bool get_varint(uint64_t& value);
+
+	public:
+		BlockDecoder(const unsigned char* data, std::size_t length, int64_t first_timestamp);
+		bool next(int64_t& timestamp_us, uint8_t& device, uint16_t& pid_code, double& value, uint8_t& status);
+};
+
+/* This class appends decoded samples to a recording
+* Samples are collected in an in-memory block and written one full block at a time;
+* nothing is flushed per sample. The footer index is written by close()
+* Compressed recordings are encoded as the samples arrive, into a much smaller block
+* Samples from several devices can share a recording, tagged with their device number
+*/
+class Recorder
+{
+	private:
+		std::ofstream file;
+		uint32_t block_capacity;
+		bool compressed;
+		std::vector<unsigned char> block;
+		BlockEncoder encoder;
+		std::vector<IndexEntry> index;
+		uint64_t offset;
+
+		BlockHeader* block_header();
+		void write_block();
+
+	public:
+		Recorder(std::string path, uint32_t capacity = Recording::DEFAULT_BLOCK_CAPACITY, bool compressed = false);
+		~Recorder();
+		bool is_open();
+		void record(int64_t timestamp_us, Command::COMMAND cmd, const Command::Reading& reading, uint8_t device = 0);
+		void record_sample(int64_t timestamp_us, uint16_t pid_code, double value, uint8_t status, uint8_t device = 0);
+		void close();
+};
+
+/* This class reads a recording, memory-mapping it where the platform allows
+* Scans visit the samples in a time range, optionally for a single PID, using the index
+* to skip blocks that can't contain matches
+*/
+class RecordingReader
+{
+	public:
+		typedef std::function<void(int64_t timestamp_us, uint8_t device, uint16_t pid_code, double value, uint8_t status)> SampleHandler;
+
+	private:
+		const unsigned char* data;
+		std::size_t size;
+		std::vector<unsigned char> buffer;
+		std::vector<IndexEntry> index;
+		uint32_t block_capacity;
+		uint32_t version;
+
+		bool load_index();
+		void rebuild_index();
+		void scan_compressed(const IndexEntry& entry, int64_t start_us, int64_t end_us, int pid_code, SampleHandler handler);
+
+	public:
+		RecordingReader(std::string path);
+		~RecordingReader();
+		bool is_open();
+		const std::vector<IndexEntry>& get_index();
+		void scan(int64_t start_us, int64_t end_us, int pid_code, SampleHandler handler);
+};
+
+#endif
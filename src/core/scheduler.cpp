@@ -0,0 +1,180 @@
+/* This file contains code that schedules polling of OBDII items at individual rates
+*
+* Author: Josh McIntyre
+*/
+
+#include "scheduler.h"
+
+/* This function adds an item to the schedule
+* A rate or priority of 0 or less selects the item's default from default_rates
+* New items are due immediately
+*/
+void PollScheduler::add_item(Command::COMMAND cmd, double rate_hz, int priority)
+{
+	double default_rate_hz = DEFAULT_RATE_HZ;
+	int default_priority = 0;
+	for (const DefaultRate& rate : default_rates)
+	{
+		if (std::string_view(rate.name) == Command::get_info(cmd).name)
+		{
+			default_rate_hz = rate.rate_hz;
+			default_priority = rate.priority;
+		}
+	}
+
+	ScheduledItem item;
+	item.cmd = cmd;
+	item.rate_hz = (rate_hz > 0) ? rate_hz : default_rate_hz;
+	item.priority = (priority >= 0) ? priority : default_priority;
+	item.next_deadline = std::chrono::steady_clock::now();
+	item.reading = Command::make_reading(Command::STATUS_NO_DATA, cmd);
+	item.samples = 0;
+	item.missed_deadlines = 0;
+	item.achieved_hz = 0;
+
+	items.push_back(item);
+}
+
+// This function returns when the next item is due
+std::chrono::steady_clock::time_point PollScheduler::get_next_deadline()
+{
+	std::chrono::steady_clock::time_point earliest = std::chrono::steady_clock::time_point::max();
+	for (const ScheduledItem& item : items)
+	{
+		earliest = std::min(earliest, item.next_deadline);
+	}
+
+	return earliest;
+}
+
+// This function returns the commands for a batch of items
+std::vector<Command::COMMAND> PollScheduler::get_commands(const std::vector<int>& batch)
+{
+	std::vector<Command::COMMAND> cmds;
+	for (int index : batch)
+	{
+		cmds.push_back(items[index].cmd);
+	}
+
+	return cmds;
+}
+
+/* This function stores the readings fetched for a batch of items, in the same order as the batch
+* Acquisition and Fleet call it from their fetch handlers, after fetching the batch from select_batch()
+*/
+void PollScheduler::complete_batch(const std::vector<int>& batch, const std::vector<Command::Reading>& readings, std::chrono::steady_clock::time_point now)
+{
+	for (std::vector<int>::size_type i = 0; i < batch.size(); i++)
+	{
+		record_sample(items[batch[i]], readings[i], now);
+	}
+}
+
+/* This function picks the items to fetch in the next cycle
+* Due items are taken in order of priority, then deadline, up to a full batch of Mode 01 items
+* Free slots are filled with Mode 01 items due within half a period, earliest deadline first
+* Other commands, such as trouble codes, can't be batched and are fetched whenever they're due
+*/
+std::vector<int> PollScheduler::select_batch(std::chrono::steady_clock::time_point now)
+{
+	std::vector<int> due;
+	std::vector<int> upcoming;
+	for (int i = 0; i < (int) items.size(); i++)
+	{
+		std::chrono::duration<double> period(1.0 / items[i].rate_hz);
+		if (items[i].next_deadline <= now)
+		{
+			due.push_back(i);
+		}
+		else if (Command::is_batchable(items[i].cmd) && items[i].next_deadline - now <= period / 2)
+		{
+			upcoming.push_back(i);
+		}
+	}
+
+	std::sort(due.begin(), due.end(), [this](int a, int b)
+	{
+		if (items[a].priority != items[b].priority)
+		{
+			return items[a].priority > items[b].priority;
+		}
+
+		return items[a].next_deadline < items[b].next_deadline;
+	});
+
+	std::sort(upcoming.begin(), upcoming.end(), [this](int a, int b)
+	{
+		return items[a].next_deadline < items[b].next_deadline;
+	});
+
+	std::vector<int> batch;
+	int batched = 0;
+	for (int index : due)
+	{
+		if (!Command::is_batchable(items[index].cmd))
+		{
+			batch.push_back(index);
+		}
+		else if (batched < Command::MAX_BATCH_SIZE)
+		{
+			batch.push_back(index);
+			batched++;
+		}
+	}
+
+	for (int index : upcoming)
+	{
+		if (batched == Command::MAX_BATCH_SIZE)
+		{
+			break;
+		}
+
+		batch.push_back(index);
+		batched++;
+	}
+
+	return batch;
+}
+
+/* This function stores a new sample for an item and schedules its next fetch
+* Items that fall more than a full period behind count a missed deadline and are
+* rescheduled from now, instead of trying to catch up with a burst of fetches
+*/
+void PollScheduler::record_sample(ScheduledItem &item, Command::Reading reading, std::chrono::steady_clock::time_point now)
+{
+	std::chrono::steady_clock::duration period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(1.0 / item.rate_hz));
+
+	if (item.samples > 0)
+	{
+		// Smooth the achieved rate, so a single slow round-trip doesn't flag an item
+		double interval = std::chrono::duration<double>(now - item.last_sample).count();
+		double instant_hz = (interval > 0) ? 1.0 / interval : item.rate_hz;
+		item.achieved_hz = (item.samples == 1) ? instant_hz : 0.8 * item.achieved_hz + 0.2 * instant_hz;
+	}
+
+	item.reading = reading;
+	item.samples++;
+	item.last_sample = now;
+
+	if (now > item.next_deadline + period)
+	{
+		item.missed_deadlines++;
+		item.next_deadline = now + period;
+	}
+	else
+	{
+		item.next_deadline += period;
+	}
+}
+
+const std::vector<ScheduledItem>& PollScheduler::get_items()
+{
+	return items;
+}
+
+// This function checks whether an item is falling short of its target rate
+bool PollScheduler::is_behind(const ScheduledItem& item)
+{
+	return item.samples >= 2 && item.achieved_hz < item.rate_hz * BEHIND_THRESHOLD;
+}
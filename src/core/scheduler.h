@@ -0,0 +1,84 @@
+/* This file contains function declarations and includes for the polling scheduler
+*
+* Author: Josh McIntyre
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include "elm_device.h"
+
+/* This struct holds the schedule and latest result for one polled item
+* Rates are in samples per second
+*/
+struct ScheduledItem
+{
+	Command::COMMAND cmd;
+	double rate_hz;
+	int priority;
+	std::chrono::steady_clock::time_point next_deadline;
+
+	Command::Reading reading;
+	long samples;
+	long missed_deadlines;
+	double achieved_hz;
+	std::chrono::steady_clock::time_point last_sample;
+};
+
+// This struct holds the default rate and priority for an item
+struct DefaultRate
+{
+	const char* name;
+	double rate_hz;
+	int priority;
+};
+
+/* Fast-moving signals are polled often and win when the link is overloaded,
+* while slow ones such as coolant temp and trouble codes barely change
+* Items that aren't listed use DEFAULT_RATE_HZ and priority 0
+*/
+constexpr DefaultRate default_rates[] = {
+	{ "rpm", 20.0, 3 },
+	{ "thr", 20.0, 3 },
+	{ "spd", 5.0, 2 },
+	{ "maf", 5.0, 2 },
+	{ "lod", 5.0, 1 },
+	{ "coo", 0.2, 0 },
+	{ "dtc", 1.0 / 60.0, 0 },
+	{ "pdtc", 1.0 / 60.0, 0 },
+	{ "perm", 1.0 / 60.0, 0 }
+};
+
+/* This class polls a set of items, each at its own target rate
+* Items are kept in an earliest-deadline-first order. Every cycle, the due items with the
+* highest priority are fetched together, and any free slots in the batch are filled with
+* items that are due soon, so each serial round-trip carries as many PIDs as possible
+*/
+class PollScheduler
+{
+	private:
+		std::vector<ScheduledItem> items;
+
+		void record_sample(ScheduledItem &item, Command::Reading reading, std::chrono::steady_clock::time_point now);
+
+	public:
+		// Rate used for items without a default or requested rate
+		static constexpr double DEFAULT_RATE_HZ = 1.0;
+
+		// An item is behind when it achieves less than this fraction of its target rate
+		static constexpr double BEHIND_THRESHOLD = 0.9;
+
+		void add_item(Command::COMMAND cmd, double rate_hz = 0, int priority = -1);
+		std::chrono::steady_clock::time_point get_next_deadline();
+		std::vector<int> select_batch(std::chrono::steady_clock::time_point now);
+		std::vector<Command::COMMAND> get_commands(const std::vector<int>& batch);
+		void complete_batch(const std::vector<int>& batch, const std::vector<Command::Reading>& readings, std::chrono::steady_clock::time_point now);
+		const std::vector<ScheduledItem>& get_items();
+		static bool is_behind(const ScheduledItem& item);
+};
+
+#endif
@@ -6,58 +6,495 @@
 
 #include "serial.h"
 
-// This constructor initializes the OS-dependent serial connection
-SerialConnection::SerialConnection(std::string port)
+// This constructor initializes the OS-dependent serial connection, with its own io_service
+SerialConnection::SerialConnection(std::string port, long baud)
+	: own_io(new boost::asio::io_service()), io(*own_io), strand(io), read_buffer(MAX_RESPONSE_SIZE)
+{
+	init_connection(port, baud);
+}
+
+/* This constructor initializes the OS-dependent serial connection on a shared io_service
+* The io_service must be run by other threads, since the blocking calls only wait for it
+*/
+SerialConnection::SerialConnection(boost::asio::io_service& shared_io, std::string port, long baud)
+	: io(shared_io), strand(io), read_buffer(MAX_RESPONSE_SIZE)
+{
+	init_connection(port, baud);
+}
+
+void SerialConnection::init_connection(std::string port, long baud)
 {
 	serial_port = new boost::asio::serial_port(io);
-	connect_asio_port(port.c_str());
+	deadline = new boost::asio::steady_timer(io);
+	busy = false;
+	timed_out = false;
+	resync_needed = false;
+	streaming = false;
+	request_id = 0;
+	capture = nullptr;
+	command_start_us = 0;
+	write_start_us = 0;
+	timing = ExchangeTiming{ 0, 0, 0 };
+	last_timing = timing;
+
+	baud_rate = baud;
+
+	connect_asio_port(port.c_str(), baud);
 }
 
 // This function closes the connection to the serial port
 SerialConnection::~SerialConnection()
 {
 	serial_port -> close();
+	delete capture;
+	delete deadline;
 	delete serial_port;
 }
 
-/* This function fetches the response to a command via the Windows serial port connection
+/* This function fetches the response to a command via the serial port connection
 * It takes a standard \r (carriage return) terminated, standard OBDII code.
 * It returns the raw ASCII response. Any processing of the response into useful data will be performed separately.
+* If the ELM327 doesn't finish responding before the deadline, an empty string is returned
+* The response normally ends at the prompt, but a different delimiter can be given for
+* exchanges such as baud rate negotiation, where the ELM327 sends a line without one
+* On a shared io_service, this must not be called from the threads running it
 */
-std::string SerialConnection::fetch_response(std::string command, unsigned long expected_response_size)
+std::string SerialConnection::fetch_response(std::string command, long timeout_ms, char delimiter)
 {
-	// First, send the command to the ELM327
-	unsigned long bytes_sent_total = command.length();
-	boost::asio::write(*serial_port, boost::asio::buffer(command.c_str(), bytes_sent_total));
+	std::shared_ptr<std::promise<std::string> > response(new std::promise<std::string>());
+	async_fetch_response(command, timeout_ms, [response](const boost::system::error_code& error, std::string data)
+	{
+		response -> set_value(error ? std::string() : data);
+	}, delimiter);
+	run();
+
+	return response -> get_future().get();
+}
 
-	char buffer[100];
-	memset(buffer, 0, sizeof(buffer));
-	
-	// Read the response
-	int return_count = 0;
-	for (int i = 0; i < 100; i++)
+/* This function queues a command to be sent to the ELM327 and returns immediately
+* The handler is called from run() with the raw response, or with an error such as
+* boost::asio::error::timed_out if the deadline passed first
+* Commands are sent one at a time in the order they were queued
+*/
+void SerialConnection::async_fetch_response(std::string command, long timeout_ms, ResponseHandler handler, char delimiter)
+{
+	PendingCommand pending = { command, timeout_ms, handler, delimiter, nullptr, nullptr };
+	boost::asio::post(strand, [this, pending]()
 	{
-		char buffer_char;
-		boost::asio::read(*serial_port, boost::asio::buffer(&buffer_char, 1));
-		buffer[i] = buffer_char;
+		pending_commands.push_back(pending);
+		if (!busy)
+		{
+			start_next();
+		}
+	});
+}
 
-		if (buffer_char == '>')
+/* This function queues a command and returns a future for the raw response
+* The future is only fulfilled while the io_service is running, such as during run()
+*/
+std::future<std::string> SerialConnection::fetch_response_future(std::string command, long timeout_ms, char delimiter)
+{
+	std::shared_ptr<std::promise<std::string> > promise(new std::promise<std::string>());
+	async_fetch_response(command, timeout_ms, [promise](const boost::system::error_code& error, std::string data)
+	{
+		if (error)
+		{
+			promise -> set_exception(std::make_exception_ptr(boost::system::system_error(error)));
+		}
+		else
 		{
-			break;
+			promise -> set_value(data);
 		}
+	}, delimiter);
+
+	return promise -> get_future();
+}
+
+/* This function queues a command whose output streams until it's stopped, such as AT MA
+* Each chunk of output is passed to the stream handler as it's read, without waiting for a
+* line or the prompt. The command ends when the device prompts, either by itself, such as
+* when the ELM327's buffer fills, or after stop_stream(), and then the handler is called
+* If stopped is already set by the time the command's turn comes, it isn't sent, and the
+* handler is called with boost::asio::error::operation_aborted. Setting it before calling
+* stop_stream() means a stop can't be missed while the command is still queued
+*/
+void SerialConnection::async_stream(std::string command, StreamHandler stream, ResponseHandler handler, const std::atomic<bool>& stopped)
+{
+	PendingCommand pending = { command, DEFAULT_TIMEOUT_MS, handler, PROMPT, stream, &stopped };
+	boost::asio::post(strand, [this, pending]()
+	{
+		pending_commands.push_back(pending);
+		if (!busy)
+		{
+			start_next();
+		}
+	});
+}
+
+/* This function stops the streaming command in progress, and returns immediately
+* Any character interrupts the ELM327, which then prompts. If it doesn't prompt before the
+* command's deadline, the stream ends with a timeout and the link is resynchronized
+*/
+void SerialConnection::stop_stream()
+{
+	boost::asio::post(strand, [this]()
+	{
+		if (!streaming)
+		{
+			return;
+		}
+
+		streaming = false;
+		unsigned long id = request_id;
+		deadline -> expires_after(std::chrono::milliseconds(pending_commands.front().timeout_ms));
+		deadline -> async_wait(boost::asio::bind_executor(strand, [this, id](const boost::system::error_code& error)
+		{
+			if (!error && id == request_id && busy)
+			{
+				timed_out = true;
+				serial_port -> cancel();
+			}
+		}));
+
+		static const char interrupt[] = "\r";
+		boost::asio::async_write(*serial_port, boost::asio::buffer(interrupt, sizeof(interrupt) - 1),
+			boost::asio::bind_executor(strand, [](const boost::system::error_code&, std::size_t)
+		{
+			// A failed write shows up as an error on the read in progress
+		}));
+	});
+}
+
+/* This function runs a function on the connection's strand, after anything already queued there,
+* and returns immediately. State shared with the response handlers can then be used without locks,
+* even on a shared io_service run by many threads
+*/
+void SerialConnection::post(std::function<void()> function)
+{
+	boost::asio::post(strand, function);
+}
+
+/* This function runs queued commands until all of them have completed
+* A shared io_service is already being run by other threads, so there's nothing to do
+*/
+void SerialConnection::run()
+{
+	if (own_io)
+	{
+		io.restart();
+		io.run();
+	}
+}
+
+/* This function starts teeing every command and its raw response into a capture file
+* It returns false if the file can't be opened
+*/
+bool SerialConnection::start_capture(std::string path)
+{
+	delete capture;
+	capture = new CaptureWriter(path);
+	if (!capture -> is_open())
+	{
+		delete capture;
+		capture = nullptr;
+		return false;
+	}
+
+	return true;
+}
+
+/* This function changes the baud rate of the port, such as after the ELM327 has been told to switch
+* The link is treated as in sync, since the caller is in the middle of a handshake with the device
+* It returns false if the port doesn't support the rate
+*/
+bool SerialConnection::set_baud_rate(long baud)
+{
+	try
+	{
+		serial_port -> set_option(boost::asio::serial_port_base::baud_rate(baud));
 	}
-	
-	return std::string(buffer);
+	catch (boost::system::system_error&)
+	{
+		return false;
+	}
+
+	baud_rate = baud;
+	resync_needed = false;
+
+	return true;
+}
+
+long SerialConnection::get_baud_rate()
+{
+	return baud_rate;
+}
+
+/* This function returns the timings of the last exchange to finish
+* Called from a response handler, it's the exchange the handler is for
+*/
+const ExchangeTiming& SerialConnection::get_last_timing()
+{
+	return last_timing;
+}
+
+/* This function starts the next queued command
+* If the previous command timed out, the ELM327 may still be busy or about to send a late
+* response, so the link is resynchronized first
+*/
+void SerialConnection::start_next()
+{
+	if (pending_commands.empty())
+	{
+		busy = false;
+		return;
+	}
+
+	busy = true;
+	command_start_us = Capture::now_us();
+	if (resync_needed)
+	{
+		start_resync();
+	}
+	else
+	{
+		start_command();
+	}
+}
+
+/* This function interrupts whatever the ELM327 is doing and discards everything up to its next prompt
+* Any character sent while the chip is busy aborts the current command
+*/
+void SerialConnection::start_resync()
+{
+	read_buffer.consume(read_buffer.size());
+
+	static const char interrupt[] = "\r";
+	boost::asio::async_write(*serial_port, boost::asio::buffer(interrupt, sizeof(interrupt) - 1),
+		boost::asio::bind_executor(strand, [this](const boost::system::error_code& error, std::size_t)
+	{
+		if (error)
+		{
+			finish_command(error, std::string());
+			return;
+		}
+
+		start_read(PROMPT, [this](const boost::system::error_code& error, std::size_t)
+		{
+			if (error)
+			{
+				finish_command(error, std::string());
+				return;
+			}
+
+			read_buffer.consume(read_buffer.size());
+			resync_needed = false;
+			start_command();
+		});
+	}));
+}
+
+// This function writes the command at the front of the queue and reads its response
+void SerialConnection::start_command()
+{
+	if (pending_commands.front().stopped != nullptr && *pending_commands.front().stopped)
+	{
+		finish_command(boost::asio::error::operation_aborted, std::string());
+		return;
+	}
+
+	const std::string& command = pending_commands.front().command;
+	write_start_us = Capture::now_us();
+	timing = ExchangeTiming{ 0, 0, 0 };
+	boost::asio::async_write(*serial_port, boost::asio::buffer(command.c_str(), command.length()),
+		boost::asio::bind_executor(strand, [this](const boost::system::error_code& error, std::size_t)
+	{
+		if (error)
+		{
+			finish_command(error, std::string());
+			return;
+		}
+
+		timing.write_us = Capture::now_us() - write_start_us;
+
+		if (pending_commands.front().stream)
+		{
+			streaming = true;
+			timed_out = false;
+			++request_id;
+			read_stream();
+			return;
+		}
+
+		start_read(pending_commands.front().delimiter, [this](const boost::system::error_code& error, std::size_t bytes_read)
+		{
+			if (error)
+			{
+				finish_command(error, std::string());
+				return;
+			}
+
+			// Copy the response out of the reusable buffer, up to and including the prompt
+			boost::asio::streambuf::const_buffers_type data = read_buffer.data();
+			std::string response(boost::asio::buffers_begin(data), boost::asio::buffers_begin(data) + bytes_read);
+			read_buffer.consume(bytes_read);
+
+			finish_command(error, response);
+		});
+	}));
+}
+
+/* This function reads into the reusable buffer until the delimiter, normally the ELM327's > prompt, arrives
+* The read is cancelled if the current command's deadline passes first
+*/
+void SerialConnection::start_read(char delimiter, std::function<void(const boost::system::error_code&, std::size_t)> handler)
+{
+	unsigned long id = ++request_id;
+	timed_out = false;
+
+	deadline -> expires_after(std::chrono::milliseconds(pending_commands.front().timeout_ms));
+	deadline -> async_wait(boost::asio::bind_executor(strand, [this, id](const boost::system::error_code& error)
+	{
+		// Ignore deadlines for reads that have already completed
+		if (!error && id == request_id && busy)
+		{
+			timed_out = true;
+			serial_port -> cancel();
+		}
+	}));
+
+	if (read_buffer.size() > 0)
+	{
+		timing.first_byte_us = Capture::now_us() - write_start_us;
+	}
+
+	read_until(delimiter, handler, 0);
+}
+
+/* This function reads a chunk at a time until the delimiter is in the buffer
+* It works like async_read_until, but also notes when the first byte arrives, so the time
+* the vehicle takes to answer can be told apart from the time the adapter takes to finish
+*/
+void SerialConnection::read_until(char delimiter, std::function<void(const boost::system::error_code&, std::size_t)> handler, std::size_t searched)
+{
+	std::string_view buffered(static_cast<const char*>(read_buffer.data().data()), read_buffer.size());
+	std::string_view::size_type found = buffered.find(delimiter, searched);
+	if (found != std::string_view::npos)
+	{
+		deadline -> cancel();
+		timing.prompt_us = Capture::now_us() - write_start_us;
+		handler(boost::system::error_code(), found + 1);
+		return;
+	}
+
+	if (read_buffer.size() >= read_buffer.max_size())
+	{
+		deadline -> cancel();
+		handler(boost::asio::error::not_found, 0);
+		return;
+	}
+
+	std::size_t chunk_size = std::min(READ_CHUNK_SIZE, read_buffer.max_size() - read_buffer.size());
+	serial_port -> async_read_some(read_buffer.prepare(chunk_size),
+		boost::asio::bind_executor(strand, [this, delimiter, handler](const boost::system::error_code& error, std::size_t bytes_read)
+	{
+		std::size_t searched = read_buffer.size();
+		read_buffer.commit(bytes_read);
+		if (bytes_read > 0 && searched == 0)
+		{
+			timing.first_byte_us = Capture::now_us() - write_start_us;
+		}
+
+		if (error)
+		{
+			deadline -> cancel();
+			if (error == boost::asio::error::operation_aborted && timed_out)
+			{
+				handler(boost::asio::error::timed_out, 0);
+			}
+			else
+			{
+				handler(error, 0);
+			}
+			return;
+		}
+
+		read_until(delimiter, handler, searched);
+	}));
+}
+
+/* This function reads the output of a streaming command until the prompt
+* Every chunk is handed to the stream handler straight from the read buffer, and the buffer
+* is then reused for the next chunk. There's no deadline until the stream is stopped
+*/
+void SerialConnection::read_stream()
+{
+	serial_port -> async_read_some(read_buffer.prepare(STREAM_CHUNK_SIZE),
+		boost::asio::bind_executor(strand, [this](const boost::system::error_code& error, std::size_t bytes_read)
+	{
+		read_buffer.commit(bytes_read);
+		std::string_view chunk(static_cast<const char*>(read_buffer.data().data()), read_buffer.size());
+		std::string_view::size_type prompt = chunk.find(PROMPT);
+
+		if (timing.first_byte_us == 0 && bytes_read > 0)
+		{
+			timing.first_byte_us = Capture::now_us() - write_start_us;
+		}
+
+		pending_commands.front().stream(chunk.substr(0, prompt));
+		read_buffer.consume(read_buffer.size());
+
+		if (prompt != std::string_view::npos)
+		{
+			streaming = false;
+			deadline -> cancel();
+			timing.prompt_us = Capture::now_us() - write_start_us;
+			finish_command(boost::system::error_code(), std::string());
+			return;
+		}
+
+		if (error)
+		{
+			streaming = false;
+			deadline -> cancel();
+			finish_command((error == boost::asio::error::operation_aborted && timed_out) ? boost::asio::error::timed_out : error, std::string());
+			return;
+		}
+
+		read_stream();
+	}));
+}
+
+// This function completes the command at the front of the queue and starts the next one
+void SerialConnection::finish_command(const boost::system::error_code& error, std::string response)
+{
+	if (error)
+	{
+		resync_needed = true;
+	}
+
+	PendingCommand finished = pending_commands.front();
+	pending_commands.pop_front();
+	++request_id;
+	last_timing = timing;
+
+	if (capture != nullptr)
+	{
+		CaptureRecord record = { command_start_us, Capture::now_us() - command_start_us, finished.command, response };
+		capture -> write(record);
+	}
+
+	finished.handler(error, response);
+	start_next();
 }
 
 // This function establishes a connection to the serial port hosting the OBDII reader
-void SerialConnection::connect_asio_port(const char* port)
+void SerialConnection::connect_asio_port(const char* port, long baud)
 {
 	try
 	{
 		serial_port -> open(port);
 		
-		serial_port -> set_option(boost::asio::serial_port_base::baud_rate(38400));
+		serial_port -> set_option(boost::asio::serial_port_base::baud_rate(baud));
 		serial_port -> set_option(boost::asio::serial_port_base::character_size(8));
 		
 		boost::asio::serial_port_base::parity parity(boost::asio::serial_port_base::parity::none);
@@ -66,9 +503,9 @@ void SerialConnection::connect_asio_port(const char* port)
 		serial_port -> set_option(parity);
 		serial_port -> set_option(stop_bits);
 	}
-	catch (int e)
+	catch (boost::system::system_error& e)
 	{
-		std::cout << "Unable to access OBDII device via serial port\n";
+		std::cout << "Unable to access OBDII device via serial port " << port << ": " << e.what() << "\n";
 		exit(1);
 	}
 }	
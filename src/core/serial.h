@@ -3,32 +3,130 @@
 *Author: Josh McIntyre
 */
 
+#ifndef SERIAL_H
+#define SERIAL_H
+
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <atomic>
+#include <utility>
 #include <boost/asio/serial_port.hpp>
 #include <boost/asio.hpp>
+
+#include "capture.h"
+#include "stats.h"
 	
 
 /* This class will abstract away the serial connection details away
 * from classes/functions that need to communicate to the ELM327 OBDII device 
 * via a serial connection.
+* A connection either runs its own io_service, driven by the blocking calls, or shares one
+* with other connections, driven by a pool of threads. Each connection's handlers run
+* on its own strand, so a shared io_service can be run from any number of threads
 */
 class SerialConnection
 {
+	public:
+		// Completion handler for asynchronous commands, called with the raw ASCII response
+		typedef std::function<void(const boost::system::error_code&, std::string)> ResponseHandler;
+
+		/* Handler for the output of a streaming command, called with each chunk as it's read
+		* The chunk points into the read buffer, so it's only valid during the call
+		*/
+		typedef std::function<void(std::string_view)> StreamHandler;
+
+		// Default deadline for a single command, long enough to cover the ELM327's protocol search
+		static const long DEFAULT_TIMEOUT_MS = 5000;
+
+		// Baud rate the ELM327 uses after power-on, unless it's been reprogrammed
+		static const long DEFAULT_BAUD_RATE = 38400;
+
+		// The ELM327 ends every response with a prompt
+		static const char PROMPT = '>';
+
+		// Upper bound on a single response, so a device that never sends a prompt can't exhaust memory
+		static const std::size_t MAX_RESPONSE_SIZE = 65536;
+
+		// Most responses fit in a single read of this size
+		static constexpr std::size_t READ_CHUNK_SIZE = 256;
+
+		// Streaming commands, such as monitoring the bus, read in larger chunks to keep up with it
+		static constexpr std::size_t STREAM_CHUNK_SIZE = 4096;
+
 	private:
-		boost::asio::io_service io;
+		// A command waiting for its turn on the serial link
+		struct PendingCommand
+		{
+			std::string command;
+			long timeout_ms;
+			ResponseHandler handler;
+			char delimiter;
+
+			// Set for streaming commands, which run until stopped or the device prompts
+			StreamHandler stream;
+			const std::atomic<bool>* stopped;
+		};
+
+		std::unique_ptr<boost::asio::io_service> own_io;
+		boost::asio::io_service& io;
+		boost::asio::io_service::strand strand;
 		boost::asio::serial_port* serial_port;
+		boost::asio::steady_timer* deadline;
+		boost::asio::streambuf read_buffer;
+		long baud_rate;
+
+		std::deque<PendingCommand> pending_commands;
+		bool busy;
+		bool timed_out;
+		bool resync_needed;
+		bool streaming;
+		unsigned long request_id;
+
+		// Transcript of every exchange, when capturing is enabled
+		CaptureWriter* capture;
+		int64_t command_start_us;
+
+		// Phases of the exchange in progress, and of the last one to finish
+		int64_t write_start_us;
+		ExchangeTiming timing;
+		ExchangeTiming last_timing;
 	
 	/* The following functions are designed to provide a common API for serial code across operating systems
 	* When the code is compiled, regardless of OS, the other code in this program should be able to call
 	* these public functions
 	*/
 	public:
-		SerialConnection(std::string port);
+		SerialConnection(std::string port, long baud = DEFAULT_BAUD_RATE);
+		SerialConnection(boost::asio::io_service& shared_io, std::string port, long baud = DEFAULT_BAUD_RATE);
 		~SerialConnection();
-		std::string fetch_response(std::string command, unsigned long expected_response_size);
+		std::string fetch_response(std::string command, long timeout_ms = DEFAULT_TIMEOUT_MS, char delimiter = PROMPT);
+		void async_fetch_response(std::string command, long timeout_ms, ResponseHandler handler, char delimiter = PROMPT);
+		std::future<std::string> fetch_response_future(std::string command, long timeout_ms = DEFAULT_TIMEOUT_MS, char delimiter = PROMPT);
+		void async_stream(std::string command, StreamHandler stream, ResponseHandler handler, const std::atomic<bool>& stopped);
+		void stop_stream();
+		void post(std::function<void()> function);
+		void run();
+		bool start_capture(std::string path);
+		bool set_baud_rate(long baud);
+		long get_baud_rate();
+		const ExchangeTiming& get_last_timing();
 
 	private:
-		void connect_asio_port(const char* port_name);
+		void init_connection(std::string port, long baud);
+		void connect_asio_port(const char* port_name, long baud);
+		void start_next();
+		void start_resync();
+		void start_command();
+		void start_read(char delimiter, std::function<void(const boost::system::error_code&, std::size_t)> handler);
+		void read_until(char delimiter, std::function<void(const boost::system::error_code&, std::size_t)> handler, std::size_t searched);
+		void read_stream();
+		void finish_command(const boost::system::error_code& error, std::string response);
 };
 
-
+#endif
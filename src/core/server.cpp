@@ -0,0 +1,372 @@
+/* This file contains code that shares one ELM327 adapter with several local clients
+*
+* Author: Josh McIntyre
+*/
+
+#include "server.h"
+
+#ifdef LINUX
+
+/* This constructor connects to and initializes the device
+* The io_service thread is started first, since device setup waits on responses delivered
+* through it. Clients aren't accepted until start()
+*/
+ObdServer::ObdServer(std::string port, long baud, std::string cache_path, std::string socket_path, long max_age_ms)
+	: socket_path(socket_path), acceptor(io), max_age_ms(max_age_ms)
+{
+	listening = false;
+	fetching = false;
+	stats = {};
+
+	work.reset(new boost::asio::io_service::work(io));
+	thread = std::thread([this]()
+	{
+		io.run();
+	});
+
+	elm_device.reset(new ElmDevice(io, port, baud, cache_path));
+}
+
+// This destructor stops serving before the device is freed
+ObdServer::~ObdServer()
+{
+	stop();
+}
+
+// This function captures the device's raw exchanges. It must be called before start()
+bool ObdServer::start_capture(std::string path)
+{
+	return elm_device -> start_capture(path);
+}
+
+/* This function starts accepting clients on the socket and returns immediately
+* A socket left behind by a server that didn't stop cleanly is replaced, but one that a
+* running server still answers on isn't, and neither is anything at the path that isn't a
+* socket. It returns false if the socket can't be set up
+*/
+bool ObdServer::start()
+{
+	boost::asio::local::stream_protocol::endpoint endpoint(socket_path);
+	boost::system::error_code error;
+
+	boost::asio::local::stream_protocol::socket probe(io);
+	probe.connect(endpoint, error);
+	if (!error)
+	{
+		std::cout << "Another obdcmd is already serving on " << socket_path << "\n";
+		return false;
+	}
+
+	struct stat status;
+	if (lstat(socket_path.c_str(), &status) == 0)
+	{
+		if (!S_ISSOCK(status.st_mode))
+		{
+			std::cout << socket_path << " already exists and isn't a socket, so it was left alone\n";
+			return false;
+		}
+		std::remove(socket_path.c_str());
+	}
+
+	acceptor.open(endpoint.protocol(), error);
+	if (!error)
+	{
+		acceptor.bind(endpoint, error);
+	}
+	if (!error)
+	{
+		acceptor.listen(boost::asio::socket_base::max_connections, error);
+	}
+	if (error)
+	{
+		boost::system::error_code ignored;
+		acceptor.close(ignored);
+		return false;
+	}
+
+	listening = true;
+	io.post([this]()
+	{
+		accept();
+	});
+
+	return true;
+}
+
+ElmDevice& ObdServer::get_device()
+{
+	return *elm_device;
+}
+
+// This function returns how requests were served. Call it once stopped, since the counts belong to the io_service thread
+ServerStats ObdServer::get_stats()
+{
+	return stats;
+}
+
+/* This function disconnects every client and waits for the io_service thread to finish
+* A fetch already on the wire is allowed to complete first, so the adapter is left at its prompt
+*/
+void ObdServer::stop()
+{
+	if (!thread.joinable())
+	{
+		return;
+	}
+
+	io.post([this]()
+	{
+		boost::system::error_code ignored;
+		acceptor.close(ignored);
+		for (std::weak_ptr<Session>& session : sessions)
+		{
+			std::shared_ptr<Session> connected = session.lock();
+			if (connected)
+			{
+				connected -> socket.close(ignored);
+			}
+		}
+	});
+
+	work.reset();
+	thread.join();
+
+	if (listening)
+	{
+		std::remove(socket_path.c_str());
+	}
+}
+
+// This function waits for the next client, keeping track of it so it can be disconnected on stop()
+void ObdServer::accept()
+{
+	std::shared_ptr<Session> session(new Session(io));
+	acceptor.async_accept(session -> socket, [this, session](const boost::system::error_code& error)
+	{
+		if (error)
+		{
+			return;
+		}
+
+		stats.clients++;
+		sessions.erase(std::remove_if(sessions.begin(), sessions.end(), [](const std::weak_ptr<Session>& previous)
+		{
+			return previous.expired();
+		}), sessions.end());
+		sessions.push_back(session);
+
+		read_request(session);
+		accept();
+	});
+}
+
+// This function reads a client's next request line. The client is dropped if it disconnects or sends too long a line
+void ObdServer::read_request(std::shared_ptr<Session> session)
+{
+	boost::asio::async_read_until(session -> socket, session -> buffer, '\n', [this, session](const boost::system::error_code& error, std::size_t length)
+	{
+		if (error)
+		{
+			return;
+		}
+
+		std::string line(boost::asio::buffers_begin(session -> buffer.data()), boost::asio::buffers_begin(session -> buffer.data()) + length - 1);
+		session -> buffer.consume(length);
+		handle_request(session, line);
+	});
+}
+
+/* This function answers each item of a request from the cache, if it was read recently enough,
+* or waits for it on the bus. An item that's already waiting for the bus is shared, rather than
+* being asked for twice, and new items are queued for the next fetch
+*/
+void ObdServer::handle_request(std::shared_ptr<Session> session, std::string line)
+{
+	if (!line.empty() && line.back() == '\r')
+	{
+		line.pop_back();
+	}
+
+	std::string items = line;
+	long max_age = max_age_ms;
+	std::string::size_type space = line.find(' ');
+	if (space != std::string::npos)
+	{
+		items = line.substr(0, space);
+		max_age = std::atol(line.substr(space + 1).c_str());
+	}
+
+	std::shared_ptr<ClientRequest> request(new ClientRequest());
+	request -> session = session;
+	std::stringstream ss(items);
+	std::string name;
+	while (std::getline(ss, name, ','))
+	{
+		request -> names.push_back(name);
+	}
+
+	if (request -> names.empty())
+	{
+		read_request(session);
+		return;
+	}
+
+	request -> readings.resize(request -> names.size());
+	request -> remaining = request -> names.size();
+	stats.requests++;
+	stats.items += request -> names.size();
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	for (int i = 0; i < (int) request -> names.size(); i++)
+	{
+		Command::COMMAND cmd = Command::find_command(request -> names[i]);
+		if (cmd == Command::INVALID_COMMAND)
+		{
+			TimedReading invalid = {};
+			invalid.reading.status = Command::STATUS_INVALID;
+			complete_item(request, i, invalid);
+			continue;
+		}
+
+		std::map<Command::COMMAND, TimedReading>::iterator cached = cache.find(cmd);
+		if (cached != cache.end() && now - cached -> second.read_at <= std::chrono::milliseconds(max_age))
+		{
+			stats.cached++;
+			complete_item(request, i, cached -> second);
+			continue;
+		}
+
+		if (waiters.count(cmd) > 0)
+		{
+			stats.coalesced++;
+		}
+		else
+		{
+			queued.push_back(cmd);
+		}
+		waiters[cmd].push_back(std::make_pair(request, i));
+	}
+
+	fetch_queued();
+}
+
+/* This function fetches every queued item in one batch, unless a fetch is already on the wire
+* Items queued meanwhile go out together when it completes. The device splits the batch into
+* as few adapter requests as it can
+*/
+void ObdServer::fetch_queued()
+{
+	if (fetching || queued.empty())
+	{
+		return;
+	}
+
+	fetching = true;
+	std::vector<Command::COMMAND> batch;
+	batch.swap(queued);
+	stats.fetches++;
+	stats.fetched += batch.size();
+
+	elm_device -> async_get_data_batch(batch, [this, batch](std::vector<Command::Reading> readings)
+	{
+		TimedReading timed;
+		timed.timestamp_us = Capture::now_us();
+		timed.read_at = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < (int) batch.size(); i++)
+		{
+			timed.reading = readings[i];
+			cache[batch[i]] = timed;
+
+			std::vector<std::pair<std::shared_ptr<ClientRequest>, int> > waiting;
+			waiting.swap(waiters[batch[i]]);
+			waiters.erase(batch[i]);
+			for (std::pair<std::shared_ptr<ClientRequest>, int>& waiter : waiting)
+			{
+				complete_item(waiter.first, waiter.second, timed);
+			}
+		}
+
+		fetching = false;
+		fetch_queued();
+	});
+}
+
+// This function fills in one item of a request, answering the client once they're all in
+void ObdServer::complete_item(std::shared_ptr<ClientRequest> request, int index, const TimedReading& reading)
+{
+	request -> readings[index] = reading;
+	if (--request -> remaining == 0)
+	{
+		send_answer(request);
+	}
+}
+
+// This function writes the answer to a request, a line per item, then waits for the client's next request
+void ObdServer::send_answer(std::shared_ptr<ClientRequest> request)
+{
+	std::shared_ptr<Session> session = request -> session;
+	session -> answer.clear();
+	for (int i = 0; i < (int) request -> names.size(); i++)
+	{
+		const TimedReading& timed = request -> readings[i];
+		session -> answer += request -> names[i] + "\t" + format_status(timed.reading.status) + "\t"
+			+ (timed.reading.status == Command::STATUS_OK ? format_value(timed.reading) : "") + "\t"
+			+ std::to_string(timed.timestamp_us) + "\n";
+	}
+
+	boost::asio::async_write(session -> socket, boost::asio::buffer(session -> answer), [this, session](const boost::system::error_code& error, std::size_t)
+	{
+		if (!error)
+		{
+			read_request(session);
+		}
+	});
+}
+
+/* This function formats a reading's value for an answer
+* Numbers are given in full, without units, and trouble codes as a comma separated list
+*/
+std::string ObdServer::format_value(const Command::Reading& reading)
+{
+	std::stringstream ss;
+	if (reading.type == Command::TYPE_DTCS)
+	{
+		for (int i = 0; i < reading.dtc_count; i++)
+		{
+			char dtc[6];
+			Command::format_dtc(reading.dtcs[i], dtc);
+			ss << (i > 0 ? "," : "") << dtc;
+		}
+	}
+	else if (reading.type == Command::TYPE_TEXT)
+	{
+		ss << reading.text;
+	}
+	else
+	{
+		ss << std::setprecision(10) << reading.value;
+	}
+
+	return ss.str();
+}
+
+std::string ObdServer::format_status(Command::STATUS status)
+{
+	switch (status)
+	{
+		case Command::STATUS_OK:
+			return "OK";
+
+		case Command::STATUS_NO_DATA:
+			return std::string(Command::RET_NO_DATA);
+
+		case Command::STATUS_TIMEOUT:
+			return std::string(Command::RET_TIMEOUT);
+
+		default:
+			return std::string(Command::RET_INVALID);
+	}
+}
+
+#endif
@@ -0,0 +1,130 @@
+/* This file contains function declarations and includes for sharing one device with local clients
+*
+* Author: Josh McIntyre
+*/
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <iomanip>
+#include <utility>
+#include <boost/asio.hpp>
+
+#include "elm_device.h"
+#include "capture.h"
+
+// Clients connect over a Unix domain socket, so serving is Linux only
+#ifdef LINUX
+#include <sys/stat.h>
+
+/* Clients connect to the server's Unix domain socket and send one request per line:
+* <item>[,<item>...][ <max age in ms>]
+* such as "rpm,spd 50". The server answers each request with a line per item, in order:
+* <item>\t<OK | NO DATA | TIMEOUT | INVALID>\t<value>\t<timestamp_us>
+* The value is a number, a comma separated list of trouble codes, or text, such as the VIN.
+* The timestamp is when the value was read from the vehicle, in microseconds since the epoch
+* A client sends its next request once it has the whole answer to the last one
+*/
+
+// This struct holds counts of how requests were served, to show how much bus traffic was saved
+struct ServerStats
+{
+	unsigned long clients;
+	unsigned long requests;
+	unsigned long items;
+	unsigned long cached;
+	unsigned long coalesced;
+	unsigned long fetched;
+	unsigned long fetches;
+};
+
+/* This class owns a device and serves its readings to any number of local clients
+* Everything runs on a single io_service thread, so no locks are needed. An item read
+* recently enough is answered from the cache. Otherwise it waits for the bus: an item that's
+* already queued or on the wire is shared with the clients waiting on it, and everything
+* queued while the adapter is busy goes out together in the next batch
+*/
+class ObdServer
+{
+	public:
+		// Values up to this old are served from the cache, unless a request asks for fresher ones
+		static constexpr long DEFAULT_MAX_AGE_MS = 100;
+
+		// Longer request lines are refused, and the client disconnected
+		static constexpr std::size_t MAX_REQUEST_LENGTH = 1024;
+
+	private:
+		// A reading with the times it was taken, for the cache and the answers
+		struct TimedReading
+		{
+			Command::Reading reading;
+			int64_t timestamp_us;
+			std::chrono::steady_clock::time_point read_at;
+		};
+
+		struct Session
+		{
+			boost::asio::local::stream_protocol::socket socket;
+			boost::asio::streambuf buffer;
+			std::string answer;
+
+			Session(boost::asio::io_service& io) : socket(io), buffer(MAX_REQUEST_LENGTH) {}
+		};
+
+		// A client's request, answered once every item has a reading
+		struct ClientRequest
+		{
+			std::shared_ptr<Session> session;
+			std::vector<std::string> names;
+			std::vector<TimedReading> readings;
+			int remaining;
+		};
+
+		boost::asio::io_service io;
+		std::unique_ptr<boost::asio::io_service::work> work;
+		std::thread thread;
+		std::unique_ptr<ElmDevice> elm_device;
+		std::string socket_path;
+		boost::asio::local::stream_protocol::acceptor acceptor;
+		std::vector<std::weak_ptr<Session> > sessions;
+		long max_age_ms;
+		bool listening;
+
+		std::map<Command::COMMAND, TimedReading> cache;
+		std::map<Command::COMMAND, std::vector<std::pair<std::shared_ptr<ClientRequest>, int> > > waiters;
+		std::vector<Command::COMMAND> queued;
+		bool fetching;
+		ServerStats stats;
+
+		void accept();
+		void read_request(std::shared_ptr<Session> session);
+		void handle_request(std::shared_ptr<Session> session, std::string line);
+		void fetch_queued();
+		void complete_item(std::shared_ptr<ClientRequest> request, int index, const TimedReading& reading);
+		void send_answer(std::shared_ptr<ClientRequest> request);
+		static std::string format_value(const Command::Reading& reading);
+		static std::string format_status(Command::STATUS status);
+
+	public:
+		ObdServer(std::string port, long baud, std::string cache_path, std::string socket_path, long max_age_ms = DEFAULT_MAX_AGE_MS);
+		~ObdServer();
+		bool start_capture(std::string path);
+		bool start();
+		ElmDevice& get_device();
+		ServerStats get_stats();
+		void stop();
+};
+
+#endif
+
+#endif
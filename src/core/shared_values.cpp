@@ -0,0 +1,267 @@
+/* This file contains code that shares the latest values with other processes on the same machine
+*
+* Author: Josh McIntyre
+*/
+
+#include "shared_values.h"
+
+const char SharedValues::MAGIC[] = "OBDSHVAL";
+
+// This function returns the POSIX shared memory object name for a table name, such as /obdcmd for obdcmd
+std::string SharedValues::get_object_name(std::string name)
+{
+	return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+
+// This function returns the size of a table with a slot for each of slot_count items
+std::size_t SharedValues::get_size(uint32_t slot_count)
+{
+	return sizeof(SharedValuesHeader) + slot_count * sizeof(SharedValueSlot);
+}
+
+/* This function checks whether a table is still being published to by a running process
+* so a second writer doesn't take it over. A table left behind by a crash can be reused
+*/
+bool SharedValues::is_in_use(std::string object_name)
+{
+	#ifdef LINUX
+		SharedValuesReader reader(object_name);
+		if (!reader.is_open() || !reader.is_live())
+		{
+			return false;
+		}
+
+		pid_t writer = (pid_t) reader.get_writer_pid();
+		return writer != getpid() && kill(writer, 0) == 0;
+	#else
+		return false;
+	#endif
+}
+
+/* This constructor creates the shared memory object for a table, with every item not yet read
+* The table can't be created on platforms without POSIX shared memory, or while another
+* process is publishing to it; check is_open()
+*/
+SharedValuesWriter::SharedValuesWriter(std::string name)
+{
+	object_name = SharedValues::get_object_name(name);
+	header = nullptr;
+	slots = nullptr;
+	size = SharedValues::get_size(PID_TABLE_SIZE);
+
+	#ifdef LINUX
+		if (SharedValues::is_in_use(object_name))
+		{
+			return;
+		}
+
+		int fd = shm_open(object_name.c_str(), O_RDWR | O_CREAT, 0644);
+		if (fd < 0)
+		{
+			return;
+		}
+
+		void* mapped = MAP_FAILED;
+		if (ftruncate(fd, size) == 0)
+		{
+			mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		}
+		::close(fd);
+
+		if (mapped == MAP_FAILED)
+		{
+			return;
+		}
+
+		header = (SharedValuesHeader*) mapped;
+		slots = (SharedValueSlot*) ((unsigned char*) mapped + sizeof(SharedValuesHeader));
+	#else
+		return;
+	#endif
+
+	// The table may be left over from an earlier run, so every field is reset
+	header -> live.store(0, std::memory_order_release);
+	std::memcpy(header -> magic, SharedValues::MAGIC, sizeof(header -> magic));
+	header -> version = SharedValues::VERSION;
+	header -> slot_count = PID_TABLE_SIZE;
+	header -> slot_size = sizeof(SharedValueSlot);
+
+	for (int i = 0; i < PID_TABLE_SIZE; i++)
+	{
+		SharedValueSlot& slot = slots[i];
+		slot.sequence.store(0, std::memory_order_relaxed);
+		slot.pid_code = Recording::get_pid_code(i);
+		std::memset(slot.name, 0, sizeof(slot.name));
+		std::strncpy(slot.name, PID_TABLE[i].name, sizeof(slot.name) - 1);
+		slot.timestamp_us.store(0, std::memory_order_relaxed);
+		slot.value.store(0, std::memory_order_relaxed);
+		slot.status.store(Command::STATUS_NO_DATA, std::memory_order_relaxed);
+		slot.unit.store(PID_TABLE[i].unit, std::memory_order_relaxed);
+	}
+
+	#ifdef LINUX
+		header -> writer_pid = getpid();
+	#endif
+	header -> live.store(1, std::memory_order_release);
+}
+
+/* This destructor marks the table as no longer live and removes it
+* Readers that still have it mapped see the last values, and is_live() turns false
+*/
+SharedValuesWriter::~SharedValuesWriter()
+{
+	#ifdef LINUX
+		if (header != nullptr)
+		{
+			header -> live.store(0, std::memory_order_release);
+			munmap(header, size);
+			shm_unlink(object_name.c_str());
+		}
+	#endif
+}
+
+bool SharedValuesWriter::is_open()
+{
+	return header != nullptr;
+}
+
+/* This function updates an item's slot with a new reading
+* The sequence is odd while the slot is being written, and the fences keep the slot's fields
+* from being seen outside that window
+*/
+void SharedValuesWriter::publish(int64_t timestamp_us, Command::COMMAND cmd, const Command::Reading& reading)
+{
+	if (header == nullptr || cmd < 0 || cmd >= PID_TABLE_SIZE || PID_TABLE[cmd].type == Command::TYPE_TEXT)
+	{
+		return;
+	}
+
+	SharedValueSlot& slot = slots[cmd];
+	uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+	slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.timestamp_us.store(timestamp_us, std::memory_order_relaxed);
+	slot.value.store(PID_TABLE[cmd].type == Command::TYPE_DTCS ? reading.dtc_count : reading.value, std::memory_order_relaxed);
+	slot.status.store(reading.status, std::memory_order_relaxed);
+
+	slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+/* This constructor maps a table read-only, checking that it was written by a compatible version
+* On platforms without POSIX shared memory, or if there's no such table, check is_open()
+*/
+SharedValuesReader::SharedValuesReader(std::string name)
+{
+	header = nullptr;
+	slots = nullptr;
+	size = 0;
+
+	#ifdef LINUX
+		int fd = shm_open(SharedValues::get_object_name(name).c_str(), O_RDONLY, 0);
+		if (fd < 0)
+		{
+			return;
+		}
+
+		struct stat object_stat;
+		void* mapped = MAP_FAILED;
+		if (fstat(fd, &object_stat) == 0 && object_stat.st_size >= (off_t) sizeof(SharedValuesHeader))
+		{
+			size = object_stat.st_size;
+			mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+		}
+		::close(fd);
+
+		if (mapped == MAP_FAILED)
+		{
+			return;
+		}
+
+		const SharedValuesHeader* mapped_header = (const SharedValuesHeader*) mapped;
+		if (std::memcmp(mapped_header -> magic, SharedValues::MAGIC, sizeof(mapped_header -> magic)) != 0
+			|| mapped_header -> version != SharedValues::VERSION || mapped_header -> slot_size != sizeof(SharedValueSlot)
+			|| size < SharedValues::get_size(mapped_header -> slot_count))
+		{
+			munmap(mapped, size);
+			return;
+		}
+
+		header = mapped_header;
+		slots = (const SharedValueSlot*) ((const unsigned char*) mapped + sizeof(SharedValuesHeader));
+	#endif
+}
+
+SharedValuesReader::~SharedValuesReader()
+{
+	#ifdef LINUX
+		if (header != nullptr)
+		{
+			munmap((void*) header, size);
+		}
+	#endif
+}
+
+bool SharedValuesReader::is_open()
+{
+	return header != nullptr;
+}
+
+// This function checks whether the writer is still publishing, since the last values stay readable after it exits
+bool SharedValuesReader::is_live()
+{
+	return header != nullptr && header -> live.load(std::memory_order_acquire) != 0;
+}
+
+int64_t SharedValuesReader::get_writer_pid()
+{
+	return (header != nullptr) ? header -> writer_pid : 0;
+}
+
+int SharedValuesReader::get_slot_count()
+{
+	return (header != nullptr) ? header -> slot_count : 0;
+}
+
+/* This function copies a slot, retrying while the writer is part way through updating it
+* It returns false if there's no such slot, or the slot stays torn, as when its writer
+* died mid-update
+*/
+bool SharedValuesReader::read(int slot, SharedValue& value)
+{
+	if (header == nullptr || slot < 0 || slot >= (int) header -> slot_count)
+	{
+		return false;
+	}
+
+	const SharedValueSlot& shared = slots[slot];
+	for (int attempt = 0; attempt < SharedValues::MAX_READ_ATTEMPTS; attempt++)
+	{
+		uint32_t before = shared.sequence.load(std::memory_order_acquire);
+		if (before & 1)
+		{
+			continue;
+		}
+
+		int64_t timestamp_us = shared.timestamp_us.load(std::memory_order_relaxed);
+		double latest = shared.value.load(std::memory_order_relaxed);
+		uint8_t status = shared.status.load(std::memory_order_relaxed);
+		uint8_t unit = shared.unit.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (shared.sequence.load(std::memory_order_relaxed) != before)
+		{
+			continue;
+		}
+
+		value.pid_code = shared.pid_code;
+		value.name = std::string(shared.name, strnlen(shared.name, sizeof(shared.name)));
+		value.timestamp_us = timestamp_us;
+		value.value = latest;
+		value.status = (Command::STATUS) status;
+		value.unit = (Command::UNIT) unit;
+		return true;
+	}
+
+	return false;
+}
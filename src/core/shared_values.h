@@ -0,0 +1,125 @@
+/* This file contains function declarations and includes for the shared table of latest values
+*
+* Author: Josh McIntyre
+*/
+
+#ifndef SHARED_VALUES_H
+#define SHARED_VALUES_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <atomic>
+
+#ifdef LINUX
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "command.h"
+#include "recorder.h"
+
+/* The shared values are a POSIX shared memory object holding a header and one slot for each
+* entry in PID_TABLE, in table order. Each slot is a cache line holding the latest value of its
+* item, such as 1726 for rpm, or the number of codes for dtc, and when it was read, in
+* microseconds since the epoch (0 until the item is first read). Text items, such as the VIN,
+* aren't shared. The PID code is mode << 8 | PID, as in recordings, and the name is the item's
+* short name. Fields are in the machine's native byte order
+*
+* Each slot is guarded by a seqlock: the writer makes the sequence odd, updates the slot, then
+* makes it even again. Readers copy the slot and try again if the sequence was odd or changed
+* meanwhile, so reading takes no system calls and never holds up the writer or other readers
+*/
+struct alignas(64) SharedValuesHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t slot_count;
+	uint32_t slot_size;
+	std::atomic<uint32_t> live;
+	int64_t writer_pid;
+};
+
+struct alignas(64) SharedValueSlot
+{
+	std::atomic<uint32_t> sequence;
+	uint16_t pid_code;
+	char name[10];
+	std::atomic<int64_t> timestamp_us;
+	std::atomic<double> value;
+	std::atomic<uint8_t> status;
+	std::atomic<uint8_t> unit;
+};
+
+static_assert(sizeof(SharedValuesHeader) == 64, "SharedValuesHeader must fill one cache line");
+static_assert(sizeof(SharedValueSlot) == 64, "SharedValueSlot must fill one cache line");
+static_assert(std::atomic<int64_t>::is_always_lock_free && std::atomic<double>::is_always_lock_free,
+	"Shared values need lock-free 64 bit atomics");
+
+// This struct holds a copy of one slot, as read by SharedValuesReader
+struct SharedValue
+{
+	uint16_t pid_code;
+	std::string name;
+	int64_t timestamp_us;
+	double value;
+	Command::STATUS status;
+	Command::UNIT unit;
+};
+
+// This class holds the constants and helpers shared by the shared values writer and reader
+class SharedValues
+{
+	public:
+		static const char MAGIC[];
+		static const uint32_t VERSION = 1;
+
+		// A reader gives up on a slot after this many torn reads, in case its writer died mid-update
+		static const int MAX_READ_ATTEMPTS = 1000;
+
+		static std::string get_object_name(std::string name);
+		static std::size_t get_size(uint32_t slot_count);
+		static bool is_in_use(std::string object_name);
+};
+
+/* This class publishes the latest value of each item to a shared memory object
+* Publishing only copies into the item's slot, so it's safe to call on the acquisition thread
+* There must be a single writer per object. It's removed when the writer is destroyed
+*/
+class SharedValuesWriter
+{
+	private:
+		std::string object_name;
+		SharedValuesHeader* header;
+		SharedValueSlot* slots;
+		std::size_t size;
+
+	public:
+		SharedValuesWriter(std::string name);
+		~SharedValuesWriter();
+		bool is_open();
+		void publish(int64_t timestamp_us, Command::COMMAND cmd, const Command::Reading& reading);
+};
+
+// This class reads the latest values published by another process
+class SharedValuesReader
+{
+	private:
+		const SharedValuesHeader* header;
+		const SharedValueSlot* slots;
+		std::size_t size;
+
+	public:
+		SharedValuesReader(std::string name);
+		~SharedValuesReader();
+		bool is_open();
+		bool is_live();
+		int64_t get_writer_pid();
+		int get_slot_count();
+		bool read(int slot, SharedValue& value);
+};
+
+#endif
@@ -0,0 +1,141 @@
+/* This file contains code that collects latency statistics for device commands
+*
+* Author: Josh McIntyre
+*/
+
+#include "stats.h"
+
+LatencyHistogram::LatencyHistogram()
+{
+	counts.fill(0);
+	count = 0;
+	max = 0;
+}
+
+// This function counts a value. Negative values are counted as 0
+void LatencyHistogram::record(int64_t value)
+{
+	if (value < 0)
+	{
+		value = 0;
+	}
+
+	counts[get_bucket(value)]++;
+	count++;
+	max = std::max(max, value);
+}
+
+/* This function returns the value below which the given percentage of values fall, such as
+* 99 for p99. It's the upper limit of the bucket the percentile lands in, capped at the maximum
+*/
+int64_t LatencyHistogram::get_percentile(double percentile) const
+{
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	uint64_t target = (uint64_t) (percentile / 100.0 * count + 0.5);
+	target = std::min(std::max(target, (uint64_t) 1), count);
+
+	uint64_t seen = 0;
+	for (int i = 0; i < BUCKET_COUNT; i++)
+	{
+		seen += counts[i];
+		if (seen >= target)
+		{
+			return std::min(get_bucket_limit(i), max);
+		}
+	}
+
+	return max;
+}
+
+uint64_t LatencyHistogram::get_count() const
+{
+	return count;
+}
+
+int64_t LatencyHistogram::get_max() const
+{
+	return max;
+}
+
+/* This function finds a value's bucket
+* Values below SUB_BUCKETS get a bucket each. Above that, the bucket is picked by the
+* value's highest set bit and the SUB_BUCKET_BITS bits below it
+*/
+int LatencyHistogram::get_bucket(int64_t value)
+{
+	if (value < SUB_BUCKETS)
+	{
+		return (int) value;
+	}
+
+	int power = 63 - __builtin_clzll((unsigned long long) value);
+	if (power >= MAX_POWER)
+	{
+		return BUCKET_COUNT - 1;
+	}
+
+	int shift = power - SUB_BUCKET_BITS;
+	int sub_bucket = (int) (value >> shift) - SUB_BUCKETS;
+
+	return SUB_BUCKETS * (shift + 1) + sub_bucket;
+}
+
+// This function returns the largest value that falls in a bucket
+int64_t LatencyHistogram::get_bucket_limit(int bucket)
+{
+	if (bucket < SUB_BUCKETS)
+	{
+		return bucket;
+	}
+
+	int shift = bucket / SUB_BUCKETS - 1;
+	int64_t mantissa = SUB_BUCKETS + bucket % SUB_BUCKETS;
+
+	return ((mantissa + 1) << shift) - 1;
+}
+
+/* This function records the outcome of one command in an exchange
+* Timings are only recorded for exchanges that completed, while NO DATA and timeouts are counted
+*/
+void LatencyStats::record(Command::COMMAND cmd, const ExchangeTiming& timing, int64_t decode_ns, const Command::Reading& reading)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	CommandStats& stats = commands[cmd];
+	if (stats.samples == 0)
+	{
+		stats.first_sample = now;
+	}
+	stats.samples++;
+	stats.last_sample = now;
+
+	if (reading.status == Command::STATUS_TIMEOUT)
+	{
+		stats.timeouts++;
+		return;
+	}
+
+	if (reading.status == Command::STATUS_NO_DATA)
+	{
+		stats.no_data++;
+	}
+
+	stats.write_us.record(timing.write_us);
+	stats.first_byte_us.record(timing.first_byte_us);
+	stats.prompt_us.record(timing.prompt_us);
+	stats.decode_ns.record(decode_ns);
+}
+
+const std::map<Command::COMMAND, CommandStats>& LatencyStats::get_commands() const
+{
+	return commands;
+}
+
+void LatencyStats::clear()
+{
+	commands.clear();
+}
@@ -0,0 +1,87 @@
+/* This file contains function declarations and includes for latency statistics
+*
+* Author: Josh McIntyre
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <cstdint>
+#include <array>
+#include <map>
+#include <chrono>
+#include <algorithm>
+
+#include "command.h"
+
+/* This class counts values, such as latencies, in log-linear buckets
+* Every power of two is split into SUB_BUCKETS buckets, so percentiles are accurate to
+* within 1 / SUB_BUCKETS of the value, and recording a value is a few integer operations
+*/
+class LatencyHistogram
+{
+	public:
+		static const int SUB_BUCKET_BITS = 3;
+		static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+		// Values of 2^MAX_POWER and above share the last bucket
+		static const int MAX_POWER = 40;
+		static const int BUCKET_COUNT = SUB_BUCKETS * (MAX_POWER - SUB_BUCKET_BITS + 1);
+
+	private:
+		std::array<uint32_t, BUCKET_COUNT> counts;
+		uint64_t count;
+		int64_t max;
+
+		static int get_bucket(int64_t value);
+		static int64_t get_bucket_limit(int bucket);
+
+	public:
+		LatencyHistogram();
+		void record(int64_t value);
+		int64_t get_percentile(double percentile) const;
+		uint64_t get_count() const;
+		int64_t get_max() const;
+};
+
+/* This struct holds the statistics for one command
+* Exchange phases are in microseconds from when the request started being written: the write
+* completing, the first response byte and the prompt. Decoding is in nanoseconds
+*/
+struct CommandStats
+{
+	LatencyHistogram write_us;
+	LatencyHistogram first_byte_us;
+	LatencyHistogram prompt_us;
+	LatencyHistogram decode_ns;
+
+	long samples;
+	long no_data;
+	long timeouts;
+	std::chrono::steady_clock::time_point first_sample;
+	std::chrono::steady_clock::time_point last_sample;
+};
+
+// Timings of a single exchange with the device, in microseconds from when the request started being written
+struct ExchangeTiming
+{
+	int64_t write_us;
+	int64_t first_byte_us;
+	int64_t prompt_us;
+};
+
+/* This class collects statistics for every command fetched from a device
+* A batched request counts once for each command in it
+*/
+class LatencyStats
+{
+	private:
+		std::map<Command::COMMAND, CommandStats> commands;
+
+	public:
+		void record(Command::COMMAND cmd, const ExchangeTiming& timing, int64_t decode_ns, const Command::Reading& reading);
+		const std::map<Command::COMMAND, CommandStats>& get_commands() const;
+		void clear();
+};
+
+#endif
@@ -0,0 +1,156 @@
+/* This file contains code that stores what's been learned about vehicles between runs
+*
+* Author: Josh McIntyre
+*/
+
+#include "vehicle_cache.h"
+
+std::mutex VehicleCache::lock;
+
+/* This function returns the cache file in the user's home directory
+* It returns an empty path, which disables the cache, if there's no home directory
+*/
+std::string VehicleCache::get_default_path()
+{
+	#ifdef LINUX
+		const char* home = std::getenv("HOME");
+		std::string separator = "/";
+	#else
+		const char* home = std::getenv("USERPROFILE");
+		std::string separator = "\\";
+	#endif
+
+	if (home == nullptr || *home == '\0')
+	{
+		return std::string();
+	}
+
+	return std::string(home) + separator + ".obdcmd_vehicles";
+}
+
+// This function loads the most recently used vehicle, whose protocol is the best guess for the next connection
+bool VehicleCache::load_last(std::string path, VehicleInfo& info)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	std::vector<VehicleInfo> vehicles = read_all(path);
+	if (vehicles.empty())
+	{
+		return false;
+	}
+
+	info = vehicles[0];
+	return true;
+}
+
+// This function loads a vehicle by VIN and protocol
+bool VehicleCache::load(std::string path, std::string vin, int protocol, VehicleInfo& info)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	for (const VehicleInfo& vehicle : read_all(path))
+	{
+		if (vehicle.vin == vin && vehicle.protocol == protocol)
+		{
+			info = vehicle;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* This function saves a vehicle as the most recently used one, replacing any earlier entry
+* for the same VIN and protocol
+*/
+bool VehicleCache::store(std::string path, const VehicleInfo& info)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	std::vector<VehicleInfo> vehicles = read_all(path);
+	vehicles.erase(std::remove_if(vehicles.begin(), vehicles.end(), [&info](const VehicleInfo& vehicle)
+	{
+		return vehicle.vin == info.vin && vehicle.protocol == info.protocol;
+	}), vehicles.end());
+	vehicles.insert(vehicles.begin(), info);
+	if ((int) vehicles.size() > MAX_VEHICLES)
+	{
+		vehicles.resize(MAX_VEHICLES);
+	}
+
+	std::ofstream file(path, std::ios::trunc);
+	for (const VehicleInfo& vehicle : vehicles)
+	{
+		file << format_line(vehicle) << "\n";
+	}
+
+	return file.good();
+}
+
+// This function reads every vehicle in the cache, skipping lines it doesn't understand
+std::vector<VehicleInfo> VehicleCache::read_all(std::string path)
+{
+	std::vector<VehicleInfo> vehicles;
+	if (path.empty())
+	{
+		return vehicles;
+	}
+
+	std::ifstream file(path);
+	std::string line;
+	while (std::getline(file, line))
+	{
+		VehicleInfo info;
+		if (parse_line(line, info))
+		{
+			vehicles.push_back(info);
+		}
+	}
+
+	return vehicles;
+}
+
+bool VehicleCache::parse_line(const std::string& line, VehicleInfo& info)
+{
+	std::stringstream ss(line);
+	std::string protocol;
+	std::string bitmaps;
+	if (!std::getline(ss, info.vin, '\t') || !std::getline(ss, protocol, '\t') || !std::getline(ss, bitmaps)
+		|| info.vin.empty() || protocol.length() != 1 || bitmaps.length() != info.supported_pids.size() * 8)
+	{
+		return false;
+	}
+
+	char* end = nullptr;
+	info.protocol = (int) std::strtol(protocol.c_str(), &end, 16);
+	if (*end != '\0')
+	{
+		return false;
+	}
+
+	for (std::array<uint32_t, 8>::size_type i = 0; i < info.supported_pids.size(); i++)
+	{
+		std::string bitmap = bitmaps.substr(i * 8, 8);
+		info.supported_pids[i] = (uint32_t) std::strtoul(bitmap.c_str(), &end, 16);
+		if (*end != '\0')
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::string VehicleCache::format_line(const VehicleInfo& info)
+{
+	std::string line = info.vin + "\t" + Command::hex_digit(info.protocol) + "\t";
+	for (uint32_t bitmap : info.supported_pids)
+	{
+		for (int shift = 28; shift >= 0; shift -= 4)
+		{
+			line += Command::hex_digit(bitmap >> shift);
+		}
+	}
+
+	return line;
+}
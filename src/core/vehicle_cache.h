@@ -0,0 +1,58 @@
+/* This file contains function declarations and includes for the cache of known vehicles
+*
+* Author: Josh McIntyre
+*/
+
+#ifndef VEHICLE_CACHE_H
+#define VEHICLE_CACHE_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <array>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <mutex>
+#include <algorithm>
+
+#include "command.h"
+
+/* This struct holds what's been learned about a vehicle
+* The protocol is the ELM327 protocol number reported by AT DPN, such as 6 for CAN 11/500
+* supported_pids holds the Mode 01 supported PID bitmaps, as returned for PIDs 00, 20, 40, ...
+* The most significant bit of each is the PID after the one requested
+*/
+struct VehicleInfo
+{
+	std::string vin;
+	int protocol;
+	std::array<uint32_t, 8> supported_pids;
+};
+
+/* This class keeps the vehicles seen before in a text file, so they can be set up quickly
+* Each line is a vehicle: <VIN>\t<protocol>\t<bitmap for PID 00>...<bitmap for PID E0>
+* with each bitmap as 8 hex digits. Vehicles are keyed by VIN and protocol, and the most
+* recently used vehicle comes first
+* The file is rewritten on every store, under a lock, so devices set up in parallel can share it
+*/
+class VehicleCache
+{
+	private:
+		static std::mutex lock;
+
+		static std::vector<VehicleInfo> read_all(std::string path);
+		static bool parse_line(const std::string& line, VehicleInfo& info);
+		static std::string format_line(const VehicleInfo& info);
+
+	public:
+		// The cache keeps this many vehicles, dropping the least recently used
+		static const int MAX_VEHICLES = 64;
+
+		static std::string get_default_path();
+		static bool load_last(std::string path, VehicleInfo& info);
+		static bool load(std::string path, std::string vin, int protocol, VehicleInfo& info);
+		static bool store(std::string path, const VehicleInfo& info);
+};
+
+#endif
@@ -6,8 +6,16 @@
 import logging
 import io
 import math
+import mmap
+import struct
 import serial
 
+# The native bindings to the C++ core, built with make py, if they're on the path
+try:
+    import obdcore
+except ImportError:
+    obdcore = None
+
 # Set log level
 logging.basicConfig(level=logging.INFO)
 
@@ -15,6 +23,15 @@ logging.basicConfig(level=logging.INFO)
 PORT = "COM5"
 BAUD = "38400"
 
+# Constants for reading values shared by obdcmd --share, see src/core/shared_values.h
+SHARED_NAME = "obdcmd"
+SHARED_MAGIC = b"OBDSHVAL"
+SHARED_VERSION = 1
+SHARED_HEADER = struct.Struct("=8sIIIIq")
+SHARED_SLOT = struct.Struct("=IH10sqdBB")
+SHARED_SLOT_SIZE = 64
+SHARED_MAX_ATTEMPTS = 1000
+
 # Available commands
 class Command():
 
@@ -92,6 +109,44 @@ def trim_resp(resp):
 
     return resp
 
+# Read the latest values shared by a running obdcmd, without touching the serial port
+# Returns a dict of item name to (value, timestamp in microseconds, status), or None if nothing is shared
+def read_shared_values(name):
+
+    try:
+        shm = open(f"/dev/shm/{name}", "rb")
+    except OSError:
+        return None
+
+    with shm:
+        table = mmap.mmap(shm.fileno(), 0, access=mmap.ACCESS_READ)
+
+    magic, version, slot_count, slot_size, live, writer_pid = SHARED_HEADER.unpack_from(table, 0)
+    if magic != SHARED_MAGIC or version != SHARED_VERSION or slot_size != SHARED_SLOT_SIZE:
+        logging.error(f"Shared values {name} are from an incompatible version of obdcmd")
+        return None
+    if not live:
+        logging.warning(f"The obdcmd sharing {name} has stopped, these are its last values")
+
+    values = {}
+    for slot in range(slot_count):
+        offset = SHARED_SLOT_SIZE * (slot + 1)
+
+        # Each slot is guarded by a seqlock: retry while the sequence is odd or changes under us
+        for attempt in range(SHARED_MAX_ATTEMPTS):
+            sequence, pid_code, item, timestamp, value, status, unit = SHARED_SLOT.unpack_from(table, offset)
+            if sequence % 2 == 0 and struct.unpack_from("=I", table, offset)[0] == sequence:
+                break
+        else:
+            continue
+
+        if timestamp != 0:
+            values[item.rstrip(b"\0").decode()] = (value, timestamp, status)
+
+    table.close()
+
+    return values
+
 # Print a response
 def output(resp):
 
@@ -108,6 +163,19 @@ def run_output(conn, cmd):
 # The main entry point for the program
 def main():
 
+    # Share the adapter with a running obdcmd --share obdcmd instead of opening the port
+    values = read_shared_values(SHARED_NAME)
+    if values is not None and "rpm" in values:
+        output(f"{CMD_GET_ENGINE_RPM.plaintext}: {math.ceil(values['rpm'][0])}")
+        return
+
+    # Use the C++ core when it's built, since it sets up the adapter fully and decodes every item
+    if obdcore is not None:
+        device = obdcore.Device(PORT)
+        rpm = device.get("rpm")
+        output(f"{CMD_GET_ENGINE_RPM.plaintext}: {rpm if rpm is None else math.ceil(rpm)}")
+        return
+
     conn = setup(PORT, BAUD)
 
     run_output(conn, CMD_GET_ENGINE_RPM)
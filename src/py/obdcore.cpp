@@ -0,0 +1,470 @@
+/* This file contains the obdcore Python extension module, which exposes the C++ core to Python
+* Samples are fetched in C++ without holding the GIL and handed back as arrays, one column
+* per item, instead of one Python object per value:
+*
+*   import numpy, obdcore
+*   device = obdcore.Device("/dev/ttyUSB0")
+*   timestamps, values, statuses = device.poll(["rpm", "spd", "maf"], 1000)
+*   rpm = numpy.asarray(values)[:, 0]
+*
+* Author: Josh McIntyre
+*/
+
+#include "obdcore.h"
+
+// This function frees an array's storage. Python only calls it once no buffer views are left
+static void array_dealloc(ArrayObject* self)
+{
+	delete self -> data;
+	Py_TYPE(self) -> tp_free((PyObject*) self);
+}
+
+// This function fills in a buffer view of the whole array for the buffer protocol
+static int array_getbuffer(ArrayObject* self, Py_buffer* view, int flags)
+{
+	view -> obj = (PyObject*) self;
+	Py_INCREF(self);
+
+	view -> buf = self -> data -> data();
+	view -> len = self -> data -> size();
+	view -> readonly = 0;
+	view -> itemsize = self -> itemsize;
+	view -> format = (flags & PyBUF_FORMAT) ? (char*) self -> format : nullptr;
+	view -> ndim = self -> ndim;
+	view -> shape = (flags & PyBUF_ND) ? self -> shape : nullptr;
+	view -> strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? self -> strides : nullptr;
+	view -> suboffsets = nullptr;
+	view -> internal = nullptr;
+
+	return 0;
+}
+
+static Py_ssize_t array_length(ArrayObject* self)
+{
+	return self -> shape[0];
+}
+
+/* The slot tables start out zeroed and are filled in by PyInit_obdcore
+*/
+static PyBufferProcs array_buffer_procs = {};
+static PySequenceMethods array_sequence_methods = {};
+static PyTypeObject ArrayType = {};
+
+/* This function creates an array of rows by columns items, filled with zeros
+* A columns of 0 makes a one dimensional array of rows items
+* It raises MemoryError if the array is too large to allocate
+*/
+PyObject* new_array(const char* format, Py_ssize_t itemsize, Py_ssize_t rows, Py_ssize_t columns)
+{
+	Py_ssize_t row_size = std::max(columns, (Py_ssize_t) 1) * itemsize;
+	if (rows > PY_SSIZE_T_MAX / row_size)
+	{
+		return PyErr_NoMemory();
+	}
+
+	ArrayObject* array = PyObject_New(ArrayObject, &ArrayType);
+	if (array == nullptr)
+	{
+		return nullptr;
+	}
+
+	try
+	{
+		array -> data = new std::vector<unsigned char>(rows * row_size);
+	}
+	catch (const std::bad_alloc&)
+	{
+		array -> data = nullptr;
+		Py_DECREF(array);
+		return PyErr_NoMemory();
+	}
+
+	array -> format = format;
+	array -> itemsize = itemsize;
+	array -> ndim = (columns > 0) ? 2 : 1;
+	array -> shape[0] = rows;
+	array -> shape[1] = columns;
+	array -> strides[0] = row_size;
+	array -> strides[1] = itemsize;
+
+	return (PyObject*) array;
+}
+
+/* This function converts a reading to a Python value: a float for numeric items, a list of codes
+* such as ['P0133', 'P0420'] for trouble codes, a string for text items, or None if the item
+* couldn't be read
+*/
+PyObject* reading_to_python(const Command::Reading& reading)
+{
+	if (reading.status != Command::STATUS_OK)
+	{
+		Py_RETURN_NONE;
+	}
+
+	if (reading.type == Command::TYPE_DTCS)
+	{
+		PyObject* codes = PyList_New(reading.dtc_count);
+		for (int i = 0; codes != nullptr && i < reading.dtc_count; i++)
+		{
+			char dtc[6];
+			Command::format_dtc(reading.dtcs[i], dtc);
+			PyList_SET_ITEM(codes, i, PyUnicode_FromString(dtc));
+		}
+
+		return codes;
+	}
+	else if (reading.type == Command::TYPE_TEXT)
+	{
+		return PyUnicode_FromString(reading.text);
+	}
+
+	return PyFloat_FromDouble(reading.value);
+}
+
+// This function looks up an item by its name in PID_TABLE, raising ValueError if there's no such item
+Command::COMMAND find_item(PyObject* name)
+{
+	const char* text = PyUnicode_AsUTF8(name);
+	if (text == nullptr)
+	{
+		return Command::INVALID_COMMAND;
+	}
+
+	Command::COMMAND cmd = Command::find_command(text);
+	if (cmd == Command::INVALID_COMMAND)
+	{
+		PyErr_Format(PyExc_ValueError, "Unknown item '%s'", text);
+	}
+
+	return cmd;
+}
+
+/* This function sets up the adapter: Device(port, baud=38400, cache=None)
+* Vehicles are remembered in obdcmd's cache unless cache is given, or is '' for no cache
+*/
+static int device_init(DeviceObject* self, PyObject* args, PyObject* kwargs)
+{
+	static const char* keywords[] = { "port", "baud", "cache", nullptr };
+	const char* port;
+	long baud = SerialConnection::DEFAULT_BAUD_RATE;
+	const char* cache = nullptr;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|lz", (char**) keywords, &port, &baud, &cache))
+	{
+		return -1;
+	}
+
+	if (self -> elm_device != nullptr)
+	{
+		PyErr_SetString(PyExc_RuntimeError, "Device is already set up");
+		return -1;
+	}
+
+	// The serial layer exits the process if the port can't be opened, so that's checked first
+	#ifdef LINUX
+		if (access(port, R_OK | W_OK) != 0)
+		{
+			PyErr_SetFromErrnoWithFilename(PyExc_OSError, port);
+			return -1;
+		}
+	#endif
+
+	std::string cache_path = (cache != nullptr) ? std::string(cache) : VehicleCache::get_default_path();
+	ElmDevice* elm_device;
+	Py_BEGIN_ALLOW_THREADS
+	elm_device = new ElmDevice(port, baud, cache_path);
+	Py_END_ALLOW_THREADS
+
+	self -> elm_device = elm_device;
+	self -> lock = new std::mutex();
+	return 0;
+}
+
+static void device_dealloc(DeviceObject* self)
+{
+	delete self -> elm_device;
+	delete self -> lock;
+	Py_TYPE(self) -> tp_free((PyObject*) self);
+}
+
+// This function checks that a device was set up, since __init__ can be skipped from Python
+static bool check_device(DeviceObject* self)
+{
+	if (self -> elm_device == nullptr)
+	{
+		PyErr_SetString(PyExc_RuntimeError, "Device isn't set up");
+		return false;
+	}
+
+	return true;
+}
+
+// This function reads one item: get(item)
+static PyObject* device_get(DeviceObject* self, PyObject* name)
+{
+	Command::COMMAND cmd = find_item(name);
+	if (cmd == Command::INVALID_COMMAND || !check_device(self))
+	{
+		return nullptr;
+	}
+
+	Command::Reading reading;
+	Py_BEGIN_ALLOW_THREADS
+	std::lock_guard<std::mutex> guard(*self -> lock);
+	reading = self -> elm_device -> get_data(cmd);
+	Py_END_ALLOW_THREADS
+
+	return reading_to_python(reading);
+}
+
+/* This function reads a list of items count times, as fast as the adapter allows: poll(items, count)
+* Each round reads every item in as few requests as possible, as obdcmd's polling mode does
+* It returns three arrays: the time of each round in microseconds since the epoch (int64,
+* count), the values (float64, count x items) and the statuses (uint8, count x items), where
+* 0 is OK, 1 NO DATA, 2 TIMEOUT and 3 INVALID. Values that couldn't be read are NaN, and
+* trouble code items give the number of codes. Text items, such as the VIN, can't be polled
+* The GIL is only taken between rounds, to check for Ctrl+C
+*/
+static PyObject* device_poll(DeviceObject* self, PyObject* args)
+{
+	PyObject* names;
+	Py_ssize_t count;
+	if (!PyArg_ParseTuple(args, "On", &names, &count) || !check_device(self))
+	{
+		return nullptr;
+	}
+
+	PyObject* sequence = PySequence_Fast(names, "items must be a sequence of item names");
+	if (sequence == nullptr)
+	{
+		return nullptr;
+	}
+
+	std::vector<Command::COMMAND> cmds;
+	for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(sequence); i++)
+	{
+		Command::COMMAND cmd = find_item(PySequence_Fast_GET_ITEM(sequence, i));
+		if (cmd == Command::INVALID_COMMAND)
+		{
+			Py_DECREF(sequence);
+			return nullptr;
+		}
+		if (Command::get_info(cmd).type == Command::TYPE_TEXT)
+		{
+			PyErr_Format(PyExc_ValueError, "Text item '%s' can't be polled", Command::get_info(cmd).name);
+			Py_DECREF(sequence);
+			return nullptr;
+		}
+
+		cmds.push_back(cmd);
+	}
+	Py_DECREF(sequence);
+
+	if (cmds.empty() || count < 0)
+	{
+		PyErr_SetString(PyExc_ValueError, "poll needs at least one item and a count of 0 or more");
+		return nullptr;
+	}
+
+	Py_ssize_t columns = cmds.size();
+	PyObject* timestamps = new_array("q", sizeof(int64_t), count, 0);
+	PyObject* values = new_array("d", sizeof(double), count, columns);
+	PyObject* statuses = new_array("B", sizeof(uint8_t), count, columns);
+	if (timestamps == nullptr || values == nullptr || statuses == nullptr)
+	{
+		Py_XDECREF(timestamps);
+		Py_XDECREF(values);
+		Py_XDECREF(statuses);
+		return nullptr;
+	}
+
+	int64_t* timestamp_data = (int64_t*) ((ArrayObject*) timestamps) -> data -> data();
+	double* value_data = (double*) ((ArrayObject*) values) -> data -> data();
+	uint8_t* status_data = ((ArrayObject*) statuses) -> data -> data();
+
+	bool interrupted = false;
+	Py_BEGIN_ALLOW_THREADS
+	std::lock_guard<std::mutex> guard(*self -> lock);
+	for (Py_ssize_t row = 0; row < count && !interrupted; row++)
+	{
+		std::vector<Command::Reading> readings = self -> elm_device -> get_data_batch(cmds);
+		timestamp_data[row] = Capture::now_us();
+
+		for (Py_ssize_t column = 0; column < columns; column++)
+		{
+			const Command::Reading& reading = readings[column];
+			double value = (reading.type == Command::TYPE_DTCS) ? reading.dtc_count : reading.value;
+			value_data[row * columns + column] = (reading.status == Command::STATUS_OK) ? value : NAN;
+			status_data[row * columns + column] = reading.status;
+		}
+
+		Py_BLOCK_THREADS
+		interrupted = (PyErr_CheckSignals() != 0);
+		Py_UNBLOCK_THREADS
+	}
+	Py_END_ALLOW_THREADS
+
+	if (interrupted)
+	{
+		Py_DECREF(timestamps);
+		Py_DECREF(values);
+		Py_DECREF(statuses);
+		return nullptr;
+	}
+
+	return Py_BuildValue("(NNN)", timestamps, values, statuses);
+}
+
+// This function returns the vehicle found during setup, as a dict of its VIN and protocol number
+static PyObject* device_get_vehicle(DeviceObject* self, PyObject*)
+{
+	if (!check_device(self))
+	{
+		return nullptr;
+	}
+
+	const VehicleInfo& vehicle = self -> elm_device -> get_vehicle();
+	return Py_BuildValue("{s:s,s:i}", "vin", vehicle.vin.c_str(), "protocol", vehicle.protocol);
+}
+
+static PyObject* device_get_baud_rate(DeviceObject* self, PyObject*)
+{
+	if (!check_device(self))
+	{
+		return nullptr;
+	}
+
+	return PyLong_FromLong(self -> elm_device -> get_baud_rate());
+}
+
+static PyMethodDef device_methods[] = {
+	{ "get", (PyCFunction) device_get, METH_O, "get(item) -> the item's value, or None if it couldn't be read" },
+	{ "poll", (PyCFunction) device_poll, METH_VARARGS, "poll(items, count) -> (timestamps, values, statuses) arrays" },
+	{ "get_vehicle", (PyCFunction) device_get_vehicle, METH_NOARGS, "get_vehicle() -> {'vin': ..., 'protocol': ...}" },
+	{ "get_baud_rate", (PyCFunction) device_get_baud_rate, METH_NOARGS, "get_baud_rate() -> the baud rate in use" },
+	{ nullptr, nullptr, 0, nullptr }
+};
+
+static PyTypeObject DeviceType = {};
+
+// This function decodes a raw ELM327 response to an item, without a device: decode(item, response)
+static PyObject* obdcore_decode(PyObject*, PyObject* args)
+{
+	PyObject* name;
+	const char* response;
+	Py_ssize_t length;
+	if (!PyArg_ParseTuple(args, "Us#", &name, &response, &length))
+	{
+		return nullptr;
+	}
+
+	Command::COMMAND cmd = find_item(name);
+	if (cmd == Command::INVALID_COMMAND)
+	{
+		return nullptr;
+	}
+
+	return reading_to_python(Command::decode(std::string_view(response, length), cmd));
+}
+
+/* This function lists the items that can be read, as (name, label, unit) tuples
+* Units are the display suffixes without their leading space. They're in code page 437, as
+* the Windows console shows them, for the degree sign
+*/
+static PyObject* obdcore_items(PyObject*, PyObject*)
+{
+	PyObject* items = PyList_New(PID_TABLE_SIZE);
+	for (int i = 0; items != nullptr && i < PID_TABLE_SIZE; i++)
+	{
+		const char* unit = Command::get_unit_suffix(PID_TABLE[i].unit);
+		unit += (unit[0] == ' ') ? 1 : 0;
+
+		PyList_SET_ITEM(items, i, Py_BuildValue("(ssN)", PID_TABLE[i].name, PID_TABLE[i].label, PyUnicode_Decode(unit, strlen(unit), "cp437", nullptr)));
+	}
+
+	return items;
+}
+
+// This function describes a generic trouble code such as P0133, or returns None if it isn't known
+static PyObject* obdcore_describe_dtc(PyObject*, PyObject* code)
+{
+	const char* text = PyUnicode_AsUTF8(code);
+	if (text == nullptr)
+	{
+		return nullptr;
+	}
+
+	unsigned short raw_dtc = Command::parse_dtc(text);
+	const char* description = (raw_dtc != 0) ? Command::get_dtc_description(raw_dtc) : nullptr;
+	if (description == nullptr)
+	{
+		Py_RETURN_NONE;
+	}
+
+	return PyUnicode_FromString(description);
+}
+
+static PyMethodDef obdcore_methods[] = {
+	{ "decode", obdcore_decode, METH_VARARGS, "decode(item, response) -> the value in a raw ELM327 response" },
+	{ "items", obdcore_items, METH_NOARGS, "items() -> [(name, label, unit), ...]" },
+	{ "describe_dtc", obdcore_describe_dtc, METH_O, "describe_dtc(code) -> the description of a generic trouble code, or None" },
+	{ nullptr, nullptr, 0, nullptr }
+};
+
+static PyModuleDef obdcore_module = {
+	PyModuleDef_HEAD_INIT,
+	"obdcore",
+	"Native bindings to the obdcmd core",
+	-1,
+	obdcore_methods,
+	nullptr,
+	nullptr,
+	nullptr,
+	nullptr
+};
+
+// This function is the entry point for the module, called by Python on import
+PyMODINIT_FUNC PyInit_obdcore()
+{
+	array_buffer_procs.bf_getbuffer = (getbufferproc) array_getbuffer;
+	array_sequence_methods.sq_length = (lenfunc) array_length;
+
+	Py_SET_REFCNT(&ArrayType, 1);
+	ArrayType.tp_name = "obdcore.Array";
+	ArrayType.tp_doc = "A contiguous array of numbers, readable in place through the buffer protocol";
+	ArrayType.tp_basicsize = sizeof(ArrayObject);
+	ArrayType.tp_flags = Py_TPFLAGS_DEFAULT;
+	ArrayType.tp_dealloc = (destructor) array_dealloc;
+	ArrayType.tp_as_buffer = &array_buffer_procs;
+	ArrayType.tp_as_sequence = &array_sequence_methods;
+
+	Py_SET_REFCNT(&DeviceType, 1);
+	DeviceType.tp_name = "obdcore.Device";
+	DeviceType.tp_doc = "Device(port, baud=38400, cache=None) sets up an ELM327 adapter";
+	DeviceType.tp_basicsize = sizeof(DeviceObject);
+	DeviceType.tp_flags = Py_TPFLAGS_DEFAULT;
+	DeviceType.tp_new = PyType_GenericNew;
+	DeviceType.tp_init = (initproc) device_init;
+	DeviceType.tp_dealloc = (destructor) device_dealloc;
+	DeviceType.tp_methods = device_methods;
+
+	if (PyType_Ready(&ArrayType) < 0 || PyType_Ready(&DeviceType) < 0)
+	{
+		return nullptr;
+	}
+
+	PyObject* module = PyModule_Create(&obdcore_module);
+	if (module == nullptr)
+	{
+		return nullptr;
+	}
+
+	Py_INCREF(&ArrayType);
+	Py_INCREF(&DeviceType);
+	if (PyModule_AddObject(module, "Array", (PyObject*) &ArrayType) < 0 || PyModule_AddObject(module, "Device", (PyObject*) &DeviceType) < 0)
+	{
+		Py_DECREF(module);
+		return nullptr;
+	}
+
+	return module;
+}
@@ -0,0 +1,55 @@
+/* This file contains function declarations and includes for the obdcore Python extension module
+*
+* Author: Josh McIntyre
+*/
+
+#ifndef OBDCORE_H
+#define OBDCORE_H
+
+// Python.h must come first, since it sets feature macros for the standard headers
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <new>
+#include <unistd.h>
+
+#include "elm_device.h"
+#include "capture.h"
+
+/* This struct is an obdcore.Array: a contiguous array of numbers that Python reads in place
+* through the buffer protocol, so numpy.asarray() and memoryview() wrap it without copying
+* Arrays have one dimension, or two for a row of values per sample
+*/
+struct ArrayObject
+{
+	PyObject_HEAD
+	std::vector<unsigned char>* data;
+	const char* format;
+	Py_ssize_t itemsize;
+	int ndim;
+	Py_ssize_t shape[2];
+	Py_ssize_t strides[2];
+};
+
+/* This struct is an obdcore.Device: an ELM327 adapter, set up as obdcmd sets it up
+* The GIL is released while the adapter is busy, so other Python threads keep running.
+* The lock keeps those threads from using the same adapter at once
+*/
+struct DeviceObject
+{
+	PyObject_HEAD
+	ElmDevice* elm_device;
+	std::mutex* lock;
+};
+
+PyObject* new_array(const char* format, Py_ssize_t itemsize, Py_ssize_t rows, Py_ssize_t columns);
+PyObject* reading_to_python(const Command::Reading& reading);
+Command::COMMAND find_item(PyObject* name);
+
+#endif
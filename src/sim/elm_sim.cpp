@@ -0,0 +1,1385 @@
+/* This file contains code for a simulated ELM327 OBDII adapter
+* It opens a pseudo-terminal that obdcmd can connect to like a real serial port,
+* so the utility can be tested and benchmarked without an adapter or a vehicle
+* This file contains the main entry point for the simulator
+*
+* Author: Josh McIntyre
+*/
+
+#include "elm_sim.h"
+
+#include <csignal>
+
+const char ElmSimulator::ELM_VERSION[] = "ELM327 v1.5";
+
+// The symlink created with --link, removed again when the simulator is stopped
+static std::string link_name;
+
+static void handle_signal(int)
+{
+	if (!link_name.empty())
+	{
+		unlink(link_name.c_str());
+	}
+
+	_exit(0);
+}
+
+// This function is the main entry point for the simulator
+int main(int argc, char* argv[])
+{
+	ElmSimulator simulator;
+	std::string vehicle_path = "";
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = std::string(argv[i]);
+		bool has_value = (i + 1 < argc);
+
+		if (arg == "--help" || arg == "-h")
+		{
+			show_help();
+			exit(0);
+		}
+		else if (arg == "--link" && has_value)
+		{
+			link_name = std::string(argv[++i]);
+		}
+		else if (arg == "--vehicle" && has_value)
+		{
+			vehicle_path = std::string(argv[++i]);
+		}
+		else if (arg == "--latency" && has_value)
+		{
+			simulator.set_latency(std::atol(argv[++i]));
+		}
+		else if (arg == "--baud" && has_value)
+		{
+			simulator.set_baud_rate(std::atol(argv[++i]));
+		}
+		else if (arg == "--max-baud" && has_value)
+		{
+			simulator.set_max_baud_rate(std::atol(argv[++i]));
+		}
+		else if (arg == "--ecus" && has_value)
+		{
+			simulator.set_ecu_count(std::atoi(argv[++i]));
+		}
+		else if (arg == "--no-data" && has_value)
+		{
+			simulator.set_no_data_percent(std::atoi(argv[++i]));
+		}
+		else if (arg == "--garbage" && has_value)
+		{
+			simulator.set_garbage_percent(std::atoi(argv[++i]));
+		}
+		else if (arg == "--protocol" && has_value)
+		{
+			simulator.set_can_protocol(std::string(argv[++i]) != "iso");
+		}
+		else if (arg == "--bus-rate" && has_value)
+		{
+			simulator.set_bus_rate(std::atol(argv[++i]));
+		}
+		else if (arg == "--search" && has_value)
+		{
+			simulator.set_search_time(std::atol(argv[++i]));
+		}
+		else if (arg == "--seed" && has_value)
+		{
+			simulator.set_seed(std::atoi(argv[++i]));
+		}
+		else
+		{
+			std::cout << "Usage elmsim [optional: --link <path> --vehicle <file> --latency <ms> --baud <rate> --max-baud <rate> --ecus <n> "
+				<< "--no-data <percent> --garbage <percent> --protocol can|iso --search <ms> --bus-rate <frames/s> --seed <n>]\n";
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (vehicle_path.empty())
+	{
+		simulator.load_default_vehicle();
+	}
+	else if (!simulator.load_vehicle(vehicle_path))
+	{
+		std::cout << "Unable to load vehicle model " << vehicle_path << "\n";
+		exit(EXIT_FAILURE);
+	}
+
+	if (!simulator.open_pty(link_name))
+	{
+		std::cout << "Unable to open a pseudo-terminal\n";
+		exit(EXIT_FAILURE);
+	}
+
+	signal(SIGINT, handle_signal);
+	signal(SIGTERM, handle_signal);
+
+	// Print the port on its own line so scripts can read it
+	std::cout << (link_name.empty() ? simulator.get_slave_name() : link_name) << std::endl;
+	simulator.run();
+
+	return 0;
+}
+
+// This constructor sets up a simulator with no latency, pacing or fault injection
+ElmSimulator::ElmSimulator()
+{
+	master_fd = -1;
+	default_latency_ms = 0;
+	baud_rate = 0;
+	max_baud_rate = 500000;
+	ecu_count = 1;
+	link_baud_rate = 38400;
+	no_data_percent = 0;
+	garbage_percent = 0;
+	can_protocol = true;
+	search_ms = 0;
+	bus_rate = 1000;
+	selected_protocol = 0;
+	auto_protocol = true;
+	start_time = std::chrono::steady_clock::now();
+
+	reset_settings();
+}
+
+// This destructor closes the pseudo-terminal
+ElmSimulator::~ElmSimulator()
+{
+	if (master_fd >= 0)
+	{
+		close(master_fd);
+	}
+}
+
+/* This function opens the pseudo-terminal the simulated adapter answers on
+* If a link path is given, a symlink to the terminal is created there, such as /tmp/ttyELM
+*/
+bool ElmSimulator::open_pty(std::string link_path)
+{
+	master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master_fd < 0 || grantpt(master_fd) != 0 || unlockpt(master_fd) != 0)
+	{
+		return false;
+	}
+
+	slave_name = std::string(ptsname(master_fd));
+
+	/* Keep the slave side open and in raw mode. Otherwise the terminal would echo
+	* commands back, and reads on the master would fail whenever no client is connected
+	*/
+	int slave_fd = open(slave_name.c_str(), O_RDWR | O_NOCTTY);
+	if (slave_fd < 0)
+	{
+		return false;
+	}
+
+	struct termios settings;
+	tcgetattr(slave_fd, &settings);
+	cfmakeraw(&settings);
+	tcsetattr(slave_fd, TCSANOW, &settings);
+
+	if (!link_path.empty())
+	{
+		unlink(link_path.c_str());
+		if (symlink(slave_name.c_str(), link_path.c_str()) != 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* This function loads a vehicle model script
+* Each line describes one item by its PID_TABLE name, for example:
+* rpm sine 800 3000 8
+* coo const 90
+* dtc codes P0133 P0420
+* vin text 1D4GP00R55B123456
+* latency rpm 40
+* Blank lines and lines starting with # are ignored
+*/
+bool ElmSimulator::load_vehicle(std::string path)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::stringstream ss(line);
+		std::string name;
+		std::string waveform;
+		if (!(ss >> name) || name[0] == '#')
+		{
+			continue;
+		}
+
+		// Per-command latency overrides the --latency default
+		if (name == "latency")
+		{
+			std::string item;
+			long latency_ms;
+			ss >> item >> latency_ms;
+
+			Channel* channel = find_channel(Command::find_command(item));
+			if (channel == nullptr)
+			{
+				std::cout << "Unknown item in latency line: " << line << "\n";
+				return false;
+			}
+
+			channel -> latency_ms = latency_ms;
+			continue;
+		}
+
+		Command::COMMAND cmd = Command::find_command(name);
+		if (cmd == Command::INVALID_COMMAND || !(ss >> waveform))
+		{
+			std::cout << "Invalid vehicle model line: " << line << "\n";
+			return false;
+		}
+
+		Channel channel = { cmd, waveform, { 0, 0, 0 }, -1, std::vector<unsigned short>(), std::vector<std::string>() };
+		if (waveform == "text")
+		{
+			std::string text;
+			while (ss >> text)
+			{
+				channel.texts.push_back(text);
+			}
+		}
+		else if (waveform == "codes")
+		{
+			std::string code;
+			while (ss >> code)
+			{
+				// Convert a code such as P0133 back to its raw 2 byte form
+				unsigned short raw_dtc = Command::parse_dtc(code);
+				if (raw_dtc == 0)
+				{
+					std::cout << "Invalid trouble code: " << code << "\n";
+					return false;
+				}
+
+				channel.dtcs.push_back(raw_dtc);
+			}
+		}
+		else
+		{
+			for (int i = 0; i < 3 && (ss >> channel.args[i]); i++);
+		}
+
+		channels.push_back(channel);
+	}
+
+	return true;
+}
+
+// This function loads a small built-in vehicle with the default dashboard items and a few extras
+void ElmSimulator::load_default_vehicle()
+{
+	channels.clear();
+
+	Channel rpm = { Command::find_command("rpm"), "sine", { 800, 3000, 8 }, -1, std::vector<unsigned short>(), std::vector<std::string>() };
+	Channel spd = { Command::find_command("spd"), "ramp", { 0, 120, 30 }, -1, std::vector<unsigned short>(), std::vector<std::string>() };
+	Channel coo = { Command::find_command("coo"), "const", { 90, 0, 0 }, -1, std::vector<unsigned short>(), std::vector<std::string>() };
+	Channel thr = { Command::find_command("thr"), "random", { 10, 40, 0 }, -1, std::vector<unsigned short>(), std::vector<std::string>() };
+	Channel lod = { Command::find_command("lod"), "sine", { 20, 60, 5 }, -1, std::vector<unsigned short>(), std::vector<std::string>() };
+	Channel iat = { Command::find_command("iat"), "const", { 25, 0, 0 }, -1, std::vector<unsigned short>(), std::vector<std::string>() };
+	Channel maf = { Command::find_command("maf"), "sine", { 2, 30, 8 }, -1, std::vector<unsigned short>(), std::vector<std::string>() };
+	Channel vlt = { Command::find_command("vlt"), "const", { 14.1, 0, 0 }, -1, std::vector<unsigned short>(), std::vector<std::string>() };
+	Channel dtc = { Command::find_command("dtc"), "codes", { 0, 0, 0 }, -1, std::vector<unsigned short>(1, 0x0133), std::vector<std::string>() };
+	Channel pdtc = { Command::find_command("pdtc"), "codes", { 0, 0, 0 }, -1, std::vector<unsigned short>(1, 0x0442), std::vector<std::string>() };
+	Channel vin = { Command::find_command("vin"), "text", { 0, 0, 0 }, -1, std::vector<unsigned short>(), std::vector<std::string>(1, "1D4GP00R55B123456") };
+	Channel cal = { Command::find_command("cal"), "text", { 0, 0, 0 }, -1, std::vector<unsigned short>(), std::vector<std::string>(1, "ELMSIM0001") };
+
+	channels.push_back(rpm);
+	channels.push_back(spd);
+	channels.push_back(coo);
+	channels.push_back(thr);
+	channels.push_back(lod);
+	channels.push_back(iat);
+	channels.push_back(maf);
+	channels.push_back(vlt);
+	channels.push_back(dtc);
+	channels.push_back(pdtc);
+	channels.push_back(vin);
+	channels.push_back(cal);
+}
+
+void ElmSimulator::set_latency(long latency_ms)
+{
+	default_latency_ms = latency_ms;
+}
+
+// A baud rate of 0 writes responses as fast as the terminal allows
+void ElmSimulator::set_baud_rate(long baud)
+{
+	baud_rate = baud;
+}
+
+// AT BRD requests above this rate are refused. A rate of 0 refuses AT BRD entirely, as many clones do
+void ElmSimulator::set_max_baud_rate(long baud)
+{
+	max_baud_rate = baud;
+}
+
+// Extra ECUs make requests for PID 00 answer with more than one message
+void ElmSimulator::set_ecu_count(int count)
+{
+	ecu_count = std::max(1, count);
+}
+
+void ElmSimulator::set_no_data_percent(int percent)
+{
+	no_data_percent = percent;
+}
+
+void ElmSimulator::set_garbage_percent(int percent)
+{
+	garbage_percent = percent;
+}
+
+// CAN vehicles answer multi-PID requests and use multi-frame responses, ISO vehicles don't
+void ElmSimulator::set_can_protocol(bool can)
+{
+	can_protocol = can;
+}
+
+// This function sets how long an automatic protocol search takes
+void ElmSimulator::set_search_time(long search_ms)
+{
+	this -> search_ms = std::max(0L, search_ms);
+}
+
+// This function sets how many frames per second the simulated bus carries in monitor mode
+void ElmSimulator::set_bus_rate(long frames_per_second)
+{
+	bus_rate = std::max(1L, frames_per_second);
+}
+
+void ElmSimulator::set_seed(unsigned int seed)
+{
+	random.seed(seed);
+}
+
+std::string ElmSimulator::get_slave_name()
+{
+	return slave_name;
+}
+
+/* This function is the main loop of the simulator
+* It reads \r terminated commands from the terminal and answers each one followed by the > prompt
+*/
+void ElmSimulator::run()
+{
+	std::string pending = "";
+	char buffer[256];
+
+	while (true)
+	{
+		ssize_t bytes_read = read(master_fd, buffer, sizeof(buffer));
+		if (bytes_read <= 0)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			continue;
+		}
+
+		pending.append(buffer, bytes_read);
+
+		std::string::size_type end;
+		while ((end = pending.find('\r')) != std::string::npos)
+		{
+			std::string command = pending.substr(0, end);
+			pending.erase(0, end + 1);
+			boost::erase_all(command, "\n");
+
+			std::string output = echo ? command + "\r" : std::string();
+
+			// Changing the baud rate is a handshake, rather than a single response
+			std::string normalized = normalize_command(command);
+			if (boost::starts_with(normalized, "ATBRD"))
+			{
+				write_paced(output);
+				negotiate_baud_rate(normalized.substr(5), pending);
+				continue;
+			}
+
+			// Monitoring streams frames until any character arrives
+			if (normalized == "ATMA" && can_protocol)
+			{
+				write_paced(output);
+				monitor_bus();
+				pending.clear();
+				continue;
+			}
+
+			long latency_ms = default_latency_ms;
+			long silence_ms = 0;
+			std::string response = handle_command(command, latency_ms, silence_ms);
+
+			if (latency_ms > 0)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(latency_ms));
+			}
+
+			write_paced(output + garble(response));
+
+			// The prompt only follows once the chip has stopped waiting for more responses
+			if (silence_ms > 0)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(silence_ms));
+			}
+
+			write_paced(end_line() + ">");
+		}
+	}
+}
+
+// This function restores the ELM327's power-on settings
+void ElmSimulator::reset_settings()
+{
+	echo = true;
+	spaces = true;
+	linefeeds = false;
+	headers = false;
+	baud_timeout_ms = 75;
+	response_timeout_ms = DEFAULT_RESPONSE_TIMEOUT_MS;
+	connected = false;
+	receive_set = false;
+	can_filter = 0;
+	can_mask = 0;
+}
+
+// This function normalizes a command, ignoring spaces and case as the ELM327 does
+std::string ElmSimulator::normalize_command(std::string command)
+{
+	boost::erase_all(command, " ");
+	for (std::string::size_type i = 0; i < command.length(); i++)
+	{
+		command[i] = std::toupper(command[i]);
+	}
+
+	return command;
+}
+
+/* This function answers a single command, without the trailing prompt
+* An empty command repeats nothing and just returns the prompt
+* OBD requests without a response count leave the chip waiting for the AT ST timeout
+* before it prompts, which is returned in silence_ms. With a count, it prompts as soon
+* as that many messages have arrived, dropping any later ones
+*/
+std::string ElmSimulator::handle_command(std::string command, long &latency_ms, long &silence_ms)
+{
+	command = normalize_command(command);
+
+	if (command.empty())
+	{
+		return std::string();
+	}
+
+	if (boost::starts_with(command, "AT"))
+	{
+		latency_ms = 0;
+		return handle_at(command.substr(2));
+	}
+
+	// OBD requests are hex bytes. An odd trailing digit is the expected response count
+	for (std::string::size_type i = 0; i < command.length(); i++)
+	{
+		if (Command::hex_value(command[i]) < 0)
+		{
+			return "?" + end_line();
+		}
+	}
+
+	std::vector<std::string>::size_type expected_messages = 0;
+	if (command.length() % 2 == 1)
+	{
+		expected_messages = Command::hex_value(command[command.length() - 1]);
+		command.erase(command.length() - 1);
+	}
+
+	if (command.length() < 2)
+	{
+		return "?" + end_line();
+	}
+
+	std::string searching = connect(latency_ms);
+	if (!connected)
+	{
+		return searching;
+	}
+
+	std::vector<std::string> messages;
+	std::string mode = command.substr(0, 2);
+
+	// Randomly drop requests, as a vehicle that's slow to answer would
+	if (no_data_percent > 0 && (int) (random() % 100) < no_data_percent)
+	{
+		mode = "";
+	}
+
+	if (mode == "01" && command.length() >= 4)
+	{
+		std::vector<unsigned char> pids;
+		for (std::string::size_type i = 2; i + 1 < command.length(); i += 2)
+		{
+			pids.push_back(std::stoi(command.substr(i, 2), nullptr, 16));
+		}
+
+		messages = handle_mode_01(pids, latency_ms);
+	}
+	else if (mode == "03" || mode == "07" || mode == "0A")
+	{
+		messages = handle_dtcs(Command::find_command(std::stoi(mode, nullptr, 16), 0x00), latency_ms);
+	}
+	else if (mode == "09" && command.length() == 4)
+	{
+		messages = handle_mode_09(std::stoi(command.substr(2, 2), nullptr, 16), latency_ms);
+	}
+
+	// NO DATA is only reported once the timeout has passed without a response
+	if (messages.empty())
+	{
+		latency_ms = std::max(latency_ms, response_timeout_ms);
+		return searching + Command::RET_NO_DATA + end_line();
+	}
+
+	if (expected_messages > 0 && expected_messages <= messages.size())
+	{
+		messages.resize(expected_messages);
+	}
+	else
+	{
+		silence_ms = response_timeout_ms;
+	}
+
+	std::string response = searching;
+	for (const std::string& message : messages)
+	{
+		response += message;
+	}
+
+	return response;
+}
+
+// This function answers AT commands, which change the ELM327's own settings
+std::string ElmSimulator::handle_at(std::string command)
+{
+	if (command == "Z" || command == "WS")
+	{
+		reset_settings();
+		return end_line() + ELM_VERSION + end_line();
+	}
+	else if (command == "I")
+	{
+		return ELM_VERSION + end_line();
+	}
+	else if (command == "@1")
+	{
+		return "OBDII to RS232 Interpreter" + end_line();
+	}
+	else if (command == "RV")
+	{
+		return "12.6V" + end_line();
+	}
+	else if (command == "DP")
+	{
+		std::string name = can_protocol ? "ISO 15765-4 (CAN 11/500)" : "ISO 9141-2";
+		return (auto_protocol ? "AUTO, " + name : name) + end_line();
+	}
+	else if (command == "DPN")
+	{
+		std::string number(1, "0123456789ABC"[connected ? get_protocol_number() : selected_protocol]);
+		return (auto_protocol ? "A" + number : number) + end_line();
+	}
+	else if ((boost::starts_with(command, "SP") || boost::starts_with(command, "TP"))
+		&& (command.length() == 3 || (command.length() == 4 && command[2] == 'A'))
+		&& Command::hex_value(command.back()) >= 0 && Command::hex_value(command.back()) <= 0xC)
+	{
+		// SP 0 searches automatically. SP A<n> tries protocol n first, then searches if it fails
+		selected_protocol = Command::hex_value(command.back());
+		auto_protocol = (command.length() == 4 || selected_protocol == 0);
+		connected = false;
+	}
+	else if (command == "E0" || command == "E1")
+	{
+		echo = (command[1] == '1');
+	}
+	else if (command == "S0" || command == "S1")
+	{
+		spaces = (command[1] == '1');
+	}
+	else if (command == "L0" || command == "L1")
+	{
+		linefeeds = (command[1] == '1');
+	}
+	else if (command == "H0" || command == "H1")
+	{
+		headers = (command[1] == '1');
+	}
+	else if (boost::starts_with(command, "BRT") && command.length() == 5
+		&& Command::hex_value(command[3]) >= 0 && Command::hex_value(command[4]) >= 0)
+	{
+		// The AT BRD handshake timeout is set in units of 5 ms, where 00 means 1.28 s
+		long units = Command::hex_value(command[3]) * 16 + Command::hex_value(command[4]);
+		baud_timeout_ms = (units == 0) ? 1280 : units * 5;
+	}
+	else if (boost::starts_with(command, "ST") && command.length() == 4
+		&& Command::hex_value(command[2]) >= 0 && Command::hex_value(command[3]) >= 0)
+	{
+		// The response timeout is set in units of 4 ms, where 00 restores the default
+		long units = Command::hex_value(command[2]) * 16 + Command::hex_value(command[3]);
+		response_timeout_ms = (units == 0) ? DEFAULT_RESPONSE_TIMEOUT_MS : units * 4;
+	}
+	else if (boost::starts_with(command, "CRA") && command.length() > 3)
+	{
+		if (!parse_can_id(command.substr(3), receive_filter, receive_mask))
+		{
+			return "?" + end_line();
+		}
+		receive_set = true;
+	}
+	else if (command == "CRA" || command == "AR")
+	{
+		receive_set = false;
+	}
+	else if (boost::starts_with(command, "CF") && command.length() > 2 && !boost::starts_with(command, "CFC"))
+	{
+		unsigned long mask;
+		if (!parse_can_id(command.substr(2), can_filter, mask))
+		{
+			return "?" + end_line();
+		}
+	}
+	else if (boost::starts_with(command, "CM") && command.length() > 2)
+	{
+		unsigned long mask;
+		if (!parse_can_id(command.substr(2), can_mask, mask))
+		{
+			return "?" + end_line();
+		}
+	}
+	else if (command == "D" || command == "M0" || command == "M1"
+		|| boost::starts_with(command, "AT")
+		|| boost::starts_with(command, "SH") || boost::starts_with(command, "CAF"))
+	{
+		// Settings that don't change the simulated responses
+	}
+	else
+	{
+		return "?" + end_line();
+	}
+
+	return "OK" + end_line();
+}
+
+/* This function connects to the vehicle before the first OBD request is answered
+* If the protocol set with AT SP is the vehicle's, it connects straight away. Otherwise, if
+* automatic searching is allowed, the chip reports SEARCHING... and tries each protocol in
+* turn, which takes --search milliseconds. The returned text goes in front of the response
+* If it can't connect, connected stays false and the returned text is the whole response
+*/
+std::string ElmSimulator::connect(long &latency_ms)
+{
+	if (connected)
+	{
+		return std::string();
+	}
+
+	if (selected_protocol == get_protocol_number())
+	{
+		connected = true;
+		return std::string();
+	}
+
+	if (!auto_protocol)
+	{
+		latency_ms = std::max(latency_ms, response_timeout_ms);
+		return "UNABLE TO CONNECT" + end_line();
+	}
+
+	latency_ms += search_ms;
+	connected = true;
+
+	return "SEARCHING..." + end_line();
+}
+
+/* This function streams broadcast frames, as AT MA shows all traffic on the bus, until a character arrives
+* Frames are produced at --bus-rate. Only those passing the AT CRA, or AT CF and AT CM,
+* filters are sent. If the link paced by --baud can't keep up and more than
+* MONITOR_BUFFER_FRAMES pile up, the chip reports BUFFER FULL and stops, as the ELM327 does
+*/
+void ElmSimulator::monitor_bus()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	unsigned long sent = 0;
+
+	while (true)
+	{
+		struct pollfd input = { master_fd, POLLIN, 0 };
+		if (poll(&input, 1, 0) > 0)
+		{
+			// The character that stops monitoring is thrown away
+			char discard[256];
+			if (read(master_fd, discard, sizeof(discard)) < 0)
+			{
+				return;
+			}
+			break;
+		}
+
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		unsigned long due = (unsigned long) (elapsed * bus_rate);
+
+		std::string output = "";
+		long waiting = 0;
+		for (; sent < due; sent++)
+		{
+			unsigned long id;
+			std::string frame = format_bus_frame(sent, id);
+			bool passes = receive_set ? (id & receive_mask) == receive_filter : (id & can_mask) == (can_filter & can_mask);
+			if (passes)
+			{
+				output += frame;
+				waiting++;
+			}
+		}
+
+		// Without --baud the link is as fast as the terminal, so it always keeps up
+		if (baud_rate > 0 && waiting > MONITOR_BUFFER_FRAMES)
+		{
+			write_paced("BUFFER FULL" + end_line());
+			break;
+		}
+
+		if (output.empty())
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		write_paced(output);
+	}
+
+	write_paced(end_line() + ">");
+}
+
+/* This function formats one broadcast frame as the ELM327 shows it while monitoring
+* The frames cycle through the vehicle's Mode 01 channels, each with its own ID, carrying
+* the channel's current value followed by a rolling counter
+*/
+std::string ElmSimulator::format_bus_frame(unsigned long frame_number, unsigned long &id)
+{
+	std::vector<Channel*> broadcasts;
+	for (Channel& channel : channels)
+	{
+		if (Command::get_info(channel.cmd).mode == 0x01)
+		{
+			broadcasts.push_back(&channel);
+		}
+	}
+
+	std::vector<unsigned char> bytes(8, 0);
+	unsigned long index = broadcasts.empty() ? 0 : frame_number % broadcasts.size();
+	id = BUS_BASE_ID + index;
+	if (!broadcasts.empty())
+	{
+		encode_channel(*broadcasts[index], bytes.data());
+	}
+	bytes[7] = frame_number & 0xFF;
+
+	std::string frame = "";
+	if (headers)
+	{
+		frame += Command::hex_digit(id >> 8);
+		frame += Command::format_hex_byte(id);
+		frame += spaces ? " " : "";
+	}
+
+	return frame + format_bytes(bytes.begin(), bytes.end()) + end_line();
+}
+
+/* This function parses a CAN ID for the monitor filters, such as 7E8, where X is a wildcard digit
+* The mask has every bit set except for the wildcards
+*/
+bool ElmSimulator::parse_can_id(std::string hex, unsigned long &value, unsigned long &mask)
+{
+	if (hex.length() != 3 && hex.length() != 8)
+	{
+		return false;
+	}
+
+	value = 0;
+	mask = 0;
+	for (char c : hex)
+	{
+		value <<= 4;
+		mask <<= 4;
+		if (c == 'X')
+		{
+			continue;
+		}
+
+		int digit = Command::hex_value(c);
+		if (digit < 0)
+		{
+			return false;
+		}
+
+		value |= digit;
+		mask |= 0xF;
+	}
+
+	return true;
+}
+
+// This function returns the ELM327 protocol number of the simulated vehicle
+int ElmSimulator::get_protocol_number()
+{
+	return can_protocol ? 6 : 3;
+}
+
+/* This function runs the AT BRD handshake for a divisor such as 23 (4 MHz / 0x23, about 115.2 kbaud)
+* OK is sent at the old rate, then the ID at the new rate. The new rate is kept only if a
+* carriage return arrives within the AT BRT timeout and the client has switched its terminal
+* to the new rate. Otherwise the old rate is restored and the prompt is sent there
+* The simulated rate is used for pacing when --baud is set
+*/
+void ElmSimulator::negotiate_baud_rate(std::string divisor, std::string &pending)
+{
+	long value = (divisor.length() == 2 && Command::hex_value(divisor[0]) >= 0 && Command::hex_value(divisor[1]) >= 0)
+		? Command::hex_value(divisor[0]) * 16 + Command::hex_value(divisor[1]) : 0;
+	long new_baud_rate = (value > 0) ? 4000000 / value : 0;
+
+	if (new_baud_rate == 0 || max_baud_rate == 0 || new_baud_rate > max_baud_rate * 105 / 100)
+	{
+		write_paced("?" + end_line() + end_line() + ">");
+		return;
+	}
+
+	write_paced("OK" + end_line());
+
+	long old_baud_rate = link_baud_rate;
+	long old_pacing_rate = baud_rate;
+	link_baud_rate = new_baud_rate;
+	if (baud_rate > 0)
+	{
+		baud_rate = new_baud_rate;
+	}
+
+	// Give the client time to switch before sending the ID at the new rate
+	std::this_thread::sleep_for(std::chrono::milliseconds(BAUD_SWITCH_DELAY_MS));
+	write_paced(ELM_VERSION + end_line());
+
+	// Wait for the client's carriage return at the new rate
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(baud_timeout_ms);
+	while (pending.find('\r') == std::string::npos)
+	{
+		long remaining_ms = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+		struct pollfd poll_fd = { master_fd, POLLIN, 0 };
+		if (remaining_ms <= 0 || poll(&poll_fd, 1, remaining_ms) <= 0)
+		{
+			break;
+		}
+
+		char buffer[256];
+		ssize_t bytes_read = read(master_fd, buffer, sizeof(buffer));
+		if (bytes_read > 0)
+		{
+			pending.append(buffer, bytes_read);
+		}
+	}
+
+	// Anything other than a lone carriage return would have been garbled at the wrong rate
+	long terminal_baud_rate = get_terminal_baud_rate();
+	bool terminal_matches = (terminal_baud_rate == 0)
+		|| (std::labs(terminal_baud_rate - new_baud_rate) * 100 <= new_baud_rate * 5);
+	if (!pending.empty() && pending[0] == '\r' && terminal_matches)
+	{
+		pending.erase(0, 1);
+		write_paced("OK" + end_line() + end_line() + ">");
+		return;
+	}
+
+	pending.clear();
+	link_baud_rate = old_baud_rate;
+	baud_rate = old_pacing_rate;
+	write_paced(end_line() + ">");
+}
+
+/* This function returns the baud rate the client has set on the terminal
+* The terminal settings are shared by both ends of a pseudo-terminal
+* It returns 0 if the rate can't be read
+*/
+long ElmSimulator::get_terminal_baud_rate()
+{
+	struct termios settings;
+	if (tcgetattr(master_fd, &settings) != 0)
+	{
+		return 0;
+	}
+
+	static const struct { speed_t speed; long baud; } rates[] = {
+		{ B9600, 9600 }, { B19200, 19200 }, { B38400, 38400 }, { B57600, 57600 },
+		{ B115200, 115200 }, { B230400, 230400 }, { B500000, 500000 }, { B1000000, 1000000 }
+	};
+
+	speed_t speed = cfgetospeed(&settings);
+	for (const auto& rate : rates)
+	{
+		if (rate.speed == speed)
+		{
+			return rate.baud;
+		}
+	}
+
+	return 0;
+}
+
+/* This function answers a Mode 01 request for one or more PIDs, with one message per responding ECU
+* PIDs 00, 20, 40, ... return the supported PID bitmaps for the vehicle model
+* Any extra ECUs only answer PID 00, with an empty bitmap
+* ISO vehicles only answer the first PID of a multi-PID request
+*/
+std::vector<std::string> ElmSimulator::handle_mode_01(std::vector<unsigned char> pids, long &latency_ms)
+{
+	std::vector<std::string> messages;
+	std::vector<unsigned char> bytes;
+	bytes.push_back(0x41);
+
+	long max_latency_ms = -1;
+	for (std::vector<unsigned char>::size_type i = 0; i < pids.size(); i++)
+	{
+		if (!can_protocol && i > 0)
+		{
+			break;
+		}
+
+		unsigned char pid = pids[i];
+		unsigned char data[4] = { 0, 0, 0, 0 };
+		int data_length = 0;
+
+		if (pid % 0x20 == 0)
+		{
+			// Set a bit for each supported PID in the following 32, most significant bit first
+			bool any = false;
+			for (std::vector<Channel>::iterator it = channels.begin(); it != channels.end(); it++)
+			{
+				const Command::PidInfo& info = Command::get_info(it -> cmd);
+				if (info.mode != 0x01 || info.pid <= pid)
+				{
+					continue;
+				}
+
+				any = true;
+				if (info.pid <= pid + 0x20)
+				{
+					int bit = info.pid - pid - 1;
+					data[bit / 8] |= 0x80 >> (bit % 8);
+				}
+				else
+				{
+					data[3] |= 0x01;
+				}
+			}
+
+			if (!any && pid != 0x00)
+			{
+				continue;
+			}
+
+			data_length = 4;
+		}
+		else
+		{
+			Channel* channel = find_channel(Command::find_command(0x01, pid));
+			if (channel == nullptr || !encode_channel(*channel, data))
+			{
+				continue;
+			}
+
+			data_length = Command::get_info(channel -> cmd).data_length;
+			max_latency_ms = std::max(max_latency_ms, channel -> latency_ms);
+		}
+
+		bytes.push_back(pid);
+		bytes.insert(bytes.end(), data, data + data_length);
+	}
+
+	if (max_latency_ms >= 0)
+	{
+		latency_ms = max_latency_ms;
+	}
+
+	if (bytes.size() > 1)
+	{
+		messages.push_back(format_response(bytes));
+	}
+
+	if (std::find(pids.begin(), pids.end(), 0x00) != pids.end())
+	{
+		for (int ecu = 1; ecu < ecu_count; ecu++)
+		{
+			std::vector<unsigned char> extra_bytes = { 0x41, 0x00, 0x00, 0x00, 0x00, 0x00 };
+			messages.push_back(format_response(extra_bytes, ecu));
+		}
+	}
+
+	return messages;
+}
+
+/* This function answers a Mode 03, 07 or 0A request with the model's stored, pending or permanent trouble codes
+* CAN vehicles send a code count after the 43, 47 or 4A header. ISO vehicles send codes
+* three at a time, each message padded with empty 0000 codes
+*/
+std::vector<std::string> ElmSimulator::handle_dtcs(Command::COMMAND cmd, long &latency_ms)
+{
+	std::vector<std::string> messages;
+	unsigned char header = Command::get_response_mode(cmd);
+	Channel* channel = find_channel(cmd);
+	std::vector<unsigned short> dtcs;
+	if (channel != nullptr)
+	{
+		dtcs = channel -> dtcs;
+		if (channel -> latency_ms >= 0)
+		{
+			latency_ms = channel -> latency_ms;
+		}
+	}
+
+	if (can_protocol)
+	{
+		std::vector<unsigned char> bytes;
+		bytes.push_back(header);
+		bytes.push_back(dtcs.size());
+		for (std::vector<unsigned short>::iterator it = dtcs.begin(); it != dtcs.end(); it++)
+		{
+			bytes.push_back(*it >> 8);
+			bytes.push_back(*it & 0xFF);
+		}
+
+		messages.push_back(format_response(bytes));
+		return messages;
+	}
+
+	for (std::vector<unsigned short>::size_type i = 0; i == 0 || i < dtcs.size(); i += 3)
+	{
+		std::vector<unsigned char> bytes;
+		bytes.push_back(header);
+		for (std::vector<unsigned short>::size_type j = i; j < i + 3; j++)
+		{
+			unsigned short raw_dtc = (j < dtcs.size()) ? dtcs[j] : 0;
+			bytes.push_back(raw_dtc >> 8);
+			bytes.push_back(raw_dtc & 0xFF);
+		}
+
+		messages.push_back(format_response(bytes));
+	}
+
+	return messages;
+}
+
+/* This function answers a Mode 09 request for vehicle information text, such as the VIN
+* CAN vehicles send one message with the number of strings after the PID, and each string
+* padded to its full length. ISO vehicles send the text 4 bytes at a time in numbered
+* messages, with the VIN padded at the front to 20 bytes
+*/
+std::vector<std::string> ElmSimulator::handle_mode_09(unsigned char pid, long &latency_ms)
+{
+	std::vector<std::string> messages;
+	Command::COMMAND cmd = Command::find_command(0x09, pid);
+	Channel* channel = (cmd != Command::INVALID_COMMAND) ? find_channel(cmd) : nullptr;
+	if (channel == nullptr || channel -> texts.empty())
+	{
+		return messages;
+	}
+
+	if (channel -> latency_ms >= 0)
+	{
+		latency_ms = channel -> latency_ms;
+	}
+
+	std::vector<unsigned char> data;
+	for (const std::string& text : channel -> texts)
+	{
+		std::string padded = text.substr(0, Command::get_info(cmd).data_length);
+		padded.resize(Command::get_info(cmd).data_length, '\0');
+		data.insert(data.end(), padded.begin(), padded.end());
+	}
+
+	if (can_protocol)
+	{
+		std::vector<unsigned char> bytes = { 0x49, pid, (unsigned char) channel -> texts.size() };
+		bytes.insert(bytes.end(), data.begin(), data.end());
+		messages.push_back(format_response(bytes));
+		return messages;
+	}
+
+	while (data.size() % 4 != 0)
+	{
+		data.insert(data.begin(), 0x00);
+	}
+
+	for (std::vector<unsigned char>::size_type i = 0; i < data.size(); i += 4)
+	{
+		std::vector<unsigned char> bytes = { 0x49, pid, (unsigned char) (i / 4 + 1) };
+		bytes.insert(bytes.end(), data.begin() + i, data.begin() + i + 4);
+		messages.push_back(format_response(bytes));
+	}
+
+	return messages;
+}
+
+// This function finds the model channel for a command, or nullptr if the vehicle doesn't support it
+Channel* ElmSimulator::find_channel(Command::COMMAND cmd)
+{
+	for (std::vector<Channel>::iterator it = channels.begin(); it != channels.end(); it++)
+	{
+		if (it -> cmd == cmd)
+		{
+			return &(*it);
+		}
+	}
+
+	return nullptr;
+}
+
+/* This function encodes the current value of a channel into response data bytes
+* The PID_TABLE formulas are linear in the raw value, so the raw value is found by
+* evaluating the formula at 0 and 1. Formulas that only use the first byte are detected
+* the same way. Formulas that don't change with either byte, such as bit counts, can't be encoded
+*/
+bool ElmSimulator::encode_channel(Channel &channel, unsigned char* data)
+{
+	const Command::PidInfo& info = Command::get_info(channel.cmd);
+	if (info.formula == nullptr)
+	{
+		return false;
+	}
+
+	unsigned char zero[4] = { 0, 0, 0, 0 };
+	unsigned char one_low[4] = { 0, 1, 0, 0 };
+	unsigned char one_high[4] = { 1, 0, 0, 0 };
+
+	double offset = info.formula(zero);
+	bool two_bytes = (info.data_length >= 2 && info.formula(one_low) != offset);
+	double scale = two_bytes ? info.formula(one_low) - offset : info.formula(one_high) - offset;
+	long max_raw = two_bytes ? 0xFFFF : 0xFF;
+	if (scale == 0)
+	{
+		return false;
+	}
+
+	long raw = std::lround((channel_value(channel) - offset) / scale);
+	raw = std::max(0L, std::min(max_raw, raw));
+
+	if (two_bytes)
+	{
+		data[0] = raw >> 8;
+		data[1] = raw & 0xFF;
+	}
+	else
+	{
+		data[0] = raw;
+	}
+
+	return true;
+}
+
+// This function calculates the current value of a channel from its waveform
+double ElmSimulator::channel_value(Channel &channel)
+{
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	double low = channel.args[0];
+	double high = channel.args[1];
+	double period = channel.args[2] > 0 ? channel.args[2] : 1.0;
+
+	if (channel.waveform == "sine")
+	{
+		return low + (high - low) * (0.5 + 0.5 * std::sin(2.0 * M_PI * elapsed / period));
+	}
+	else if (channel.waveform == "ramp")
+	{
+		return low + (high - low) * std::fmod(elapsed, period) / period;
+	}
+	else if (channel.waveform == "random")
+	{
+		return low + (high - low) * std::uniform_real_distribution<double>(0.0, 1.0)(random);
+	}
+
+	return low;
+}
+
+/* This function formats response bytes from an ECU the way the ELM327 prints them
+* CAN responses longer than 7 bytes are split into a byte count and numbered frames,
+* or raw frames with their protocol control bytes when headers are on
+* The ECU number selects the source address shown in headers, starting at 7E8 (or 10 for ISO)
+*/
+std::string ElmSimulator::format_response(std::vector<unsigned char> bytes, int ecu)
+{
+	std::string response = "";
+
+	if (!can_protocol)
+	{
+		// ISO 9141 header, then a checksum byte at the end
+		if (headers)
+		{
+			unsigned char header[] = { 0x48, 0x6B, (unsigned char) (0x10 + ecu) };
+			bytes.insert(bytes.begin(), header, header + 3);
+
+			unsigned char checksum = 0;
+			for (std::vector<unsigned char>::iterator it = bytes.begin(); it != bytes.end(); it++)
+			{
+				checksum += *it;
+			}
+			bytes.push_back(checksum);
+		}
+
+		return format_bytes(bytes.begin(), bytes.end()) + end_line();
+	}
+
+	std::string can_id = headers ? std::string("7E") + Command::hex_digit(8 + ecu) + (spaces ? " " : "") : std::string();
+	if (bytes.size() <= 7)
+	{
+		if (headers)
+		{
+			bytes.insert(bytes.begin(), (unsigned char) bytes.size());
+		}
+
+		return can_id + format_bytes(bytes.begin(), bytes.end()) + end_line();
+	}
+
+	// Pad the last consecutive frame to a full 7 bytes, as the ECU does
+	std::vector<unsigned char>::size_type length = bytes.size();
+	while ((bytes.size() + 1) % 7 != 0)
+	{
+		bytes.push_back(0x00);
+	}
+
+	if (!headers)
+	{
+		char count[4];
+		std::snprintf(count, sizeof(count), "%03lX", (unsigned long) length);
+		response += std::string(count) + end_line();
+	}
+
+	for (std::vector<unsigned char>::size_type pos = 0, frame = 0; pos < bytes.size(); frame++)
+	{
+		std::vector<unsigned char>::size_type frame_size = (frame == 0) ? 6 : 7;
+		std::vector<unsigned char> frame_bytes;
+		if (headers && frame == 0)
+		{
+			frame_bytes.push_back(0x10 | (length >> 8));
+			frame_bytes.push_back(length & 0xFF);
+		}
+		else if (headers)
+		{
+			frame_bytes.push_back(0x20 | (frame % 16));
+		}
+
+		frame_bytes.insert(frame_bytes.end(), bytes.begin() + pos, bytes.begin() + pos + frame_size);
+		pos += frame_size;
+
+		std::string prefix = headers ? can_id : std::string(1, Command::hex_digit(frame)) + (spaces ? ": " : ":");
+		response += prefix + format_bytes(frame_bytes.begin(), frame_bytes.end()) + end_line();
+	}
+
+	return response;
+}
+
+// This function prints bytes as hex, separated by spaces unless they've been turned off with AT S0
+std::string ElmSimulator::format_bytes(std::vector<unsigned char>::const_iterator begin, std::vector<unsigned char>::const_iterator end)
+{
+	std::string output = "";
+	for (std::vector<unsigned char>::const_iterator it = begin; it != end; it++)
+	{
+		output += Command::format_hex_byte(*it);
+		if (spaces)
+		{
+			output += " ";
+		}
+	}
+
+	return output;
+}
+
+// This function returns the line ending, which includes a linefeed after AT L1
+std::string ElmSimulator::end_line()
+{
+	return linefeeds ? "\r\n" : "\r";
+}
+
+/* This function randomly corrupts a response, as a noisy bus or a cheap adapter would
+* The response is either replaced by an ELM327 error message, or has some of its characters
+* replaced by random bytes
+*/
+std::string ElmSimulator::garble(std::string response)
+{
+	if (garbage_percent <= 0 || response.empty() || (int) (random() % 100) >= garbage_percent)
+	{
+		return response;
+	}
+
+	static const char* errors[] = { "CAN ERROR", "BUS ERROR", "BUFFER FULL", "STOPPED", "<DATA ERROR" };
+	if (random() % 2 == 0)
+	{
+		return std::string(errors[random() % 5]) + end_line();
+	}
+
+	int corrupt_count = 1 + random() % 3;
+	for (int i = 0; i < corrupt_count; i++)
+	{
+		// Never produce a stray prompt, which would end the response early
+		char garbage = 0x21 + random() % 0x5E;
+		response[random() % response.length()] = (garbage == '>') ? '?' : garbage;
+	}
+
+	return response;
+}
+
+/* This function writes to the terminal, pacing the output to the simulated baud rate
+* Each byte on a serial line takes 10 bits: a start bit, 8 data bits and a stop bit
+*/
+void ElmSimulator::write_paced(std::string data)
+{
+	static const std::string::size_type CHUNK_SIZE = 16;
+
+	for (std::string::size_type pos = 0; pos < data.length(); pos += CHUNK_SIZE)
+	{
+		std::string::size_type chunk = std::min(CHUNK_SIZE, data.length() - pos);
+		if (baud_rate > 0)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(chunk * 10 * 1000000 / baud_rate));
+		}
+
+		ssize_t written = write(master_fd, data.c_str() + pos, chunk);
+		if (written < 0)
+		{
+			return;
+		}
+	}
+}
+
+void show_help()
+{
+	std::cout << "'--link <path>'\t\tCreate a symlink to the simulated port, such as /tmp/ttyELM\n";
+	std::cout << "'--vehicle <file>'\tLoad a vehicle model script instead of the built-in vehicle\n";
+	std::cout << "'--latency <ms>'\tDelay every OBDII response\n";
+	std::cout << "'--baud <rate>'\t\tPace responses to a serial baud rate, such as 38400\n";
+	std::cout << "'--max-baud <rate>'\tHighest rate accepted by AT BRD, or 0 to refuse it (default 500000)\n";
+	std::cout << "'--ecus <n>'\t\tNumber of ECUs that answer PID 00 (default 1)\n";
+	std::cout << "'--no-data <percent>'\tAnswer a percentage of requests with NO DATA\n";
+	std::cout << "'--garbage <percent>'\tCorrupt a percentage of responses\n";
+	std::cout << "'--protocol can|iso'\tSimulate a CAN (default) or ISO 9141 vehicle\n";
+	std::cout << "'--search <ms>'\t\tTime an automatic protocol search takes. AT SP with the right protocol skips it (default 0)\n";
+	std::cout << "'--bus-rate <n>'\tFrames per second on the bus in AT MA monitor mode (default 1000)\n";
+	std::cout << "'--seed <n>'\t\tSeed the random number generator for reproducible runs\n";
+}
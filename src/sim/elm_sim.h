@@ -0,0 +1,151 @@
+/* This file contains function declarations and includes for the ELM327 simulator
+*
+* Author: Josh McIntyre
+*/
+
+#ifndef ELM_SIM_H
+#define ELM_SIM_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <poll.h>
+#include <boost/algorithm/string/erase.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include "command.h"
+
+/* This struct describes how the simulated vehicle produces the value for one command
+* Waveforms are const (value), sine (min, max, period), ramp (min, max, period) and random (min, max)
+* DTC commands list raw trouble codes instead, and text commands such as the VIN list strings
+*/
+struct Channel
+{
+	Command::COMMAND cmd;
+	std::string waveform;
+	double args[3];
+	long latency_ms;
+	std::vector<unsigned short> dtcs;
+	std::vector<std::string> texts;
+};
+
+/* This class emulates an ELM327 adapter connected to a vehicle
+* It opens a pseudo-terminal that obdcmd can use like a real serial port
+* and answers AT commands and Mode 01/03/09 requests from a scriptable vehicle model
+* AT BRD baud rate changes are checked against the rate the client sets on the terminal
+*/
+class ElmSimulator
+{
+	private:
+		int master_fd;
+		std::string slave_name;
+
+		// Vehicle model
+		std::vector<Channel> channels;
+		std::chrono::steady_clock::time_point start_time;
+
+		// Simulation settings
+		long default_latency_ms;
+		long baud_rate;
+		long max_baud_rate;
+		int ecu_count;
+		int no_data_percent;
+		int garbage_percent;
+		bool can_protocol;
+		long search_ms;
+		long bus_rate;
+		std::mt19937 random;
+
+		// ELM327 settings changed via AT commands
+		bool echo;
+		bool spaces;
+		bool linefeeds;
+		bool headers;
+		long baud_timeout_ms;
+		long link_baud_rate;
+		long response_timeout_ms;
+
+		// Protocol selected with AT SP, where 0 is automatic, and whether it's connected to the vehicle yet
+		int selected_protocol;
+		bool auto_protocol;
+		bool connected;
+
+		// Monitor filters. A frame is shown if its ID matches the filter in the bits set in the mask
+		unsigned long receive_filter;
+		unsigned long receive_mask;
+		bool receive_set;
+		unsigned long can_filter;
+		unsigned long can_mask;
+
+		void reset_settings();
+		std::string normalize_command(std::string command);
+		std::string handle_command(std::string command, long &latency_ms, long &silence_ms);
+		void negotiate_baud_rate(std::string divisor, std::string &pending);
+		long get_terminal_baud_rate();
+		std::string handle_at(std::string command);
+		std::string connect(long &latency_ms);
+		int get_protocol_number();
+		void monitor_bus();
+		std::string format_bus_frame(unsigned long frame_number, unsigned long &id);
+		bool parse_can_id(std::string hex, unsigned long &value, unsigned long &mask);
+		std::vector<std::string> handle_mode_01(std::vector<unsigned char> pids, long &latency_ms);
+		std::vector<std::string> handle_dtcs(Command::COMMAND cmd, long &latency_ms);
+		std::vector<std::string> handle_mode_09(unsigned char pid, long &latency_ms);
+		Channel* find_channel(Command::COMMAND cmd);
+		bool encode_channel(Channel &channel, unsigned char* data);
+		double channel_value(Channel &channel);
+		std::string format_response(std::vector<unsigned char> bytes, int ecu = 0);
+		std::string format_bytes(std::vector<unsigned char>::const_iterator begin, std::vector<unsigned char>::const_iterator end);
+		std::string end_line();
+		std::string garble(std::string response);
+		void write_paced(std::string data);
+
+	public:
+		// Version string reported by ATZ and ATI
+		static const char ELM_VERSION[];
+
+		// Pause between the OK and the ID during an AT BRD handshake
+		static constexpr long BAUD_SWITCH_DELAY_MS = 5;
+
+		// The ELM327 holds this many frames waiting to go out before it gives up with BUFFER FULL
+		static constexpr long MONITOR_BUFFER_FRAMES = 24;
+
+		// Simulated broadcast frames take IDs upwards from this one, one per channel
+		static constexpr unsigned long BUS_BASE_ID = 0x100;
+
+		// The ELM327's default AT ST response timeout
+		static constexpr long DEFAULT_RESPONSE_TIMEOUT_MS = 200;
+
+		ElmSimulator();
+		~ElmSimulator();
+		bool open_pty(std::string link_path);
+		bool load_vehicle(std::string path);
+		void load_default_vehicle();
+		void set_latency(long latency_ms);
+		void set_baud_rate(long baud);
+		void set_max_baud_rate(long baud);
+		void set_ecu_count(int count);
+		void set_no_data_percent(int percent);
+		void set_garbage_percent(int percent);
+		void set_can_protocol(bool can);
+		void set_search_time(long search_ms);
+		void set_bus_rate(long frames_per_second);
+		void set_seed(unsigned int seed);
+		std::string get_slave_name();
+		void run();
+};
+
+void show_help();
+
+#endif
@@ -0,0 +1,125 @@
+/* This file contains code that draws the polling mode dashboard with incremental updates
+*
+* Author: Josh McIntyre
+*/
+
+#include "dashboard.h"
+
+// This constructor sets the frame rate. A rate of 0 or less selects DEFAULT_FPS
+Dashboard::Dashboard(double fps)
+{
+	if (fps <= 0)
+	{
+		fps = DEFAULT_FPS;
+	}
+
+	interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / fps));
+	next_frame = std::chrono::steady_clock::now();
+	drawn = false;
+}
+
+/* This function waits until the next frame is due
+* Frames are kept on a fixed cadence; if drawing fell behind, the next frame is due straight away
+*/
+void Dashboard::wait_for_frame()
+{
+	std::this_thread::sleep_until(next_frame);
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	next_frame += interval;
+	if (next_frame < now)
+	{
+		next_frame = now + interval;
+	}
+}
+
+/* This function draws a frame
+* The first frame clears the screen. After that, each line that differs from the last frame
+* is rewritten from its first changed character, and cleared past its new end if it got
+* shorter. Lines that are no longer in the frame are cleared
+*/
+void Dashboard::render(const std::vector<std::string>& lines)
+{
+	output.clear();
+	if (!drawn)
+	{
+		output += "\033[2J";
+		frame.clear();
+		drawn = true;
+	}
+
+	std::vector<std::string>::size_type rows = std::max(lines.size(), frame.size());
+	for (std::vector<std::string>::size_type row = 0; row < rows; row++)
+	{
+		static const std::string empty;
+		const std::string& previous = (row < frame.size()) ? frame[row] : empty;
+		const std::string& current = (row < lines.size()) ? lines[row] : empty;
+		if (row < frame.size() && previous == current)
+		{
+			continue;
+		}
+
+		std::string::size_type start = (row < frame.size()) ? get_change_start(previous, current) : 0;
+		output += "\033[" + std::to_string(row + 1) + ";" + std::to_string(get_column(current, start)) + "H";
+		output.append(current, start, std::string::npos);
+		if (current.length() < previous.length())
+		{
+			output += "\033[K";
+		}
+	}
+
+	if (output.empty())
+	{
+		return;
+	}
+
+	// Leave the cursor below the dashboard
+	output += "\033[" + std::to_string(lines.size() + 1) + ";1H";
+
+	std::fwrite(output.data(), 1, output.size(), stdout);
+	std::fflush(stdout);
+
+	frame = lines;
+}
+
+// This function forces the next frame to redraw the whole screen, such as after other output
+void Dashboard::invalidate()
+{
+	drawn = false;
+}
+
+/* This function finds where a line first differs from its previous version
+* Every character printed today is a single byte, the degree sign included (cp437 "\370"). The
+* position is still moved back past any UTF-8 continuation bytes, in case a label ever uses them
+*/
+std::string::size_type Dashboard::get_change_start(const std::string& previous, const std::string& current)
+{
+	std::string::size_type start = 0;
+	while (start < previous.length() && start < current.length() && previous[start] == current[start])
+	{
+		start++;
+	}
+
+	while (start > 0 && start < current.length() && (current[start] & 0xC0) == 0x80)
+	{
+		start--;
+	}
+
+	return start;
+}
+
+// This function converts a byte position in a line to a terminal column, counting from 1
+int Dashboard::get_column(const std::string& line, std::string::size_type position)
+{
+	int column = 1;
+	for (std::string::size_type i = 0; i < position && i < line.length(); i++)
+	{
+		// Only guards against future UTF-8 labels, since every character printed today is one byte
+		if ((line[i] & 0xC0) != 0x80)
+		{
+			column++;
+		}
+	}
+
+	return column;
+}
@@ -0,0 +1,44 @@
+/* This file contains function declarations and includes for the polling mode dashboard
+*
+* Author: Josh McIntyre
+*/
+
+#ifndef DASHBOARD_H
+#define DASHBOARD_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+/* This class draws a screen of text lines on a terminal, redrawing only what has changed
+* It keeps the last frame it drew. Each new frame is compared against it line by line, and
+* only the changed tail of each changed line is rewritten, using cursor addressing. The whole
+* update goes out in a single write, and frames are paced at a fixed rate, independent of how
+* often the data behind them changes
+*/
+class Dashboard
+{
+	private:
+		std::vector<std::string> frame;
+		bool drawn;
+		std::string output;
+		std::chrono::steady_clock::duration interval;
+		std::chrono::steady_clock::time_point next_frame;
+
+		static std::string::size_type get_change_start(const std::string& previous, const std::string& current);
+		static int get_column(const std::string& line, std::string::size_type position);
+
+	public:
+		// Ten frames per second looks live, without flooding a slow terminal or SSH session
+		static constexpr double DEFAULT_FPS = 10.0;
+
+		Dashboard(double fps = DEFAULT_FPS);
+		void wait_for_frame();
+		void render(const std::vector<std::string>& lines);
+		void invalidate();
+};
+
+#endif
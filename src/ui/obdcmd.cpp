@@ -10,47 +10,346 @@
 // This function is the main entry point for the program
 int main(int argc, char* argv[])
 {
-	// Retrieve the serial port from the command line
+	// Retrieve the serial port and options from the command line
 	std::string port = "";
 	std::string mode = MODE_INTERACTIVE;
 	std::string cmd = COMMAND_ALL;
+	std::string record_path = "";
+	std::string export_path = "";
+	std::string capture_path = "";
+	std::string replay_path = "";
+	std::string fleet_ports = "";
+	std::string monitor_path = "";
+	std::string filter = "";
+	std::string share_name = "";
+	std::string values_name = "";
+	std::string serve_path = "";
+	std::string connect_path = "";
+	#ifdef LINUX
+		long max_age_ms = ObdServer::DEFAULT_MAX_AGE_MS;
+	#else
+		long max_age_ms = 0;
+	#endif
+	std::string metric_specs = "";
+	std::string dtc_log_path = "";
+	int threads = Fleet::DEFAULT_THREADS;
+	double fps = Dashboard::DEFAULT_FPS;
+	bool realtime = false;
+	bool compress = false;
+	long baud = SerialConnection::DEFAULT_BAUD_RATE;
+	std::string cache_path = VehicleCache::get_default_path();
 
-	if (argc == 3)
+	std::vector<std::string> args;
+	for (int i = 1; i < argc; i++)
 	{
-		port = std::string(argv[1]);
+		std::string arg = std::string(argv[i]);
+
+		// Show command/help information directly from the command line
+		if (arg == "--help" || arg == "-h")
+		{
+			show_help();
+			exit(0);
+		}
+		else if (arg == "--record" && i + 1 < argc)
+		{
+			record_path = std::string(argv[++i]);
+		}
+		else if (arg == "--export" && i + 1 < argc)
+		{
+			export_path = std::string(argv[++i]);
+		}
+		else if (arg == "--capture" && i + 1 < argc)
+		{
+			capture_path = std::string(argv[++i]);
+		}
+		else if (arg == "--replay" && i + 1 < argc)
+		{
+			replay_path = std::string(argv[++i]);
+		}
+		else if (arg == "--baud" && i + 1 < argc)
+		{
+			baud = std::atol(argv[++i]);
+		}
+		else if (arg == "--fleet" && i + 1 < argc)
+		{
+			fleet_ports = std::string(argv[++i]);
+		}
+		else if (arg == "--threads" && i + 1 < argc)
+		{
+			threads = std::atoi(argv[++i]);
+		}
+		else if (arg == "--fps" && i + 1 < argc)
+		{
+			fps = std::atof(argv[++i]);
+		}
+		else if (arg == "--cache" && i + 1 < argc)
+		{
+			cache_path = std::string(argv[++i]);
+		}
+		else if (arg == "--no-cache")
+		{
+			cache_path = "";
+		}
+		else if (arg == "--monitor" && i + 1 < argc)
+		{
+			monitor_path = std::string(argv[++i]);
+		}
+		else if (arg == "--filter" && i + 1 < argc)
+		{
+			filter = std::string(argv[++i]);
+		}
+		else if (arg == "--share" && i + 1 < argc)
+		{
+			share_name = std::string(argv[++i]);
+		}
+		else if (arg == "--values" && i + 1 < argc)
+		{
+			values_name = std::string(argv[++i]);
+		}
+		else if (arg == "--serve" && i + 1 < argc)
+		{
+			serve_path = std::string(argv[++i]);
+		}
+		else if (arg == "--connect" && i + 1 < argc)
+		{
+			connect_path = std::string(argv[++i]);
+		}
+		else if (arg == "--max-age" && i + 1 < argc)
+		{
+			max_age_ms = std::atol(argv[++i]);
+		}
+		else if (arg == "--metrics" && i + 1 < argc)
+		{
+			metric_specs = std::string(argv[++i]);
+		}
+		else if (arg == "--dtc-log" && i + 1 < argc)
+		{
+			dtc_log_path = std::string(argv[++i]);
+		}
+		else if (arg == "--realtime")
+		{
+			realtime = true;
+		}
+		else if (arg == "--compress")
+		{
+			compress = true;
+		}
+		else
+		{
+			args.push_back(arg);
+		}
+	}
+
+	// Exporting a recording doesn't need a device
+	if (!export_path.empty() && args.empty())
+	{
+		return export_recording(export_path) ? 0 : EXIT_FAILURE;
+	}
+
+	// Reading values shared by another obdcmd doesn't need a device
+	if (!values_name.empty() && args.empty())
+	{
+		return dump_shared_values(values_name) ? 0 : EXIT_FAILURE;
+	}
+
+	// Neither does asking a server for values
+	if (!connect_path.empty() && args.size() <= 1)
+	{
+		#ifdef LINUX
+			return query_server(connect_path, args.empty() ? COMMAND_ALL : args[0], max_age_ms) ? 0 : EXIT_FAILURE;
+		#else
+			std::cout << "Connecting to a server is only supported on Linux\n";
+			return EXIT_FAILURE;
+		#endif
+	}
+
+	// Metrics are checked before anything else is set up, so a typo is reported straight away
+	MetricsEngine metrics;
+	if (!parse_metrics(metric_specs, metrics))
+	{
+		std::cout << "Invalid metric. Run obdcmd --help for a list of valid metrics\n";
+		exit(EXIT_FAILURE);
+	}
+
+	// Replaying a capture doesn't need a device either, but can be recorded
+	if (!replay_path.empty() && args.empty())
+	{
+		std::unique_ptr<Recorder> recorder;
+		if (!record_path.empty())
+		{
+			recorder.reset(new Recorder(record_path, Recording::DEFAULT_BLOCK_CAPACITY, compress));
+			if (!recorder -> is_open())
+			{
+				std::cout << "Unable to open " << record_path << " for recording\n";
+				exit(EXIT_FAILURE);
+			}
+		}
+
+		return replay_capture(replay_path, realtime, recorder.get(), metrics) ? 0 : EXIT_FAILURE;
+	}
+
+	// Polling several devices takes a list of ports and the items, with no port argument
+	if (!fleet_ports.empty() && args.size() <= 1)
+	{
+		mode = MODE_FLEET;
+		cmd = args.empty() ? COMMAND_ALL : args[0];
+	}
+	else if (args.size() == 2)
+	{
+		port = args[0];
 		mode = MODE_POLL;
-		cmd = std::string(argv[2]);
+		cmd = args[1];
 	}
-	else if (argc == 2)
+	else if (args.size() == 1)
 	{
-		port = std::string(argv[1]);
+		port = args[0];
+		mode = !monitor_path.empty() ? MODE_MONITOR : (!serve_path.empty() ? MODE_SERVE : MODE_INTERACTIVE);
 	}
 	else
 	{
-		std::cout << "Usage obdcmd [required: <serial port>]\n";
+		std::cout << "Usage obdcmd [required: <serial port>] [optional: all | <datapoint>[,<datapoint>...]] [optional: --record <file> [optional: --compress]] [optional: --capture <file>] [optional: --baud <rate>] [optional: --fps <rate>] [optional: --metrics <metric>[,<metric>...]] [optional: --share <name>] [optional: --dtc-log <file>] [optional: --cache <file> | --no-cache]\n";
+		std::cout << "      obdcmd --fleet <serial port>,<serial port>[,...] [optional: all | <datapoint>[,<datapoint>...]] [optional: --threads <count>] [optional: --record <file> [optional: --compress]] [optional: --capture <file>] [optional: --baud <rate>] [optional: --share <name>] [optional: --dtc-log <file>] [optional: --cache <file> | --no-cache]\n";
+		std::cout << "      obdcmd <serial port> --monitor <file | -> [optional: --filter <id>[/<mask>]] [optional: --baud <rate>]\n";
+		std::cout << "      obdcmd <serial port> --serve <socket> [optional: --max-age <ms>] [optional: --capture <file>] [optional: --baud <rate>] [optional: --cache <file> | --no-cache]\n";
+		std::cout << "      obdcmd --connect <socket> [optional: all | <datapoint>[,<datapoint>...]] [optional: --max-age <ms>]\n";
+		std::cout << "      obdcmd --replay <file> [optional: --realtime] [optional: --record <file> [optional: --compress]] [optional: --metrics <metric>[,<metric>...]]\n";
+		std::cout << "      obdcmd --export <file>\n";
+		std::cout << "      obdcmd --values <name>\n";
 		exit(EXIT_FAILURE);
 	}
 
-    // Show command/help information directly from the command line
-    if (port == "--help" || port == "-h")
-    {
-        show_help();
-        exit(0);
-    }
+	// Look up the requested items before connecting, so a typo doesn't wait on device setup
+	std::vector<Command::COMMAND> cmds;
+	std::vector<double> rates;
+	if (mode == MODE_POLL || mode == MODE_FLEET)
+	{
+		cmds = parse_items(cmd, rates);
+		if (cmds.empty())
+		{
+			std::cout << "Invalid datapoint. Run obdcmd --help for a list of valid datapoints\n";
+			exit(EXIT_FAILURE);
+		}
+
+		// Watching trouble codes polls every kind of code, at their default rates
+		if (!dtc_log_path.empty())
+		{
+			for (Command::COMMAND dtc_cmd : DtcTracker::COMMANDS)
+			{
+				if (std::find(cmds.begin(), cmds.end(), dtc_cmd) == cmds.end())
+				{
+					cmds.push_back(dtc_cmd);
+					rates.push_back(0);
+				}
+			}
+		}
+	}
+
+	// Open the recording before connecting, so a bad path is reported straight away
+	std::unique_ptr<Recorder> recorder;
+	if (!record_path.empty())
+	{
+		recorder.reset(new Recorder(record_path, Recording::DEFAULT_BLOCK_CAPACITY, compress));
+		if (!recorder -> is_open())
+		{
+			std::cout << "Unable to open " << record_path << " for recording\n";
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	std::unique_ptr<std::ofstream> dtc_log;
+	if (!dtc_log_path.empty() && (mode == MODE_POLL || mode == MODE_FLEET))
+	{
+		dtc_log.reset(new std::ofstream(dtc_log_path, std::ios::app));
+		if (!dtc_log -> is_open())
+		{
+			std::cout << "Unable to open " << dtc_log_path << " for logging trouble codes\n";
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (mode == MODE_FLEET)
+	{
+		std::vector<std::string> ports;
+		std::stringstream ss(fleet_ports);
+		std::string fleet_port;
+		while (std::getline(ss, fleet_port, ','))
+		{
+			ports.push_back(fleet_port);
+		}
+
+		// Each device gets its own table, numbered like the captures, such as obdcmd.0
+		std::vector<std::unique_ptr<SharedValuesWriter> > shared_values;
+		if (!share_name.empty())
+		{
+			for (int i = 0; i < (int) ports.size(); i++)
+			{
+				shared_values.emplace_back(open_shared_values(share_name + "." + std::to_string(i)));
+			}
+		}
+
+		std::cout << "Initializing settings for " << ports.size() << " devices (this may take a moment)...";
+		Fleet fleet(ports, baud, threads, cache_path);
+		std::cout << "Done!" << std::endl;
+
+		if (!capture_path.empty() && !fleet.start_capture(capture_path))
+		{
+			std::cout << "Unable to open " << capture_path << " for capturing\n";
+			exit(EXIT_FAILURE);
+		}
+
+		fleet_loop(fleet, cmds, rates, recorder.get(), shared_values, dtc_log.get(), fps);
+		return 0;
+	}
+
+	if (mode == MODE_SERVE)
+	{
+		#ifdef LINUX
+			std::cout << "Initializing settings (this may take a moment)...";
+			ObdServer server(port, baud, cache_path, serve_path, max_age_ms);
+			std::cout << "Done! (" << server.get_device().get_baud_rate() << " baud" << format_vehicle(server.get_device()) << ")" << std::endl;
+
+			if (!capture_path.empty() && !server.start_capture(capture_path))
+			{
+				std::cout << "Unable to open " << capture_path << " for capturing\n";
+				exit(EXIT_FAILURE);
+			}
+
+			return serve_loop(server, serve_path) ? 0 : EXIT_FAILURE;
+		#else
+			std::cout << "Serving is only supported on Linux\n";
+			return EXIT_FAILURE;
+		#endif
+	}
+
+	std::unique_ptr<SharedValuesWriter> shared_values;
+	if (!share_name.empty() && mode == MODE_POLL)
+	{
+		shared_values.reset(open_shared_values(share_name));
+	}
 
 	// Declare an ElmDevice instance that will initialize the connection via its constructor
 	std::cout << "Initializing settings (this may take a moment)...";
-	ElmDevice elm_device(port);
-	std::cout << "Done!" << std::endl;
+	ElmDevice elm_device(port, baud, cache_path);
+	std::cout << "Done! (" << elm_device.get_baud_rate() << " baud" << format_vehicle(elm_device) << ")" << std::endl;
+
+	if (!capture_path.empty() && !elm_device.start_capture(capture_path))
+	{
+		std::cout << "Unable to open " << capture_path << " for capturing\n";
+		exit(EXIT_FAILURE);
+	}
 	
 	// Enter appropriate run loop
 	if (mode == MODE_INTERACTIVE)
 	{
 		main_menu(elm_device);
 	}
+	else if (mode == MODE_MONITOR)
+	{
+		return monitor_loop(elm_device, filter, monitor_path) ? 0 : EXIT_FAILURE;
+	}
 	else
 	{
-		poll_loop(elm_device, cmd);
+		poll_loop(elm_device, cmds, rates, recorder.get(), shared_values.get(), metrics, dtc_log.get(), fps);
 	}
 
 	return 0;
@@ -66,9 +365,19 @@ void main_menu(ElmDevice &elm_device)
 		std::string menu_cmd;
 		std::getline(std::cin, menu_cmd);
 		
+		Command::COMMAND item = Command::find_command(menu_cmd);
+		
 		if (menu_cmd == "dumpall" || menu_cmd == "da")
 		{
-			dump_all(elm_device);
+			dump_all(elm_device, parse_items(COMMAND_ALL));
+		}
+		else if (menu_cmd == "stats" || menu_cmd == "s")
+		{
+			dump_stats(elm_device);
+		}
+		else if (menu_cmd == "stats reset")
+		{
+			elm_device.clear_stats();
 		}
 		else if (menu_cmd == "help" || menu_cmd == "h")
 		{
@@ -78,9 +387,9 @@ void main_menu(ElmDevice &elm_device)
 		{
 			exit(0);
 		}
-		else if (cmd_items.find(menu_cmd) != cmd_items.end())
+		else if (item != Command::INVALID_COMMAND)
 		{
-			dump_item(elm_device, menu_cmd);
+			dump_item(elm_device, item);
 		}
 		else
 		{
@@ -89,82 +398,953 @@ void main_menu(ElmDevice &elm_device)
 	}
 }
 
-void poll_loop(ElmDevice &elm_device, std::string cmd)
+/* This function polls the requested items until the program is interrupted
+* Each item is fetched at its own rate by the scheduler on an acquisition thread, so a slow
+* terminal can't lower the sample rate. The display is redrawn from its own ring at fps
+* frames per second, and if a recorder is given, every sample is recorded from another ring
+* on a separate thread. Shared values are updated by the acquisition thread itself
+* Metrics are updated from the display's samples, in the order they were taken, and so are
+* trouble code changes, if they're being logged
+*/
+void poll_loop(ElmDevice &elm_device, std::vector<Command::COMMAND> cmds, std::vector<double> rates, Recorder* recorder,
+	SharedValuesWriter* shared_values, MetricsEngine &metrics, std::ofstream* dtc_log, double fps)
+{
+	// Items the metrics need are polled too, at their default rates
+	for (Command::COMMAND cmd : metrics.get_required_commands())
+	{
+		if (std::find(cmds.begin(), cmds.end(), cmd) == cmds.end())
+		{
+			cmds.push_back(cmd);
+			rates.push_back(0);
+		}
+	}
+
+	// Items the vehicle doesn't support are left out of the schedule, and listed below the values
+	PollScheduler scheduler;
+	std::string unsupported = "";
+	for (int i = 0; i < (int) cmds.size(); i++)
+	{
+		if (!elm_device.is_supported(cmds[i]))
+		{
+			unsupported += (unsupported.empty() ? "" : ", ") + std::string(Command::get_info(cmds[i]).name);
+			continue;
+		}
+
+		scheduler.add_item(cmds[i], rates[i]);
+	}
+	std::vector<ScheduledItem> items = scheduler.get_items();
+
+	/* The display may skip samples when the terminal is slow, but metrics integrate trip totals
+	* and the trouble code log tracks every change, so they get a ring of their own
+	*/
+	Acquisition acquisition(elm_device, scheduler);
+	SampleRing* display_ring = acquisition.subscribe();
+	SampleRing* record_ring = (recorder != nullptr) ? acquisition.subscribe() : nullptr;
+	SampleRing* analysis_ring = (metrics.size() > 0 || dtc_log != nullptr) ? acquisition.subscribe() : nullptr;
+	acquisition.share(shared_values);
+
+	// Stop cleanly on Ctrl+C, so the recording gets its footer index
+	signal(SIGINT, handle_stop);
+	signal(SIGTERM, handle_stop);
+
+	acquisition.start();
+
+	std::atomic<bool> acquisition_done(false);
+	std::thread record_thread;
+	if (record_ring != nullptr)
+	{
+		record_thread = drain_ring(record_ring, acquisition_done, [recorder](const Sample& sample)
+		{
+			recorder -> record(sample.timestamp_us, sample.item.cmd, sample.item.reading);
+		});
+	}
+
+	// The metrics are shared with the display, which reads them every frame
+	std::mutex metrics_lock;
+	DtcTracker dtc_tracker;
+	std::thread analysis_thread;
+	if (analysis_ring != nullptr)
+	{
+		analysis_thread = drain_ring(analysis_ring, acquisition_done, [&metrics, &metrics_lock, &dtc_tracker, dtc_log](const Sample& sample)
+		{
+			{
+				std::lock_guard<std::mutex> guard(metrics_lock);
+				metrics.add_sample(sample.timestamp_us, sample.item.cmd, sample.item.reading);
+			}
+
+			if (dtc_log != nullptr)
+			{
+				log_dtc_changes(dtc_tracker, *dtc_log, sample.timestamp_us, 0, sample.item);
+			}
+		});
+	}
+
+	Dashboard dashboard(fps);
+	while (!stop_requested)
+	{
+		dashboard.wait_for_frame();
+
+		Sample sample;
+		while (display_ring -> pop(sample))
+		{
+			items[sample.index] = sample.item;
+		}
+
+		std::vector<std::string> metric_lines;
+		{
+			std::lock_guard<std::mutex> guard(metrics_lock);
+			for (int i = 0; i < metrics.size(); i++)
+			{
+				metric_lines.push_back(format_metric(metrics, i));
+			}
+		}
+
+		dump_schedule_poll(dashboard, items, metric_lines, unsupported, display_ring -> get_dropped());
+	}
+
+	// Stop acquiring first, then let the recorder and metrics drain what's left in their rings
+	acquisition.stop();
+	acquisition_done = true;
+	if (record_thread.joinable())
+	{
+		record_thread.join();
+
+		if (record_ring -> get_dropped() > 0)
+		{
+			std::cerr << "Recorder dropped " << record_ring -> get_dropped() << " samples\n";
+		}
+	}
+
+	if (analysis_thread.joinable())
+	{
+		analysis_thread.join();
+
+		if (analysis_ring -> get_dropped() > 0)
+		{
+			std::cerr << "Metrics and trouble code log dropped " << analysis_ring -> get_dropped() << " samples\n";
+		}
+	}
+}
+
+/* This function starts a thread that passes every sample in a ring to consume, as it arrives
+* Once done is set, the thread drains what's left in the ring and returns
+*/
+std::thread drain_ring(SampleRing* ring, std::atomic<bool>& done, std::function<void(const Sample&)> consume)
 {
+	return std::thread([ring, &done, consume]()
+	{
+		Sample sample;
+		while (true)
+		{
+			if (ring -> pop(sample))
+			{
+				consume(sample);
+			}
+			else if (done)
+			{
+				break;
+			}
+			else
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+	});
+}
+
+/* This function polls the requested items on every device in a fleet until the program is interrupted
+* Samples are shared from the pool threads as they arrive, and queued, tagged with their device
+* number, for a writer thread that records them and logs trouble code changes, so slow storage
+* never holds up the adapters. This thread redraws the latest values of every device at fps
+* frames per second
+*/
+void fleet_loop(Fleet &fleet, std::vector<Command::COMMAND> cmds, std::vector<double> rates, Recorder* recorder,
+	std::vector<std::unique_ptr<SharedValuesWriter> >& shared_values, std::ofstream* dtc_log, double fps)
+{
+	for (int i = 0; i < (int) cmds.size(); i++)
+	{
+		fleet.add_item(cmds[i], rates[i]);
+	}
+
+	signal(SIGINT, handle_stop);
+	signal(SIGTERM, handle_stop);
+
+	// The writer's ring and the snapshots are shared by the pool threads. The lock keeps the ring to one producer at a time
+	std::mutex lock;
+	std::vector<std::vector<ScheduledItem> > snapshots(fleet.size());
+	std::unique_ptr<SampleRing> write_ring((recorder != nullptr || dtc_log != nullptr) ? new SampleRing() : nullptr);
+
+	std::atomic<bool> polling_done(false);
+	DtcTracker dtc_tracker;
+	std::thread write_thread;
+	if (write_ring)
+	{
+		write_thread = drain_ring(write_ring.get(), polling_done, [recorder, dtc_log, &dtc_tracker](const Sample& sample)
+		{
+			if (recorder != nullptr)
+			{
+				recorder -> record(sample.timestamp_us, sample.item.cmd, sample.item.reading, sample.device);
+			}
+
+			if (dtc_log != nullptr)
+			{
+				log_dtc_changes(dtc_tracker, *dtc_log, sample.timestamp_us, sample.device, sample.item);
+			}
+		});
+	}
+
+	SampleRing* ring = write_ring.get();
+	fleet.start([&lock, &snapshots, ring, &shared_values](int device, PollScheduler& scheduler, const std::vector<int>& updated)
+	{
+		int64_t timestamp_us = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+
+		// Each device's table has a single writer, its pool thread, so it's updated outside the lock
+		if (!shared_values.empty())
+		{
+			for (int index : updated)
+			{
+				const ScheduledItem& item = scheduler.get_items()[index];
+				shared_values[device] -> publish(timestamp_us, item.cmd, item.reading);
+			}
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+
+		if (ring != nullptr)
+		{
+			Sample sample;
+			sample.timestamp_us = timestamp_us;
+			sample.device = device;
+			for (int index : updated)
+			{
+				sample.index = index;
+				sample.item = scheduler.get_items()[index];
+				ring -> push(sample);
+			}
+		}
+
+		snapshots[device] = scheduler.get_items();
+	});
+
+	// The snapshots are copied out under the lock, so a slow terminal doesn't hold up the pool threads either
+	Dashboard dashboard(fps);
+	while (!stop_requested)
+	{
+		dashboard.wait_for_frame();
+
+		std::vector<std::vector<ScheduledItem> > frame;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			frame = snapshots;
+		}
+		dump_fleet_poll(dashboard, fleet, frame);
+	}
+
+	// Stop polling first, then let the writer drain what's left in its ring
+	fleet.stop();
+	polling_done = true;
+	if (write_thread.joinable())
+	{
+		write_thread.join();
+
+		if (write_ring -> get_dropped() > 0)
+		{
+			std::cerr << "Recorder dropped " << write_ring -> get_dropped() << " samples\n";
+		}
+	}
+}
+
+/* This function writes every frame on the bus to a file, or stdout for -, until the program is interrupted
+* Frames are parsed on the monitor thread into a ring, and formatted here straight from the
+* ring into a large buffer, which is written out whenever it fills or the ring runs dry
+* A summary goes to stderr at the end, so it isn't mixed in with frames on stdout
+*/
+bool monitor_loop(ElmDevice &elm_device, std::string filter, std::string output_path)
+{
+	FILE* output = (output_path == "-") ? stdout : std::fopen(output_path.c_str(), "w");
+	if (output == nullptr)
+	{
+		std::cout << "Unable to open " << output_path << " for monitoring\n";
+		return false;
+	}
+
+	signal(SIGINT, handle_stop);
+	signal(SIGTERM, handle_stop);
+
+	CanMonitor monitor(elm_device, filter);
+	monitor.start();
+
+	int id_digits = monitor.get_id_digits();
+	std::vector<char> buffer(1 << 16);
+	std::size_t used = 0;
 	while (true)
 	{
-		if (cmd == COMMAND_ALL)
+		const CanFrame* frames;
+		std::size_t count = monitor.get_ring().read(frames);
+		for (std::size_t i = 0; i < count; i++)
 		{
-			dump_all_poll(elm_device);
+			if (used + CanMonitor::MAX_LINE_LENGTH > buffer.size())
+			{
+				std::fwrite(buffer.data(), 1, used, output);
+				used = 0;
+			}
+
+			used += CanMonitor::format_frame(frames[i], id_digits, buffer.data() + used);
 		}
-		else if (cmd_items.find(cmd) != cmd_items.end())
+		monitor.get_ring().release(count);
+
+		if (count > 0)
 		{
-			dump_item_poll(elm_device, cmd);
+			continue;
 		}
 
-		#ifdef WINDOWS
-			Sleep(POLL_INTERVAL);
-		#endif
-		
-		#ifdef LINUX
-			usleep(POLL_INTERVAL);
-		#endif
+		std::fwrite(buffer.data(), 1, used, output);
+		std::fflush(output);
+		used = 0;
+
+		// Once stopped, the last frames are written out before finishing
+		if (stop_requested || !monitor.is_running())
+		{
+			monitor.stop();
+			if (monitor.get_ring().read(frames) == 0)
+			{
+				break;
+			}
+			continue;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	if (output != stdout)
+	{
+		std::fclose(output);
 	}
+
+	if (monitor.has_failed())
+	{
+		std::cerr << "The adapter didn't accept the filter " << filter << "\n";
+		return false;
+	}
+
+	FrameParser& parser = monitor.get_parser();
+	std::cerr << parser.get_frames() << " frames, " << parser.get_errors() << " errors, "
+		<< parser.get_overflows() << " adapter buffer overflows, " << monitor.get_ring().get_dropped() << " dropped\n";
+
+	return true;
 }
 
-void dump_item(ElmDevice &elm_device, std::string item)
+#ifdef LINUX
+/* This function serves the device to local clients until the program is interrupted
+* A summary of how the requests were served goes to stderr at the end
+*/
+bool serve_loop(ObdServer &server, std::string socket_path)
 {
-	std::cout << "Dumping requested OBDII data...\n";
+	if (!server.start())
+	{
+		std::cout << "Unable to serve on " << socket_path << "\n";
+		return false;
+	}
+
+	signal(SIGINT, handle_stop);
+	signal(SIGTERM, handle_stop);
 
-	std::string data = elm_device.get_data(cmd_items[item]);
-	std::cout << cmd_labels[item] << data << cmd_units[item] << std::endl;
+	std::cout << "Serving on " << socket_path << ". Press Ctrl+C to stop" << std::endl;
+	while (!stop_requested)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	server.stop();
+
+	ServerStats stats = server.get_stats();
+	std::cerr << stats.clients << " clients, " << stats.requests << " requests for " << stats.items << " items: "
+		<< stats.cached << " from cache, " << stats.coalesced << " shared with other requests, "
+		<< stats.fetched << " fetched in " << stats.fetches << " batches\n";
+
+	return true;
 }
 
-void dump_item_poll(ElmDevice &elm_device, std::string item)
+/* This function asks a server for items and prints its answer, a line per item
+* such as "rpm	OK	1726	1700000000123456"
+*/
+bool query_server(std::string socket_path, std::string items, long max_age_ms)
 {
-	std::string data = elm_device.get_data(cmd_items[item]);
+	std::vector<Command::COMMAND> cmds = parse_items(items);
+	if (cmds.empty())
+	{
+		std::cout << "Invalid datapoint. Run obdcmd --help for a list of valid datapoints\n";
+		return false;
+	}
+
+	std::string request = "";
+	for (Command::COMMAND cmd : cmds)
+	{
+		request += (request.empty() ? "" : ",") + std::string(Command::get_info(cmd).name);
+	}
+	request += " " + std::to_string(max_age_ms) + "\n";
+
+	boost::asio::io_service io;
+	boost::asio::local::stream_protocol::socket socket(io);
+	boost::system::error_code error;
+	socket.connect(boost::asio::local::stream_protocol::endpoint(socket_path), error);
+	if (error)
+	{
+		std::cout << "Unable to connect to " << socket_path << "\n";
+		return false;
+	}
+
+	boost::asio::write(socket, boost::asio::buffer(request), error);
+	boost::asio::streambuf buffer;
+	for (int i = 0; i < (int) cmds.size() && !error; i++)
+	{
+		boost::asio::read_until(socket, buffer, '\n', error);
+	}
+	if (error)
+	{
+		std::cout << "The server at " << socket_path << " didn't answer\n";
+		return false;
+	}
+
+	std::cout << &buffer;
+	return true;
+}
+#endif
+
+void handle_stop(int)
+{
+	stop_requested = 1;
+}
+
+/* This function replays a capture of raw exchanges through the decoder
+* Each exchange is decoded as if it had just arrived from the device, then printed,
+* or recorded with its original timestamp if a recorder is given
+* Replay runs as fast as possible, or at the recorded speed if realtime is set
+* Any metrics are updated along the way, and printed at the end
+*/
+bool replay_capture(std::string path, bool realtime, Recorder* recorder, MetricsEngine &metrics)
+{
+	CaptureReader reader(path);
+	if (!reader.is_open())
+	{
+		std::cout << "Unable to read capture " << path << "\n";
+		return false;
+	}
+
+	signal(SIGINT, handle_stop);
+	signal(SIGTERM, handle_stop);
+
+	long exchanges = 0;
+	long readings = 0;
+	int64_t first_timestamp_us = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	CaptureRecord record;
+	Command::COMMAND cmds[Command::MAX_BATCH_SIZE];
+	Command::Reading data[Command::MAX_BATCH_SIZE];
+	while (!stop_requested && reader.next(record))
+	{
+		if (exchanges == 0)
+		{
+			first_timestamp_us = record.timestamp_us;
+		}
+		exchanges++;
+
+		if (realtime)
+		{
+			std::this_thread::sleep_until(start + std::chrono::microseconds(record.timestamp_us - first_timestamp_us));
+		}
+
+		int count = Command::parse_request(record.command, cmds, Command::MAX_BATCH_SIZE);
+		if (count == 1)
+		{
+			data[0] = Command::decode(record.response, cmds[0]);
+		}
+		else if (count > 1)
+		{
+			Command::decode_batch(record.response, cmds, count, data);
+		}
+
+		for (int i = 0; i < count; i++)
+		{
+			metrics.add_sample(record.timestamp_us, cmds[i], data[i]);
+
+			if (recorder != nullptr)
+			{
+				recorder -> record(record.timestamp_us, cmds[i], data[i]);
+			}
+			else
+			{
+				std::cout << std::fixed << std::setprecision(3) << (record.timestamp_us - first_timestamp_us) / 1e6 << "\t"
+					<< format_item(cmds[i], data[i]) << "\n";
+			}
+		}
+		readings += count;
+	}
 
-	std::cout << "\033[2J\033[H";
-	std::cout << cmd_labels[item] << data << cmd_units[item];
+	double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cerr << "Replayed " << exchanges << " exchanges (" << readings << " readings) in " << elapsed_s << " s\n";
+
+	for (int i = 0; i < metrics.size(); i++)
+	{
+		std::cout << format_metric(metrics, i) << "\n";
+	}
+
+	return true;
 }
 
-void dump_all(ElmDevice &elm_device)
+/* This function prints a recording as CSV, one sample per line
+* Trouble code samples are printed as codes, such as P0133
+*/
+bool export_recording(std::string path)
+{
+	RecordingReader reader(path);
+	if (!reader.is_open())
+	{
+		std::cout << "Unable to read recording " << path << "\n";
+		return false;
+	}
+
+	std::cout << "timestamp_us,device,item,value,status\n";
+	reader.scan(INT64_MIN, INT64_MAX, Recording::ANY_PID, [](int64_t timestamp_us, uint8_t device, uint16_t pid_code, double value, uint8_t status)
+	{
+		Command::COMMAND cmd = Command::find_command(pid_code >> 8, pid_code & 0xFF);
+		std::cout << timestamp_us << "," << (int) device << ",";
+		if (cmd == Command::INVALID_COMMAND)
+		{
+			std::cout << std::hex << pid_code << std::dec;
+		}
+		else
+		{
+			std::cout << Command::get_info(cmd).name;
+		}
+
+		if (cmd != Command::INVALID_COMMAND && Command::get_info(cmd).type == Command::TYPE_DTCS)
+		{
+			char dtc[6];
+			Command::format_dtc((unsigned short) value, dtc);
+			std::cout << "," << dtc;
+		}
+		else
+		{
+			std::cout << "," << value;
+		}
+
+		std::cout << "," << (int) status << "\n";
+	});
+
+	return true;
+}
+
+/* This function opens a shared values table for writing, exiting if it can't
+* such as when another obdcmd is already publishing under the same name
+*/
+SharedValuesWriter* open_shared_values(std::string name)
+{
+	SharedValuesWriter* writer = new SharedValuesWriter(name);
+	if (!writer -> is_open())
+	{
+		std::cout << "Unable to share values as " << name << ". Is another obdcmd using that name?\n";
+		exit(EXIT_FAILURE);
+	}
+
+	return writer;
+}
+
+/* This function prints the latest values shared by another obdcmd, along with their age
+* Items that haven't been read yet are left out
+*/
+bool dump_shared_values(std::string name)
+{
+	SharedValuesReader reader(name);
+	if (!reader.is_open())
+	{
+		std::cout << "No shared values named " << name << "\n";
+		return false;
+	}
+
+	if (!reader.is_live())
+	{
+		std::cout << "The obdcmd sharing " << name << " has stopped. These are its last values\n";
+	}
+
+	int64_t now_us = Capture::now_us();
+	for (int i = 0; i < reader.get_slot_count(); i++)
+	{
+		SharedValue shared;
+		if (!reader.read(i, shared) || shared.timestamp_us == 0)
+		{
+			continue;
+		}
+
+		// Slots are matched to items by PID code, in case the writer's PID table differs
+		Command::COMMAND cmd = Command::find_command(shared.pid_code >> 8, shared.pid_code & 0xFF);
+		if (cmd == Command::INVALID_COMMAND)
+		{
+			continue;
+		}
+
+		Command::Reading reading = {};
+		reading.status = shared.status;
+		reading.type = (Command::get_info(cmd).type == Command::TYPE_FLOAT) ? Command::TYPE_FLOAT : Command::TYPE_INT;
+		reading.unit = shared.unit;
+		reading.value = shared.value;
+
+		std::cout << format_item(cmd, reading) << " (" << (now_us - shared.timestamp_us) / 1000 << " ms ago)\n";
+	}
+
+	return true;
+}
+
+/* This function writes a line for each trouble code that was set or cleared since the item was last read
+* The log starts with a CSV header if it's empty, and is flushed after every change, since changes are rare
+*/
+void log_dtc_changes(DtcTracker &tracker, std::ofstream &dtc_log, int64_t timestamp_us, int device, const ScheduledItem& item)
+{
+	std::vector<DtcChange> changes;
+	if (!tracker.update(timestamp_us, device, item.cmd, item.reading, changes))
+	{
+		return;
+	}
+
+	if (dtc_log.tellp() == 0)
+	{
+		dtc_log << DtcTracker::format_header() << "\n";
+	}
+
+	for (const DtcChange& change : changes)
+	{
+		dtc_log << DtcTracker::format_change(change) << "\n";
+	}
+	dtc_log.flush();
+}
+
+void dump_item(ElmDevice &elm_device, Command::COMMAND cmd)
+{
+	std::cout << "Dumping requested OBDII data...\n";
+
+	Command::Reading reading = elm_device.get_data(cmd);
+	std::cout << format_item(cmd, reading) << std::endl;
+	std::cout << format_dtc_descriptions(reading);
+}
+
+void dump_all(ElmDevice &elm_device, std::vector<Command::COMMAND> cmds)
 {
 	std::cout << "Dumping all currently available OBDII data...\n";
 
-	for (int i = 0; i < AVAILABLE_COMMANDS_SIZE; i++)
+	std::vector<Command::Reading> data = elm_device.get_data_batch(cmds);
+	for (int i = 0; i < (int) cmds.size(); i++)
+	{
+		std::cout << format_item(cmds[i], data[i]) << std::endl;
+		std::cout << format_dtc_descriptions(data[i]);
+	}
+}
+
+/* This function prints latency statistics for every item fetched so far
+* Each exchange is split into writing the request, waiting for the first byte of the response
+* (mostly the vehicle bus) and waiting for the prompt (the adapter finishing up), followed by
+* decoding on our side
+*/
+void dump_stats(ElmDevice &elm_device)
+{
+	const std::map<Command::COMMAND, CommandStats>& commands = elm_device.get_stats().get_commands();
+	if (commands.empty())
+	{
+		std::cout << "No items fetched yet\n";
+		return;
+	}
+
+	for (const std::pair<const Command::COMMAND, CommandStats>& entry : commands)
+	{
+		const CommandStats& stats = entry.second;
+		double elapsed_s = std::chrono::duration<double>(stats.last_sample - stats.first_sample).count();
+
+		std::cout << std::fixed << std::setprecision(1);
+		std::cout << Command::get_info(entry.first).label << " (" << Command::get_info(entry.first).name << "): "
+			<< stats.samples << " samples";
+		if (elapsed_s > 0)
+		{
+			std::cout << ", " << (stats.samples - 1) / elapsed_s << "/s";
+		}
+		std::cout << ", " << 100.0 * stats.no_data / stats.samples << "% NO DATA, " << stats.timeouts << " timeouts\n";
+
+		std::cout << "\twrite\t\t" << format_histogram(stats.write_us, "us") << "\n";
+		std::cout << "\tfirst byte\t" << format_histogram(stats.first_byte_us, "us") << "\n";
+		std::cout << "\tprompt\t\t" << format_histogram(stats.prompt_us, "us") << "\n";
+		std::cout << "\tdecode\t\t" << format_histogram(stats.decode_ns, "ns") << "\n";
+	}
+}
+
+// This function builds a line of percentiles for a histogram, such as "p50 1200 us ..."
+std::string format_histogram(const LatencyHistogram& histogram, std::string unit)
+{
+	std::stringstream ss;
+	ss << "p50 " << histogram.get_percentile(50) << " " << unit
+		<< "\tp90 " << histogram.get_percentile(90) << " " << unit
+		<< "\tp99 " << histogram.get_percentile(99) << " " << unit
+		<< "\tmax " << histogram.get_max() << " " << unit;
+
+	return ss.str();
+}
+
+/* This function redraws the latest value of every polled item, followed by the metrics
+* Only the parts of the screen that changed since the last frame are rewritten
+* Items that can't be fetched at their target rate are listed at the end, along with
+* any samples the display skipped because it fell behind
+*/
+void dump_schedule_poll(Dashboard &dashboard, const std::vector<ScheduledItem>& items, const std::vector<std::string>& metric_lines, std::string unsupported, unsigned long dropped)
+{
+	std::vector<std::string> lines;
+	for (const ScheduledItem& item : items)
+	{
+		lines.push_back(format_item(item.cmd, item.reading));
+	}
+
+	lines.insert(lines.end(), metric_lines.begin(), metric_lines.end());
+
+	if (!unsupported.empty())
+	{
+		lines.push_back("Not supported by this vehicle: " + unsupported);
+	}
+
+	for (const ScheduledItem& item : items)
+	{
+		if (PollScheduler::is_behind(item))
+		{
+			std::stringstream ss;
+			ss << std::fixed << std::setprecision(1) << "Behind target rate: " << Command::get_info(item.cmd).label << " "
+				<< item.achieved_hz << "/" << item.rate_hz << " Hz";
+			lines.push_back(ss.str());
+		}
+	}
+
+	if (dropped > 0)
+	{
+		lines.push_back("Display skipped " + std::to_string(dropped) + " samples");
+	}
+
+	dashboard.render(lines);
+}
+
+// This function redraws the latest value of every polled item, grouped by device
+void dump_fleet_poll(Dashboard &dashboard, Fleet &fleet, const std::vector<std::vector<ScheduledItem> >& snapshots)
+{
+	std::vector<std::string> lines;
+	for (int i = 0; i < fleet.size(); i++)
 	{
-		std::string item = available_items[i];
-		std::string data = elm_device.get_data(cmd_items[item]);
-		std::cout << cmd_labels[item] << data << cmd_units[item] << std::endl;
+		lines.push_back("[" + std::to_string(i) + "] " + fleet.get_port(i) + " (" + std::to_string(fleet.get_baud_rate(i)) + " baud)");
+		for (const ScheduledItem& item : snapshots[i])
+		{
+			lines.push_back("    " + format_item(item.cmd, item.reading));
+		}
 	}
+
+	dashboard.render(lines);
+}
+
+// This function parses a comma separated list of item names, such as rpm,spd,maf
+std::vector<Command::COMMAND> parse_items(std::string items)
+{
+	std::vector<double> rates;
+	return parse_items(items, rates);
 }
 
-void dump_all_poll(ElmDevice &elm_device)
+/* This function parses a comma separated list of item names with optional polling rates
+* in Hz, such as rpm@20,spd@5,coo. Items without a rate get a rate of 0 (the default)
+* It returns an empty list if any of the names aren't in PID_TABLE
+*/
+std::vector<Command::COMMAND> parse_items(std::string items, std::vector<double> &rates)
 {
-	std::string output = "";
-	for (int i = 0; i < AVAILABLE_COMMANDS_SIZE; i++)
+	rates.clear();
+
+	if (items == COMMAND_ALL)
 	{
-		std::string item = available_items[i];
-		std::string data = elm_device.get_data(cmd_items[item]);
-		output += cmd_labels[item] + data + cmd_units[item] + "\n";
+		rates.resize(std::size(default_items), 0);
+		return std::vector<Command::COMMAND>(std::begin(default_items), std::end(default_items));
 	}
 
-	std::cout << "\033[2J\033[H";
-	std::cout << output;
+	std::vector<Command::COMMAND> cmds;
+	std::stringstream ss(items);
+	std::string item;
+	while (std::getline(ss, item, ','))
+	{
+		std::string::size_type at = item.find('@');
+		double rate = 0;
+		if (at != std::string::npos)
+		{
+			rate = std::atof(item.substr(at + 1).c_str());
+			item = item.substr(0, at);
+		}
+
+		Command::COMMAND cmd = Command::find_command(item);
+		if (cmd == Command::INVALID_COMMAND || rate < 0)
+		{
+			rates.clear();
+			return std::vector<Command::COMMAND>();
+		}
+
+		cmds.push_back(cmd);
+		rates.push_back(rate);
+	}
+
+	return cmds;
 }
+
+/* This function parses a comma separated list of metrics, such as rpm:mean@10,economy
+* It returns false if any of them aren't valid
+*/
+bool parse_metrics(std::string specs, MetricsEngine &metrics)
+{
+	std::stringstream ss(specs);
+	std::string spec;
+	while (std::getline(ss, spec, ','))
+	{
+		if (!metrics.add_metric(spec))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// This function builds a display line for a metric, such as "Engine RPM mean over 10 s: 1726.25 RPM"
+std::string format_metric(MetricsEngine &metrics, int metric)
+{
+	double value;
+	if (!metrics.get_value(metric, value))
+	{
+		return metrics.get_label(metric) + ": " + std::string(Command::RET_NO_DATA);
+	}
+
+	std::stringstream ss;
+	ss << metrics.get_label(metric) << ": " << std::fixed << std::setprecision(2) << value << metrics.get_unit(metric);
+	return ss.str();
+}
+
+// This function builds a display line for an item, such as "Engine RPM: 1726 RPM"
+std::string format_item(Command::COMMAND cmd, Command::Reading reading)
+{
+	const Command::PidInfo& info = Command::get_info(cmd);
+
+	std::string output = std::string(info.label) + ": " + format_reading(reading);
+	if (reading.status == Command::STATUS_OK)
+	{
+		output += Command::get_unit_suffix(info.unit);
+	}
+
+	return output;
+}
+
+/* This function converts a decoded reading to a human-readable string for display
+* DTCs are listed as comma separated codes, such as P0133, P0420
+*/
+std::string format_reading(Command::Reading reading)
+{
+	switch (reading.status)
+	{
+		case Command::STATUS_NO_DATA:
+			return std::string(Command::RET_NO_DATA);
+
+		case Command::STATUS_TIMEOUT:
+			return std::string(Command::RET_TIMEOUT);
+
+		case Command::STATUS_INVALID:
+			return std::string(Command::RET_INVALID);
+
+		default:
+			break;
+	}
+
+	std::stringstream ss;
+	if (reading.type == Command::TYPE_DTCS)
+	{
+		for (int i = 0; i < reading.dtc_count; i++)
+		{
+			char dtc[6];
+			Command::format_dtc(reading.dtcs[i], dtc);
+			ss << (i > 0 ? ", " : "") << dtc;
+		}
+	}
+	else if (reading.type == Command::TYPE_TEXT)
+	{
+		ss << reading.text;
+	}
+	else if (reading.type == Command::TYPE_FLOAT)
+	{
+		ss << std::fixed << std::setprecision(1) << reading.value;
+	}
+	else
+	{
+		ss << std::lround(reading.value);
+	}
+
+	return ss.str();
+}
+
+/* This function lists the trouble codes in a reading with their descriptions, one per line, such as
+*     P0133: O2 sensor circuit slow response (bank 1 sensor 1)
+* It returns an empty string for other readings
+*/
+std::string format_dtc_descriptions(Command::Reading reading)
+{
+	if (reading.status != Command::STATUS_OK || reading.type != Command::TYPE_DTCS)
+	{
+		return "";
+	}
+
+	std::stringstream ss;
+	for (int i = 0; i < reading.dtc_count; i++)
+	{
+		char dtc[6];
+		Command::format_dtc(reading.dtcs[i], dtc);
+		const char* description = Command::get_dtc_description(reading.dtcs[i]);
+
+		ss << "    " << dtc << ": " << (description != nullptr ? description : "Unknown or manufacturer specific code") << "\n";
+	}
+
+	return ss.str();
+}
+
+/* This function describes the vehicle found during setup, for the startup message
+* such as ", VIN 1D4GP00R55B123456, protocol 6, from cache"
+*/
+std::string format_vehicle(ElmDevice &elm_device)
+{
+	const VehicleInfo& vehicle = elm_device.get_vehicle();
+	if (vehicle.protocol <= 0)
+	{
+		return ", no vehicle found";
+	}
+
+	std::string description = vehicle.vin.empty() ? "" : ", VIN " + vehicle.vin;
+	description += ", protocol " + std::to_string(vehicle.protocol);
+
+	return elm_device.is_vehicle_cached() ? description + ", from cache" : description;
+}
+
 void show_help()
 {
 	std::cout << "'dumpall'\t\tDump all available OBDII data:\n";
 	std::cout << "'<datapoint>'\t\tDump a specific item\n";
-	std::cout << "\t\t\t(dtc) : First 3 diagnostic trouble code (DTCs)\n";
-	std::cout << "\t\t\t(coo) : Current coolant temperature in degrees Celcius\n";
-	std::cout << "\t\t\t(rpm) : Current engine RPM\n";
-	std::cout << "\t\t\t(spd) : Current vehicle speed in kilometers per hour\n";
-	std::cout << "\t\t\t(thr) : Current throttle position as percentage of throttle used\n";
+	for (int i = 0; i < PID_TABLE_SIZE; i++)
+	{
+		std::cout << "\t\t\t(" << PID_TABLE[i].name << ") : " << PID_TABLE[i].label << "\n";
+	}
 	
+	std::cout << "'--metrics'\t\tWork out metrics while polling or replaying, as <channel>[:<stat>[@<window s>]]\n";
+	std::cout << "\t\t\tChannels are the datapoints above, or:\n";
+	for (int i = 0; i < DERIVED_TABLE_SIZE; i++)
+	{
+		std::cout << "\t\t\t(" << DERIVED_TABLE[i].name << ") : " << DERIVED_TABLE[i].label << "\n";
+	}
+	std::cout << "\t\t\tStats are value, min, max, mean and ewma (default window " << MetricsEngine::DEFAULT_WINDOW_S << " s)\n";
+
+	std::cout << "'stats'\t\t\tShow latency percentiles, rates, NO DATA and timeouts for each item fetched\n";
+	std::cout << "'stats reset'\t\tClear the statistics\n";
+
 	std::cout << "'help'\t\t\tShow this help text\n";
 	
 	std::cout << "'quit'\t\t\tQuit the OBDII utility\n";
 }
-
@@ -4,49 +4,79 @@
 */
 
 #include <iostream>
+#include <iomanip>
+#include <sstream>
 #include "elm_device.h"
+#include "scheduler.h"
+#include "recorder.h"
+#include "fleet.h"
+#include "acquisition.h"
+#include "dashboard.h"
+#include "monitor.h"
+#include "shared_values.h"
+#include "server.h"
+#include "metrics.h"
+#include "dtc_tracker.h"
+#include <memory>
+#include <csignal>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <cstdio>
+#include <fstream>
 
 void main_menu(ElmDevice &elm_device);
-void poll_loop(ElmDevice &elm_device, std::string cmd);
-void dump_item(ElmDevice &elm_device, std::string item);
-void dump_item_poll(ElmDevice &elm_device, std::string item);
-void dump_all(ElmDevice &elm_device);
-void dump_all_poll(ElmDevice &elm_device);
+void poll_loop(ElmDevice &elm_device, std::vector<Command::COMMAND> cmds, std::vector<double> rates, Recorder* recorder,
+	SharedValuesWriter* shared_values, MetricsEngine &metrics, std::ofstream* dtc_log, double fps);
+void fleet_loop(Fleet &fleet, std::vector<Command::COMMAND> cmds, std::vector<double> rates, Recorder* recorder,
+	std::vector<std::unique_ptr<SharedValuesWriter> >& shared_values, std::ofstream* dtc_log, double fps);
+bool monitor_loop(ElmDevice &elm_device, std::string filter, std::string output_path);
+#ifdef LINUX
+bool serve_loop(ObdServer &server, std::string socket_path);
+bool query_server(std::string socket_path, std::string items, long max_age_ms);
+#endif
+void handle_stop(int signal);
+std::thread drain_ring(SampleRing* ring, std::atomic<bool>& done, std::function<void(const Sample&)> consume);
+bool export_recording(std::string path);
+bool replay_capture(std::string path, bool realtime, Recorder* recorder, MetricsEngine &metrics);
+SharedValuesWriter* open_shared_values(std::string name);
+bool dump_shared_values(std::string name);
+void log_dtc_changes(DtcTracker &tracker, std::ofstream &dtc_log, int64_t timestamp_us, int device, const ScheduledItem& item);
+void dump_item(ElmDevice &elm_device, Command::COMMAND cmd);
+void dump_all(ElmDevice &elm_device, std::vector<Command::COMMAND> cmds);
+void dump_stats(ElmDevice &elm_device);
+std::string format_histogram(const LatencyHistogram& histogram, std::string unit);
+void dump_schedule_poll(Dashboard &dashboard, const std::vector<ScheduledItem>& items, const std::vector<std::string>& metric_lines, std::string unsupported, unsigned long dropped);
+void dump_fleet_poll(Dashboard &dashboard, Fleet &fleet, const std::vector<std::vector<ScheduledItem> >& snapshots);
+std::vector<Command::COMMAND> parse_items(std::string items);
+std::vector<Command::COMMAND> parse_items(std::string items, std::vector<double> &rates);
+bool parse_metrics(std::string specs, MetricsEngine &metrics);
+std::string format_metric(MetricsEngine &metrics, int metric);
+std::string format_item(Command::COMMAND cmd, Command::Reading reading);
+std::string format_reading(Command::Reading reading);
+std::string format_dtc_descriptions(Command::Reading reading);
+std::string format_vehicle(ElmDevice &elm_device);
 void show_help();
 
 // Available UI modes
 const std::string MODE_INTERACTIVE = "cmd";
 const std::string MODE_POLL = "poll";
+const std::string MODE_FLEET = "fleet";
+const std::string MODE_MONITOR = "monitor";
+const std::string MODE_SERVE = "serve";
 
-// Definitions for polling
-const int POLL_INTERVAL = 1000;
+// Set by handle_stop to end polling mode
+volatile std::sig_atomic_t stop_requested = 0;
 
-// Create maps of available command data to Command::COMMANDS, units, and labels
+// Items are looked up by name in PID_TABLE. 'all' selects the default dashboard items
 const std::string COMMAND_ALL = "all";
 
-const int AVAILABLE_COMMANDS_SIZE = 5;
-std::string available_items[AVAILABLE_COMMANDS_SIZE] = { "dtc", "coo", "rpm", "spd", "thr" };
-
-std::map<std::string, Command::COMMAND> cmd_items = {
-	{ "dtc", Command::GET_DTCS },
-	{ "coo", Command::GET_COOLANT_TEMP },
-	{ "rpm", Command::GET_ENGINE_RPM },
-	{ "spd", Command::GET_VEHICLE_SPEED },
-	{ "thr", Command::GET_THROTTLE_POS }
-};
-
-std::map<std::string, std::string> cmd_units = {
-	{ "dtc", "" },
-	{ "coo", "\370C" },
-	{ "rpm", " RPM" },
-	{ "spd", " km/h" },
-	{ "thr", "%" }
-};
-
-std::map<std::string, std::string> cmd_labels = {
-	{ "dtc", "Diagnostic code(s): " },
-	{ "coo", "Coolant temp: " },
-	{ "rpm", "Engine RPM: " },
-	{ "spd", "Vehicle speed: " },
-	{ "thr", "Throttle position: " }
+constexpr Command::COMMAND default_items[] = {
+	Command::find_command("dtc"),
+	Command::find_command("coo"),
+	Command::find_command("rpm"),
+	Command::find_command("spd"),
+	Command::find_command("thr")
 };